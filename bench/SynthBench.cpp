@@ -0,0 +1,416 @@
+#include "WaveSynth.hpp"
+#include "StringSynth.hpp"
+#include "GuitarSynth.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace geiger::midi;
+
+//times every synth's three ways of producing audio: Value() one sample at a time, GenerateSample() a whole
+//sample at once, and RenderBlock() the way the engine's callback does, and writes the figures as JSON or CSV
+//results are meant to be diffed between commits on the same machine, so each case reports its fastest run,
+//which moves least with whatever else the machine happens to be doing
+
+namespace {
+
+	struct Options {
+		uint32_t sample_rate;
+		uint32_t block_size;
+
+		//each case runs this many times and each run lasts at least 'min_seconds'
+		uint32_t repeats;
+		double min_seconds;
+
+		std::string format;
+		std::string output;
+
+		//copied into every result, e.g. a commit hash, so files from different builds can be told apart
+		std::string label;
+
+		//only cases whose name contains this are run
+		std::string filter;
+	};
+
+	struct Result {
+		std::string name;
+		std::string synth;
+		std::string path;
+		std::string parameter;
+
+		uint64_t samples;
+		double best_ns_per_sample;
+		double median_ns_per_sample;
+		double samples_per_second;
+		double realtime_factor;
+	};
+
+	//renders one second of audio (or a little more) and returns how many samples that was
+	typedef std::function<uint64_t()> Pass;
+
+	//keeps the compiler from dropping output nobody reads
+	volatile float sink = 0.0f;
+
+	typedef std::chrono::steady_clock Clock;
+
+	void Usage(const char* program) {
+		std::cerr << "Usage: " << program << " [options]\n";
+		std::cerr << "\t--format json|csv   output format (default json, or taken from --output's extension)\n";
+		std::cerr << "\t--output <path>     write results here instead of to standard output\n";
+		std::cerr << "\t--label <text>      stored with every result, e.g. the commit being measured\n";
+		std::cerr << "\t--filter <text>     only run cases whose name contains <text>\n";
+		std::cerr << "\t--repeats <n>       timed runs per case (default 5)\n";
+		std::cerr << "\t--min-time <s>      shortest timed run, in seconds (default 0.2)\n";
+		std::cerr << "\t--rate <hz>         sample rate to render at (default 44100)\n";
+		std::cerr << "\t--block <frames>    block size for the RenderBlock path (default 512)\n";
+	}
+
+	bool EndsWith(const std::string& text, const std::string& suffix) {
+		return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+
+	bool ParseOptions(int argc, char* argv[], Options& options) {
+		options.sample_rate = 44100;
+		options.block_size = 512;
+		options.repeats = 5;
+		options.min_seconds = 0.2;
+
+		for(int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+
+			if(arg == "--help" || arg == "-h") {
+				return false;
+			}
+
+			if(i + 1 >= argc) {
+				std::cerr << "[SynthBench] Error reading options\n\t";
+				std::cerr << "Reason: " << arg << " needs a value.\n\n";
+				return false;
+			}
+
+			std::string value = argv[++i];
+
+			if(arg == "--format") {
+				options.format = value;
+			} else if(arg == "--output") {
+				options.output = value;
+			} else if(arg == "--label") {
+				options.label = value;
+			} else if(arg == "--filter") {
+				options.filter = value;
+			} else if(arg == "--repeats") {
+				options.repeats = (uint32_t)(std::max(1, std::atoi(value.c_str())));
+			} else if(arg == "--min-time") {
+				options.min_seconds = std::max(0.001, std::atof(value.c_str()));
+			} else if(arg == "--rate") {
+				options.sample_rate = (uint32_t)(std::max(1000, std::atoi(value.c_str())));
+			} else if(arg == "--block") {
+				options.block_size = (uint32_t)(std::max(1, std::atoi(value.c_str())));
+			} else {
+				std::cerr << "[SynthBench] Error reading options\n\t";
+				std::cerr << "Reason: " << arg << " isn't an option.\n\n";
+				return false;
+			}
+		}
+
+		if(options.format.empty()) {
+			options.format = EndsWith(options.output, ".csv") ? "csv" : "json";
+		}
+
+		if(options.format != "json" && options.format != "csv") {
+			std::cerr << "[SynthBench] Error reading options\n\t";
+			std::cerr << "Reason: The format must be json or csv, not " << options.format << ".\n\n";
+			return false;
+		}
+
+		return true;
+	}
+
+	//one untimed pass to warm caches and the buffer pool, then 'repeats' timed runs of whole passes
+	Result Measure(const Options& options, const std::string& synth, const std::string& path, const std::string& parameter, const Pass& pass) {
+		Result result;
+		result.name = synth + "/" + path + (parameter.empty() ? "" : "/" + parameter);
+		result.synth = synth;
+		result.path = path;
+		result.parameter = parameter;
+		result.samples = 0;
+
+		pass();
+
+		std::vector<double> runs;
+
+		for(uint32_t r = 0; r < options.repeats; r++) {
+			uint64_t samples = 0;
+			auto start = Clock::now();
+			double elapsed = 0.0;
+
+			do {
+				samples += pass();
+				elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+			} while(elapsed < options.min_seconds);
+
+			runs.push_back(elapsed * 1e9 / (double)(samples));
+			result.samples += samples;
+		}
+
+		std::sort(runs.begin(), runs.end());
+
+		result.best_ns_per_sample = runs.front();
+		result.median_ns_per_sample = runs[runs.size() / 2];
+		result.samples_per_second = 1e9 / result.best_ns_per_sample;
+		result.realtime_factor = result.samples_per_second / (double)(options.sample_rate);
+
+		return result;
+	}
+
+	//one second of Value(t), a sample at a time from t = 0
+	uint64_t ValuePass(Synth& synth, uint32_t sample_rate) {
+		float dt = 1.0f / (float)(sample_rate);
+		float total = 0.0f;
+
+		for(uint32_t i = 0; i < sample_rate; i++) {
+			total += synth.Value((float)(i) * dt);
+		}
+
+		sink = sink + total;
+		return sample_rate;
+	}
+
+	uint64_t GeneratePass(Synth& synth, uint32_t sample_rate) {
+		SoundSample sample = synth.GenerateSample(sample_rate, 1000, 0);
+
+		sink = sink + sample.audio_buffer[sample.buffer_length / 2];
+		return sample.buffer_length;
+	}
+
+	//one second in engine-sized blocks, rounded up to whole blocks
+	uint64_t BlockPass(Synth& synth, std::vector<float>& block, uint32_t sample_rate) {
+		uint32_t frames = (uint32_t)(block.size());
+		uint64_t samples = 0;
+
+		while(samples < sample_rate) {
+			synth.RenderBlock(block.data(), frames, sample_rate);
+			samples += frames;
+		}
+
+		sink = sink + block[frames / 2];
+		return samples;
+	}
+
+	const char* WaveName(WaveSynth::WAVE_TYPE type) {
+		switch(type) {
+			case WaveSynth::SIN: return "sin";
+			case WaveSynth::SQR: return "sqr";
+			case WaveSynth::TRI: return "tri";
+			case WaveSynth::SAW: return "saw";
+		}
+
+		return "unknown";
+	}
+
+	void BenchWaveSynth(const Options& options, std::vector<Result>& results, const std::function<bool(const std::string&)>& wanted) {
+		const WaveSynth::WAVE_TYPE types[] = {WaveSynth::SIN, WaveSynth::SQR, WaveSynth::TRI, WaveSynth::SAW};
+		std::vector<float> block(options.block_size);
+		uint32_t rate = options.sample_rate;
+
+		for(WaveSynth::WAVE_TYPE type : types) {
+			std::string parameter = WaveName(type);
+
+			//never played, so nothing here goes near the audio engine
+			WaveSynth synth(type, 440.0f, 0.5f);
+
+			if(wanted("wave/value/" + parameter)) {
+				results.push_back(Measure(options, "wave", "value", parameter, [&] { return ValuePass(synth, rate); }));
+			}
+
+			if(wanted("wave/generate/" + parameter)) {
+				results.push_back(Measure(options, "wave", "generate", parameter, [&] { return GeneratePass(synth, rate); }));
+			}
+
+			if(wanted("wave/block/" + parameter)) {
+				results.push_back(Measure(options, "wave", "block", parameter, [&] { return BlockPass(synth, block, rate); }));
+			}
+		}
+	}
+
+	void BenchStringSynth(const Options& options, std::vector<Result>& results, const std::function<bool(const std::string&)>& wanted) {
+		std::vector<float> block(options.block_size);
+		uint32_t rate = options.sample_rate;
+
+		for(uint32_t harmonics = 1; harmonics <= StringSynth::MAX_HARMONICS; harmonics *= 2) {
+			std::string parameter = "harmonics=" + std::to_string(harmonics);
+
+			StringSynth synth;
+			synth.SetHarmonicCount(harmonics);
+			synth.SetDampingRatio(1.0f);
+
+			//every pass starts from a fresh pluck, so the string never decays into its silent shortcut;
+			//each path picks the pluck up itself, since the string isn't playing through the engine
+			auto pluck = [&] { synth.Pluck(0.23f * synth.GetActiveLength(), 0.01f); };
+
+			if(wanted("string/value/" + parameter)) {
+				results.push_back(Measure(options, "string", "value", parameter, [&] { pluck(); return ValuePass(synth, rate); }));
+			}
+
+			if(wanted("string/generate/" + parameter)) {
+				results.push_back(Measure(options, "string", "generate", parameter, [&] { pluck(); return GeneratePass(synth, rate); }));
+			}
+
+			if(wanted("string/block/" + parameter)) {
+				results.push_back(Measure(options, "string", "block", parameter, [&] { pluck(); return BlockPass(synth, block, rate); }));
+			}
+		}
+	}
+
+	void BenchGuitarSynth(const Options& options, std::vector<Result>& results, const std::function<bool(const std::string&)>& wanted) {
+		std::vector<float> block(options.block_size);
+		uint32_t rate = options.sample_rate;
+
+		for(uint32_t active = 1; active <= 6; active++) {
+			std::string parameter = "strings=" + std::to_string(active);
+
+			GuitarSynth synth;
+
+			//plucks are queued for the next rendered sample, so a one-frame block applies them before the timed audio
+			auto pluck = [&] {
+				for(uint32_t i = 1; i <= active; i++) {
+					synth.PluckString(i);
+				}
+
+				float first;
+				synth.RenderBlock(&first, 1, rate);
+			};
+
+			if(wanted("guitar/value/" + parameter)) {
+				results.push_back(Measure(options, "guitar", "value", parameter, [&] { pluck(); return ValuePass(synth, rate); }));
+			}
+
+			if(wanted("guitar/generate/" + parameter)) {
+				results.push_back(Measure(options, "guitar", "generate", parameter, [&] { pluck(); return GeneratePass(synth, rate); }));
+			}
+
+			if(wanted("guitar/block/" + parameter)) {
+				results.push_back(Measure(options, "guitar", "block", parameter, [&] { pluck(); return BlockPass(synth, block, rate); }));
+			}
+		}
+	}
+
+	std::string Escape(const std::string& text) {
+		std::string escaped;
+
+		for(char c : text) {
+			if(c == '"' || c == '\\') {
+				escaped += '\\';
+			}
+
+			escaped += c;
+		}
+
+		return escaped;
+	}
+
+	void WriteJSON(std::ostream& out, const Options& options, const std::vector<Result>& results) {
+		char number[64];
+
+		out << "{\n";
+		out << "\t\"label\": \"" << Escape(options.label) << "\",\n";
+		out << "\t\"sample_rate\": " << options.sample_rate << ",\n";
+		out << "\t\"block_size\": " << options.block_size << ",\n";
+		out << "\t\"repeats\": " << options.repeats << ",\n";
+		out << "\t\"results\": [\n";
+
+		for(size_t i = 0; i < results.size(); i++) {
+			const Result& r = results[i];
+
+			out << "\t\t{\"name\": \"" << r.name << "\", \"synth\": \"" << r.synth << "\", \"path\": \"" << r.path << "\", \"parameter\": \"" << r.parameter << "\", ";
+			out << "\"samples\": " << r.samples << ", ";
+
+			std::snprintf(number, sizeof(number), "%.3f", r.best_ns_per_sample);
+			out << "\"ns_per_sample\": " << number << ", ";
+			std::snprintf(number, sizeof(number), "%.3f", r.median_ns_per_sample);
+			out << "\"median_ns_per_sample\": " << number << ", ";
+			std::snprintf(number, sizeof(number), "%.0f", r.samples_per_second);
+			out << "\"samples_per_second\": " << number << ", ";
+			std::snprintf(number, sizeof(number), "%.2f", r.realtime_factor);
+			out << "\"realtime_factor\": " << number << "}";
+
+			out << ((i + 1 < results.size()) ? ",\n" : "\n");
+		}
+
+		out << "\t]\n";
+		out << "}\n";
+	}
+
+	void WriteCSV(std::ostream& out, const Options& options, const std::vector<Result>& results) {
+		out << "label,name,synth,path,parameter,sample_rate,block_size,samples,ns_per_sample,median_ns_per_sample,samples_per_second,realtime_factor\n";
+
+		for(const Result& r : results) {
+			char numbers[160];
+			std::snprintf(numbers, sizeof(numbers), "%.3f,%.3f,%.0f,%.2f", r.best_ns_per_sample, r.median_ns_per_sample, r.samples_per_second, r.realtime_factor);
+
+			out << "\"" << Escape(options.label) << "\"," << r.name << "," << r.synth << "," << r.path << "," << r.parameter << ",";
+			out << options.sample_rate << "," << options.block_size << "," << r.samples << "," << numbers << "\n";
+		}
+	}
+
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+
+	if(!ParseOptions(argc, argv, options)) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	auto wanted = [&](const std::string& name) {
+		return options.filter.empty() || name.find(options.filter) != std::string::npos;
+	};
+
+	std::vector<Result> results;
+
+	BenchWaveSynth(options, results, wanted);
+	BenchStringSynth(options, results, wanted);
+	BenchGuitarSynth(options, results, wanted);
+
+	//a short table for whoever's watching; the machine-readable results go to the output
+	for(const Result& r : results) {
+		char line[160];
+		std::snprintf(line, sizeof(line), "%-32s %10.2f ns/sample %14.0f samples/s %9.1fx real time\n", r.name.c_str(), r.best_ns_per_sample, r.samples_per_second, r.realtime_factor);
+		std::cerr << line;
+	}
+
+	if(options.output.empty()) {
+		if(options.format == "csv") {
+			WriteCSV(std::cout, options, results);
+		} else {
+			WriteJSON(std::cout, options, results);
+		}
+
+		return 0;
+	}
+
+	std::ofstream file(options.output, std::ios::out | std::ios::trunc);
+
+	if(!file) {
+		std::cerr << "[SynthBench] Error writing results\n\t";
+		std::cerr << "Reason: Couldn't open " << options.output << " for writing.\n\n";
+		return 2;
+	}
+
+	if(options.format == "csv") {
+		WriteCSV(file, options, results);
+	} else {
+		WriteJSON(file, options, results);
+	}
+
+	return 0;
+}
@@ -0,0 +1,241 @@
+#include "AudioBackend.hpp"
+
+#define NO_STDIO_REDIRECT
+
+#include "SDL2/SDL.h"
+#include <chrono>
+#include <cstring>
+
+namespace geiger {
+	namespace midi {
+
+		SDLBackend::SDLBackend() {
+			device_ID = 0;
+		}
+
+		SDLBackend::~SDLBackend() {
+			Close();
+		}
+
+		bool SDLBackend::Open(const Specification& want, Specification& have, Callback callback, void* userdata) {
+			SDL_AudioSpec request;
+			SDL_AudioSpec obtained;
+
+			std::memset(&request, 0, sizeof(request));
+			request.freq = (int)(want.rate);
+			request.format = AUDIO_F32SYS;
+			request.channels = (Uint8)(want.channels);
+			request.samples = (Uint16)(want.frames);
+			request.callback = callback;
+			request.userdata = userdata;
+
+			//a different rate or channel layout is accepted and handled by the engine; so are 16 and 32-bit integer devices
+			device_ID = SDL_OpenAudioDevice(NULL, 0, &request, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE | SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+
+			//anything else and SDL converts from float for us instead
+			if(device_ID != 0 && obtained.format != AUDIO_F32SYS && obtained.format != AUDIO_S16SYS && obtained.format != AUDIO_S32SYS) {
+				SDL_CloseAudioDevice(device_ID);
+				device_ID = SDL_OpenAudioDevice(NULL, 0, &request, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+			}
+
+			if(device_ID == 0) {
+				error = SDL_GetError();
+				return false;
+			}
+
+			have.rate = (uint32_t)(obtained.freq);
+			have.channels = (uint16_t)(obtained.channels);
+			have.frames = (uint32_t)(obtained.samples);
+
+			if(obtained.format == AUDIO_S16SYS) {
+				have.format = OutputStage::INT_16;
+			} else if(obtained.format == AUDIO_S32SYS) {
+				have.format = OutputStage::INT_32;
+			} else {
+				have.format = OutputStage::FLOAT_32;
+			}
+
+			return true;
+		}
+
+		void SDLBackend::Start() {
+			if(device_ID != 0) {
+				SDL_PauseAudioDevice(device_ID, 0);
+			}
+		}
+
+		void SDLBackend::Close() {
+			if(device_ID == 0) {
+				return;
+			}
+
+			//SDL waits for a callback in progress
+			SDL_CloseAudioDevice(device_ID);
+			device_ID = 0;
+		}
+
+		const char* SDLBackend::GetName() const {
+			return "SDL";
+		}
+
+		NullBackend::NullBackend(bool paced_) : stopping{false}, blocks{0} {
+			callback = nullptr;
+			userdata = nullptr;
+			paced = paced_;
+			specification = {0, 0, 0, OutputStage::FLOAT_32};
+		}
+
+		NullBackend::~NullBackend() {
+			Close();
+		}
+
+		bool NullBackend::Open(const Specification& want, Specification& have, Callback callback_, void* userdata_) {
+			if(want.rate == 0 || want.channels == 0 || want.frames == 0) {
+				error = "The requested rate, channel count and block size must all be positive.";
+				return false;
+			}
+
+			//nothing to negotiate with, so the engine gets exactly what it asked for
+			specification = want;
+			have = want;
+
+			callback = callback_;
+			userdata = userdata_;
+			blocks = 0;
+
+			uint32_t bytes_per_sample = (want.format == OutputStage::INT_16) ? 2 : 4;
+			block.assign((size_t)(want.frames) * want.channels * bytes_per_sample, 0);
+
+			return true;
+		}
+
+		void NullBackend::Start() {
+			if(callback == nullptr || thread.joinable()) {
+				return;
+			}
+
+			stopping = false;
+			thread = std::thread(&NullBackend::Run, this);
+		}
+
+		void NullBackend::Close() {
+			if(thread.joinable()) {
+				stopping = true;
+				thread.join();
+			}
+
+			callback = nullptr;
+		}
+
+		const char* NullBackend::GetName() const {
+			return "null";
+		}
+
+		uint64_t NullBackend::GetBlockCount() const {
+			return blocks.load(std::memory_order_relaxed);
+		}
+
+		bool NullBackend::IsPaced() const {
+			return paced;
+		}
+
+		void NullBackend::Run() {
+			typedef std::chrono::steady_clock clock;
+
+			std::chrono::duration<double> period((double)(specification.frames) / (double)(specification.rate));
+			auto interval = std::chrono::duration_cast<clock::duration>(period);
+			auto deadline = clock::now();
+
+			while(!stopping.load(std::memory_order_relaxed)) {
+				callback(userdata, block.data(), (int)(block.size()));
+				Deliver(block.data(), specification.frames);
+				blocks.fetch_add(1, std::memory_order_relaxed);
+
+				if(!IsPaced()) {
+					continue;
+				}
+
+				//each deadline is a whole period after the last, so sleeping late once doesn't push every later block back
+				deadline += interval;
+				auto now = clock::now();
+
+				//too far behind to catch up (or just switched from unpaced): start the schedule again from here
+				if(deadline + interval < now) {
+					deadline = now;
+				}
+
+				std::this_thread::sleep_until(deadline);
+			}
+		}
+
+		FileBackend::FileBackend(const std::string& path_, WavWriter::SAMPLE_FORMAT format_, bool paced_, uint64_t frame_limit_) : NullBackend(paced_), frames_written{0} {
+			path = path_;
+			format = format_;
+			frame_limit = frame_limit_;
+		}
+
+		FileBackend::~FileBackend() {
+			Close();
+		}
+
+		bool FileBackend::Open(const Specification& want, Specification& have, Callback callback, void* userdata) {
+			//the file gets floats, so the engine is asked for floats whatever it wanted
+			Specification request = want;
+			request.format = OutputStage::FLOAT_32;
+
+			if(!NullBackend::Open(request, have, callback, userdata)) {
+				return false;
+			}
+
+			if(!writer.Open(path, have.rate, have.channels, format)) {
+				error = "Couldn't open " + path + " for writing.";
+				return false;
+			}
+
+			frames_written = 0;
+			return true;
+		}
+
+		void FileBackend::Close() {
+			NullBackend::Close();
+
+			if(writer.IsOpen()) {
+				writer.Close();
+			}
+		}
+
+		const char* FileBackend::GetName() const {
+			return "file";
+		}
+
+		bool FileBackend::IsFinished() const {
+			return frame_limit > 0 && frames_written.load(std::memory_order_relaxed) >= frame_limit;
+		}
+
+		uint64_t FileBackend::GetFramesWritten() const {
+			return frames_written.load(std::memory_order_relaxed);
+		}
+
+		void FileBackend::Deliver(const uint8_t* block, uint32_t frames) {
+			uint64_t written = frames_written.load(std::memory_order_relaxed);
+
+			if(frame_limit > 0) {
+				if(written >= frame_limit) {
+					return;
+				}
+
+				if(frame_limit - written < frames) {
+					frames = (uint32_t)(frame_limit - written);
+				}
+			}
+
+			writer.Write((const float*)(block), frames);
+			frames_written.store(written + frames, std::memory_order_relaxed);
+		}
+
+		bool FileBackend::IsPaced() const {
+			return NullBackend::IsPaced() || IsFinished();
+		}
+
+	}
+}
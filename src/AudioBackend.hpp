@@ -0,0 +1,144 @@
+#ifndef AUDIOBACKEND_HPP
+#define AUDIOBACKEND_HPP
+
+#include "OutputStage.hpp"
+#include "WavWriter.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace geiger {
+	namespace midi {
+
+		//whatever pulls blocks out of the engine: a sound card, a timer or a file
+		//a backend calls one callback, from a thread of its own, each time it wants another block
+		class AudioBackend
+		{
+			public:
+				struct Specification {
+					uint32_t rate;
+					uint16_t channels;
+
+					//frames per callback
+					uint32_t frames;
+					OutputStage::FORMAT format;
+				};
+
+				//the same shape as SDL's audio callback: 'bytes' bytes of interleaved samples to fill in 'stream'
+				typedef void (*Callback)(void* userdata, uint8_t* stream, int bytes);
+
+				virtual ~AudioBackend() {}
+
+				//'have' receives what was actually opened, which may differ from 'want' in any field
+				//on failure GetError() says why
+				virtual bool Open(const Specification& want, Specification& have, Callback callback, void* userdata) = 0;
+
+				//starts calling the callback
+				virtual void Start() = 0;
+
+				//stops, waiting for a callback in progress to return first; safe to call when not open
+				virtual void Close() = 0;
+
+				virtual const char* GetName() const = 0;
+				const std::string& GetError() const { return error; }
+
+			protected:
+				std::string error;
+		};
+
+		//the default sound card through SDL, which decides the thread and the timing
+		//float, 16 and 32-bit integer devices are taken as they are; anything else is opened as float for SDL to convert
+		class SDLBackend : public AudioBackend
+		{
+			public:
+				SDLBackend();
+				virtual ~SDLBackend();
+
+				virtual bool Open(const Specification& want, Specification& have, Callback callback, void* userdata) override;
+				virtual void Start() override;
+				virtual void Close() override;
+
+				virtual const char* GetName() const override;
+
+			private:
+				uint32_t device_ID;
+		};
+
+		//no device at all: a thread of its own pulls a block every frames / rate seconds, against absolute deadlines
+		//so the rate never drifts, and throws the audio away; for running the real-time path on machines without a sound card
+		//when not paced, it pulls blocks back to back as fast as the engine renders them
+		class NullBackend : public AudioBackend
+		{
+			public:
+				explicit NullBackend(bool paced = true);
+				virtual ~NullBackend();
+
+				virtual bool Open(const Specification& want, Specification& have, Callback callback, void* userdata) override;
+				virtual void Start() override;
+				virtual void Close() override;
+
+				virtual const char* GetName() const override;
+
+				//any thread: blocks pulled since the last Open()
+				uint64_t GetBlockCount() const;
+
+			protected:
+				//the backend's thread: does something with each block once the callback has filled it
+				virtual void Deliver(const uint8_t*, uint32_t) {}
+
+				//the backend's thread, before each block: whether to wait for the block's deadline
+				virtual bool IsPaced() const;
+
+				Specification specification;
+
+			private:
+				void Run();
+
+				Callback callback;
+				void* userdata;
+				bool paced;
+
+				std::vector<uint8_t> block;
+				std::thread thread;
+				std::atomic<bool> stopping;
+				std::atomic<uint64_t> blocks;
+		};
+
+		//the same pull loop as NullBackend, writing everything it pulls to a WAV file
+		//unpaced it renders as fast as the CPU allows; with a frame limit, blocks past the limit are pulled
+		//at real-time pace and discarded, so anything waiting on the engine's clock still gets there
+		class FileBackend : public NullBackend
+		{
+			public:
+				FileBackend(const std::string& path, WavWriter::SAMPLE_FORMAT format = WavWriter::PCM_16, bool paced = false, uint64_t frame_limit = 0);
+				virtual ~FileBackend();
+
+				virtual bool Open(const Specification& want, Specification& have, Callback callback, void* userdata) override;
+				virtual void Close() override;
+
+				virtual const char* GetName() const override;
+
+				//any thread: true once 'frame_limit' frames are in the file
+				bool IsFinished() const;
+				uint64_t GetFramesWritten() const;
+
+			protected:
+				virtual void Deliver(const uint8_t* block, uint32_t frames) override;
+				virtual bool IsPaced() const override;
+
+			private:
+				std::string path;
+				WavWriter::SAMPLE_FORMAT format;
+				uint64_t frame_limit;
+
+				WavWriter writer;
+				std::atomic<uint64_t> frames_written;
+		};
+
+	}
+}
+
+#endif // AUDIOBACKEND_HPP
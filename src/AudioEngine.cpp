@@ -0,0 +1,760 @@
+#include "AudioEngine.hpp"
+#include "Denormals.hpp"
+#include "AudioKernels.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <chrono>
+
+namespace geiger {
+	namespace midi {
+
+		static const uint32_t ENGINE_RATE = 44100;
+		static const uint32_t ENGINE_BLOCK_SIZE = 1024;
+		static const uint16_t ENGINE_CHANNELS = 2;
+
+		AudioEngine& AudioEngine::Get() {
+			static AudioEngine engine;
+			return engine;
+		}
+
+		AudioEngine::AudioEngine() : commands_sent{0}, commands_applied{0}, published_sample_time{0}, dropped_events{0}, stats{"AudioEngine"} {
+			running = false;
+			render_rate = ENGINE_RATE;
+			buffer_size = ENGINE_BLOCK_SIZE;
+			backend = &sdl_backend;
+			effects = nullptr;
+			specification.rate = ENGINE_RATE;
+			specification.frames = ENGINE_BLOCK_SIZE;
+			specification.channels = ENGINE_CHANNELS;
+			specification.format = OutputStage::FLOAT_32;
+
+			next_event = 0;
+			sample_time = 0;
+			rendered_read = 0;
+			rendered_available = 0;
+
+			adaptive = false;
+			adaptive_stopping = false;
+			adaptive_limit = 2048;
+			adaptive_misses = 1;
+
+			registered.reserve(MAX_SYNTHS);
+			active.reserve(MAX_SYNTHS);
+			pending.reserve(MAX_EVENTS);
+		}
+
+		AudioEngine::~AudioEngine() {
+			std::lock_guard<std::mutex> guard(control_lock);
+			Close();
+		}
+
+		bool AudioEngine::Add(Synth* synth) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			if(std::find(registered.begin(), registered.end(), synth) != registered.end()) {
+				return true;
+			}
+
+			if(registered.size() >= MAX_SYNTHS) {
+				std::cerr << "[AudioEngine] Error adding synth\n\t";
+				std::cerr << "Reason: The engine already mixes " << MAX_SYNTHS << " synths.\n\n";
+				return false;
+			}
+
+			registered.push_back(synth);
+			Send(EngineCommand::ADD, synth, false);
+
+			if(!running && !Open()) {
+				registered.pop_back();
+				active.clear();
+				return false;
+			}
+
+			return true;
+		}
+
+		void AudioEngine::Remove(Synth* synth) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			auto it = std::find(registered.begin(), registered.end(), synth);
+
+			if(it == registered.end()) {
+				return;
+			}
+
+			registered.erase(it);
+
+			if(registered.empty()) {
+				Close();
+				Apply({EngineCommand::REMOVE, synth, nullptr});
+				return;
+			}
+
+			Send(EngineCommand::REMOVE, synth, true);
+		}
+
+		void AudioEngine::SetPaused(Synth* synth, bool paused) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			if(std::find(registered.begin(), registered.end(), synth) == registered.end()) {
+				return;
+			}
+
+			Send(paused ? EngineCommand::PAUSE : EngineCommand::UNPAUSE, synth, false);
+		}
+
+		bool AudioEngine::Schedule(Synth* synth, const SynthCommand& cmd, uint64_t time) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			if(std::find(registered.begin(), registered.end(), synth) == registered.end()) {
+				return false;
+			}
+
+			ScheduledEvent event = {time, synth, cmd};
+
+			if(!running) {
+				Insert(event);
+				return true;
+			}
+
+			if(!incoming.Push(event)) {
+				dropped_events++;
+				return false;
+			}
+
+			return true;
+		}
+
+		uint64_t AudioEngine::GetSampleTime() const {
+			return published_sample_time.load(std::memory_order_acquire);
+		}
+
+		uint64_t AudioEngine::GetDroppedEventCount() const {
+			return dropped_events.load(std::memory_order_relaxed);
+		}
+
+		void AudioEngine::SetMasterGain(float decibels) {
+			limiter.SetGain(decibels);
+		}
+
+		void AudioEngine::SetCeiling(float decibels) {
+			limiter.SetCeiling(decibels);
+		}
+
+		float AudioEngine::GetMasterGain() const {
+			return limiter.GetGain();
+		}
+
+		float AudioEngine::GetCeiling() const {
+			return limiter.GetCeiling();
+		}
+
+		void AudioEngine::SetEffects(EffectChain* chain) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			//a closed device has no channel layout yet; Open() configures the chain once it does
+			//configuring reallocates the chain's state, so only the chain that's playing is taken out first; a new one
+			//is got ready here and swapped in without a block going by dry
+			if(chain && running) {
+				if(chain == effects) {
+					Send(EngineCommand::SET_EFFECTS, nullptr, true, nullptr);
+				}
+
+				chain->Configure(render_rate, (uint16_t)(specification.channels));
+			}
+
+			Send(EngineCommand::SET_EFFECTS, nullptr, true, chain);
+		}
+
+		bool AudioEngine::SetInsertEffects(Synth* synth, EffectChain* chain) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			if(std::find(registered.begin(), registered.end(), synth) == registered.end()) {
+				return false;
+			}
+
+			if(chain) {
+				Send(EngineCommand::SET_INSERTS, synth, true, nullptr);
+				chain->Configure(render_rate, 1);
+			}
+
+			Send(EngineCommand::SET_INSERTS, synth, true, chain);
+			return true;
+		}
+
+		void AudioEngine::SetDither(bool enabled) {
+			output.SetDither(enabled);
+		}
+
+		uint32_t AudioEngine::GetLatency() const {
+			return limiter.GetLatency();
+		}
+
+		double AudioEngine::GetOutputLatency() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			double device_rate = (double)(specification.rate);
+			double latency = (double)(specification.frames + limiter.GetLatency()) / device_rate;
+
+			//a resampled mix also waits in the rendered block and the filter's lookahead, at the engine's rate
+			if((uint32_t)(specification.rate) != render_rate) {
+				latency += (double)(specification.frames + resampler.GetLatency()) / (double)(render_rate);
+			}
+
+			return latency;
+		}
+
+		bool AudioEngine::IsRunning() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+			return running;
+		}
+
+		uint32_t AudioEngine::GetSampleRate() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+			return render_rate;
+		}
+
+		uint32_t AudioEngine::GetDeviceRate() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+			return (uint32_t)(specification.rate);
+		}
+
+		uint16_t AudioEngine::GetChannelCount() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+			return (uint16_t)(specification.channels);
+		}
+
+		uint32_t AudioEngine::GetBlockSize() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+			return (uint32_t)(specification.frames);
+		}
+
+		uint32_t AudioEngine::GetSynthCount() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+			return (uint32_t)(registered.size());
+		}
+
+		CallbackStats::Snapshot AudioEngine::GetCallbackStats() const {
+			return stats.GetSnapshot();
+		}
+
+		void AudioEngine::ResetCallbackStats() {
+			stats.Reset();
+		}
+
+		void AudioEngine::SetStatsLogInterval(float seconds) {
+			stats.SetLogInterval(seconds);
+		}
+
+		bool AudioEngine::SetBackend(AudioBackend* backend_) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			if(running) {
+				std::cerr << "[AudioEngine] Error changing audio backend\n\t";
+				std::cerr << "Reason: The device is open; stop every synth first.\n\n";
+				return false;
+			}
+
+			backend = backend_ ? backend_ : &sdl_backend;
+			return true;
+		}
+
+		bool AudioEngine::SetSampleRate(uint32_t rate) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			if(running) {
+				std::cerr << "[AudioEngine] Error changing sample rate\n\t";
+				std::cerr << "Reason: The device is open; stop every synth first.\n\n";
+				return false;
+			}
+
+			if(rate == 0) {
+				std::cerr << "[AudioEngine] Error changing sample rate\n\t";
+				std::cerr << "Reason: The rate must be positive.\n\n";
+				return false;
+			}
+
+			render_rate = rate;
+			specification.rate = rate;
+			return true;
+		}
+
+		bool AudioEngine::SetBufferSize(uint32_t frames) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			if(running) {
+				std::cerr << "[AudioEngine] Error changing buffer size\n\t";
+				std::cerr << "Reason: The device is open; stop every synth first.\n\n";
+				return false;
+			}
+
+			buffer_size = std::min(std::max(frames, (uint32_t)(MIN_BLOCK_SIZE)), (uint32_t)(MAX_BLOCK_SIZE));
+			specification.frames = buffer_size;
+			return true;
+		}
+
+		uint32_t AudioEngine::GetBufferSize() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+			return buffer_size;
+		}
+
+		void AudioEngine::SetAdaptiveBuffering(bool enabled, uint32_t max_frames, uint32_t max_misses) {
+			std::lock_guard<std::mutex> guard(control_lock);
+
+			{
+				std::lock_guard<std::mutex> settings(adaptive_lock);
+				adaptive = enabled;
+				adaptive_limit = std::min(std::max(max_frames, (uint32_t)(MIN_BLOCK_SIZE)), (uint32_t)(MAX_BLOCK_SIZE));
+				adaptive_misses = max_misses;
+			}
+
+			if(!running) {
+				return;
+			}
+
+			if(enabled) {
+				StartAdapting();
+			} else {
+				StopAdapting();
+			}
+		}
+
+		bool AudioEngine::IsAdaptiveBuffering() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+			return adaptive;
+		}
+
+		const char* AudioEngine::GetBackendName() const {
+			std::lock_guard<std::mutex> guard(control_lock);
+			return backend->GetName();
+		}
+
+		bool AudioEngine::Open() {
+			if(!OpenDevice(buffer_size)) {
+				return false;
+			}
+
+			running = true;
+			backend->Start();
+
+			if(adaptive) {
+				StartAdapting();
+			}
+
+			return true;
+		}
+
+		bool AudioEngine::OpenDevice(uint32_t frames) {
+			AudioBackend::Specification want = {render_rate, ENGINE_CHANNELS, frames, OutputStage::FLOAT_32};
+
+			//a different rate is accepted and resampled here, so the synths always render at the engine's rate
+			//a device with another channel layout is accepted too and the pan law spreads each synth across what it has
+			//16 and 32-bit integer devices are written directly by the output stage, once per block
+			if(!backend->Open(want, specification, engine_callback, (void*)(this))) {
+				std::cerr << "[AudioEngine] Error opening audio device\n\t";
+				std::cerr << "Reason: " << backend->GetError() << "\n\n";
+				return false;
+			}
+
+			if(specification.channels > MAX_CHANNELS) {
+				std::cerr << "[AudioEngine] Error opening audio device\n\t";
+				std::cerr << "Reason: The device wants " << (uint32_t)(specification.channels) << " channels, but at most " << MAX_CHANNELS << " are supported.\n\n";
+				backend->Close();
+				return false;
+			}
+
+			uint16_t channels = (uint16_t)(specification.channels);
+
+			//everything the callback touches is sized here, so a block of any size needs no setup in the callback itself
+			//scratch holds one synth's mono block; everything after the pan is interleaved
+			scratch.assign(specification.frames, 0.0f);
+			limiter.SetChannelCount(channels);
+
+			if(effects) {
+				effects->Configure(render_rate, channels);
+			}
+
+			output.Configure(specification.format, channels);
+
+			//a float device is mixed straight into the backend's buffer
+			if(output.GetFormat() != OutputStage::FLOAT_32) {
+				mixed.assign((size_t)(specification.frames) * channels, 0.0f);
+			}
+
+			if((uint32_t)(specification.rate) != render_rate) {
+				resampler.Configure(render_rate, (uint32_t)(specification.rate), Resampler::MEDIUM, channels);
+				rendered.assign((size_t)(specification.frames) * channels, 0.0f);
+			}
+
+			rendered_read = 0;
+			rendered_available = 0;
+
+			//the budget depends on the block size and rate just opened, so earlier figures don't carry over
+			stats.Reset();
+
+			return true;
+		}
+
+		void AudioEngine::Close() {
+			StopAdapting();
+
+			if(!running) {
+				return;
+			}
+
+			//the backend waits for a callback in progress, so nothing touches the registry afterwards
+			backend->Close();
+			Drain();
+		}
+
+		void AudioEngine::Drain() {
+			running = false;
+
+			//events first: a REMOVE queued after them has to find them in 'pending' to purge them
+			ScheduledEvent event;
+
+			while(incoming.Pop(event)) {
+				Insert(event);
+			}
+
+			EngineCommand cmd;
+
+			while(commands.Pop(cmd)) {
+				Apply(cmd);
+				commands_applied.fetch_add(1, std::memory_order_release);
+			}
+		}
+
+		void AudioEngine::StartAdapting() {
+			StopAdapting();
+
+			adaptive_stopping = false;
+			adaptive_thread = std::thread(&AudioEngine::AdaptLoop, this);
+		}
+
+		void AudioEngine::StopAdapting() {
+			if(!adaptive_thread.joinable()) {
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> settings(adaptive_lock);
+				adaptive_stopping = true;
+			}
+
+			adaptive_wake.notify_all();
+			adaptive_thread.join();
+		}
+
+		void AudioEngine::AdaptLoop() {
+			std::unique_lock<std::mutex> settings(adaptive_lock);
+			uint64_t seen = 0;
+
+			while(!adaptive_wake.wait_for(settings, std::chrono::seconds(1), [this] { return adaptive_stopping; })) {
+				uint64_t misses = stats.GetSnapshot().deadline_misses;
+
+				//someone else reset the figures
+				if(misses < seen) {
+					seen = 0;
+				}
+
+				uint64_t recent = misses - seen;
+
+				if(recent <= adaptive_misses) {
+					seen = misses;
+					continue;
+				}
+
+				uint32_t limit = adaptive_limit;
+				bool open = true;
+				settings.unlock();
+
+				{
+					//whoever holds the control lock may be closing the device and waiting here for this thread, so it's
+					//only tried; 'seen' stays put, so the misses are still there to act on a second later
+					std::unique_lock<std::mutex> guard(control_lock, std::try_to_lock);
+
+					if(guard.owns_lock()) {
+						//a reopen resets the figures; at the limit they're left alone and only new misses count from here
+						seen = Grow(limit, recent) ? 0 : misses;
+						open = running;
+					}
+				}
+
+				settings.lock();
+
+				if(!open) {
+					break;
+				}
+			}
+		}
+
+		bool AudioEngine::Grow(uint32_t max_frames, uint64_t misses) {
+			uint32_t frames = (uint32_t)(specification.frames);
+			uint32_t larger = std::min(frames * 2, max_frames);
+
+			if(!running || larger <= frames) {
+				return false;
+			}
+
+			//nothing's lost across the reopen: synths, pending events and queued commands all stay where they are
+			backend->Close();
+
+			if(OpenDevice(larger)) {
+				std::clog << "[AudioEngine] " << misses << " callbacks overran their block since the last check; block size raised from " << frames << " to " << specification.frames << " frames\n";
+				backend->Start();
+				return true;
+			}
+
+			if(OpenDevice(frames)) {
+				backend->Start();
+				return true;
+			}
+
+			//the device has gone altogether; registered synths play again when the next one is added
+			Drain();
+			return false;
+		}
+
+		void AudioEngine::Send(EngineCommand::TYPE type, Synth* synth, bool wait, EffectChain* chain) {
+			EngineCommand cmd = {type, synth, chain};
+
+			if(!running) {
+				Apply(cmd);
+				return;
+			}
+
+			while(!commands.Push(cmd)) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+
+			uint64_t sent = ++commands_sent;
+
+			if(!wait) {
+				return;
+			}
+
+			while(commands_applied.load(std::memory_order_acquire) < sent) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		void AudioEngine::Apply(const EngineCommand& cmd) {
+			switch(cmd.type) {
+				case EngineCommand::ADD:
+					active.push_back({cmd.synth, false, nullptr});
+					break;
+
+				case EngineCommand::REMOVE: {
+					for(size_t i = 0; i < active.size(); i++) {
+						if(active[i].synth == cmd.synth) {
+							active.erase(active.begin() + i);
+							break;
+						}
+					}
+
+					//drop anything still scheduled for the synth, since it may be destroyed as soon as Remove returns
+					//events pushed since the queue was last drained are taken in first, or they'd outlive it
+					ScheduledEvent event;
+
+					while(incoming.Pop(event)) {
+						Insert(event);
+					}
+
+					size_t kept = next_event;
+
+					for(size_t i = next_event; i < pending.size(); i++) {
+						if(pending[i].synth != cmd.synth) {
+							pending[kept++] = pending[i];
+						}
+					}
+
+					pending.resize(kept);
+					break;
+				}
+
+				case EngineCommand::PAUSE:
+				case EngineCommand::UNPAUSE:
+					for(Entry& entry : active) {
+						if(entry.synth == cmd.synth) {
+							entry.paused = (cmd.type == EngineCommand::PAUSE);
+						}
+					}
+					break;
+
+				case EngineCommand::SET_EFFECTS:
+					effects = cmd.effects;
+					break;
+
+				case EngineCommand::SET_INSERTS:
+					for(Entry& entry : active) {
+						if(entry.synth == cmd.synth) {
+							entry.inserts = cmd.effects;
+						}
+					}
+					break;
+			}
+		}
+
+		void AudioEngine::Insert(const ScheduledEvent& event) {
+			if(next_event == pending.size()) {
+				pending.clear();
+				next_event = 0;
+			}
+
+			if(pending.size() == MAX_EVENTS) {
+				if(next_event == 0) {
+					dropped_events.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+
+				pending.erase(pending.begin(), pending.begin() + next_event);
+				next_event = 0;
+			}
+
+			//events nearly always arrive in time order, so this usually stops straight away
+			size_t i = pending.size();
+			pending.push_back(event);
+
+			while(i > next_event && pending[i - 1].time > event.time) {
+				pending[i] = pending[i - 1];
+				i--;
+			}
+
+			pending[i] = event;
+		}
+
+		void AudioEngine::Fill(float* out, uint32_t frames) {
+			uint32_t chunk = (uint32_t)(scratch.size());
+			uint16_t channels = (uint16_t)(specification.channels);
+
+			if((uint32_t)(specification.rate) == render_rate) {
+				for(uint32_t done = 0; done < frames; ) {
+					uint32_t count = (frames - done < chunk) ? (frames - done) : chunk;
+					Mix(out + (size_t)(done) * channels, count);
+					done += count;
+				}
+
+				return;
+			}
+
+			uint32_t produced = 0;
+
+			while(produced < frames) {
+				if(rendered_available == 0) {
+					Mix(rendered.data(), chunk);
+					rendered_read = 0;
+					rendered_available = chunk;
+				}
+
+				uint32_t consumed = 0;
+				produced += resampler.Process(rendered.data() + (size_t)(rendered_read) * channels, rendered_available, out + (size_t)(produced) * channels, frames - produced, consumed);
+				rendered_read += consumed;
+				rendered_available -= consumed;
+			}
+		}
+
+		void AudioEngine::Mix(float* out, uint32_t frames) {
+			uint32_t done = 0;
+
+			//render up to each event, apply it, then carry on; cost is linear in frames plus events
+			while(done < frames) {
+				uint64_t now = sample_time + done;
+
+				while(next_event < pending.size() && pending[next_event].time <= now) {
+					const ScheduledEvent& event = pending[next_event++];
+					event.synth->HandleCommand(event.command);
+				}
+
+				uint32_t span = frames - done;
+
+				if(next_event < pending.size() && pending[next_event].time - now < span) {
+					span = (uint32_t)(pending[next_event].time - now);
+				}
+
+				RenderSynths(out + (size_t)(done) * specification.channels, span);
+				done += span;
+			}
+
+			//after the event splits, so the effects always see whole chunks
+			if(effects) {
+				effects->Process(out, frames);
+			}
+
+			sample_time += frames;
+		}
+
+		void AudioEngine::RenderSynths(float* out, uint32_t frames) {
+			uint16_t channels = (uint16_t)(specification.channels);
+
+			for(uint32_t i = 0; i < frames * channels; i++) {
+				out[i] = 0.0f;
+			}
+
+			float* buffer = scratch.data();
+			float gains[MAX_CHANNELS];
+
+			for(const Entry& entry : active) {
+				if(entry.paused) {
+					continue;
+				}
+
+				entry.synth->RenderBlock(buffer, frames, render_rate);
+
+				if(entry.inserts) {
+					entry.inserts->Process(buffer, frames);
+				}
+
+				//voices render mono; the synth's pan only comes in here, as one multiply per channel
+				PanGains(entry.synth->GetPan(), channels, gains);
+				MixBufferPanned(out, channels, buffer, gains, frames);
+			}
+		}
+
+		void engine_callback(void* engine_, uint8_t* stream_, int len_) {
+			CallbackStats::TimePoint start = CallbackStats::Begin();
+			AudioEngine* engine = (AudioEngine*)(engine_);
+
+			DenormalGuard guard;
+
+			//events first: a REMOVE queued after them has to find them in 'pending' to purge them
+			AudioEngine::ScheduledEvent event;
+
+			while(engine->incoming.Pop(event)) {
+				engine->Insert(event);
+			}
+
+			AudioEngine::EngineCommand cmd;
+
+			//active has MAX_SYNTHS reserved, so registering never allocates here
+			while(engine->commands.Pop(cmd)) {
+				engine->Apply(cmd);
+				engine->commands_applied.fetch_add(1, std::memory_order_release);
+			}
+
+			OutputStage& output = engine->output;
+			uint32_t frame_bytes = output.GetBytesPerSample() * engine->specification.channels;
+			uint32_t frames = (uint32_t)(len_) / frame_bytes;
+
+			//everything downstream is sized for the block the device granted; anything past it is left silent
+			if(frames > (uint32_t)(engine->specification.frames)) {
+				frames = (uint32_t)(engine->specification.frames);
+				std::memset(stream_ + (size_t)(frames) * frame_bytes, 0, (size_t)(len_) - (size_t)(frames) * frame_bytes);
+			}
+
+			float* block = (output.GetFormat() == OutputStage::FLOAT_32) ? (float*)(stream_) : engine->mixed.data();
+
+			engine->Fill(block, frames);
+
+			//synths hand over raw levels; the master bus is what keeps the sum in range
+			engine->limiter.Process(block, frames, (uint32_t)(engine->specification.rate));
+			output.Convert(block, (void*)(stream_), frames);
+
+			engine->published_sample_time.store(engine->sample_time, std::memory_order_release);
+			engine->stats.End(start, frames, (uint32_t)(engine->specification.rate));
+		}
+
+	}
+}
@@ -0,0 +1,244 @@
+#ifndef AUDIOENGINE_HPP
+#define AUDIOENGINE_HPP
+
+#include "Synth.hpp"
+#include "CommandQueue.hpp"
+#include "Limiter.hpp"
+#include "Resampler.hpp"
+#include "OutputStage.hpp"
+#include "Effect.hpp"
+#include "AudioBackend.hpp"
+#include "CallbackStats.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace geiger {
+	namespace midi {
+
+		//owns the one audio device every synth plays through
+		//synths register themselves in Play() and the single callback mixes all of them into each output block
+		//the device is an SDL sound card unless another backend is set, e.g. a NullBackend on a machine without one
+		class AudioEngine
+		{
+			public:
+				static const uint32_t MAX_SYNTHS = 128;
+				static const uint32_t MAX_EVENTS = 1024;
+
+				//the block sizes SetBufferSize() accepts, in frames
+				static const uint32_t MIN_BLOCK_SIZE = 32;
+				static const uint32_t MAX_BLOCK_SIZE = 8192;
+
+				static AudioEngine& Get();
+
+				AudioEngine(const AudioEngine&) = delete;
+				AudioEngine& operator=(const AudioEngine&) = delete;
+
+				//opens the device on the first registration; returns false if it couldn't be opened or the registry is full
+				bool Add(Synth* synth);
+
+				//blocks until the callback has stopped touching 'synth'; the device closes with the last synth
+				void Remove(Synth* synth);
+
+				//the backend the device is opened on from the next time it opens; null goes back to SDL
+				//the caller owns it and it must outlive its use; returns false while the device is open
+				bool SetBackend(AudioBackend* backend);
+				const char* GetBackendName() const;
+
+				//the rate every synth renders at from the next time the device opens; returns false while it's open
+				bool SetSampleRate(uint32_t rate);
+
+				//frames per callback asked of the device from the next time it opens, clamped to MIN_BLOCK_SIZE..MAX_BLOCK_SIZE
+				//smaller blocks reach the speakers sooner but leave less time to render each; returns false while the device is open
+				bool SetBufferSize(uint32_t frames);
+				uint32_t GetBufferSize() const;
+
+				//while the device is open, checks once a second whether more than 'max_misses' callbacks overran their block,
+				//and if so reopens it with twice the block size, up to 'max_frames'; the block never shrinks again on its own,
+				//and the next time the device opens it starts from SetBufferSize()'s size
+				void SetAdaptiveBuffering(bool enabled, uint32_t max_frames = 2048, uint32_t max_misses = 1);
+				bool IsAdaptiveBuffering() const;
+
+				//a paused synth stays registered but isn't rendered, so it resumes where it left off
+				void SetPaused(Synth* synth, bool paused);
+
+				//hands 'cmd' to synth->HandleCommand() exactly at 'sample_time' on the engine's clock
+				//the block is split there, so the event lands on its sample whatever the block size
+				//events already in the past are applied at the start of the next block
+				bool Schedule(Synth* synth, const SynthCommand& cmd, uint64_t sample_time);
+
+				//the engine's clock: samples rendered since the device was first opened, as of the last finished block
+				uint64_t GetSampleTime() const;
+
+				//events thrown away because MAX_EVENTS were already pending
+				uint64_t GetDroppedEventCount() const;
+
+				//the master bus: every block is scaled by the gain and then limited to stay under the ceiling
+				void SetMasterGain(float decibels);
+				void SetCeiling(float decibels);
+				float GetMasterGain() const;
+				float GetCeiling() const;
+
+				//the master bus's effects, run on each mixed block at the engine's rate before the gain and limiter
+				//the chain is configured here for the device's channel layout; the caller owns it, and once this returns
+				//the callback has let go of the previous one; null takes the effects out
+				void SetEffects(EffectChain* chain);
+
+				//effects on one synth's mono output before it's panned, configured here for one channel
+				//they stay with the synth until it's removed; returns false if the synth isn't added
+				bool SetInsertEffects(Synth* synth, EffectChain* chain);
+
+				//TPDF dither for 16-bit devices, on by default; float and 32-bit devices never need it
+				void SetDither(bool enabled);
+
+				//frames the limiter's lookahead delays the output by
+				uint32_t GetLatency() const;
+
+				//seconds from a synth rendering a sample to the engine handing it to the device: a block, the limiter's
+				//lookahead and whatever the resampler holds back; the device's own buffering comes on top
+				double GetOutputLatency() const;
+
+				bool IsRunning() const;
+
+				//the rate every synth renders at and the engine's clock counts in
+				uint32_t GetSampleRate() const;
+
+				//the rate the device actually plays at; the mix is resampled to it when the two differ
+				uint32_t GetDeviceRate() const;
+
+				//interleaved channels in each output frame; every synth renders mono and is panned across them
+				uint16_t GetChannelCount() const;
+
+				//the block size the device actually opened with, which adaptive buffering may have raised
+				uint32_t GetBlockSize() const;
+				uint32_t GetSynthCount() const;
+
+				//how long each callback took against the time its block lasts, counted since the device last opened
+				//a deadline miss is a callback that overran its block, i.e. an underrun on a real sound card
+				CallbackStats::Snapshot GetCallbackStats() const;
+				void ResetCallbackStats();
+
+				//every 'seconds', a line about the callbacks since the last one goes to std::clog; 0 (the default) stops it
+				void SetStatsLogInterval(float seconds);
+
+			private:
+				AudioEngine();
+				~AudioEngine();
+
+				friend void engine_callback(void* engine_, uint8_t* stream_, int len_);
+
+				struct EngineCommand {
+					enum TYPE {
+						ADD = 0,
+						REMOVE,
+						PAUSE,
+						UNPAUSE,
+						SET_EFFECTS,
+						SET_INSERTS
+					};
+
+					TYPE type;
+					Synth* synth;
+					EffectChain* effects;
+				};
+
+				struct Entry {
+					Synth* synth;
+					bool paused;
+					EffectChain* inserts;
+				};
+
+				struct ScheduledEvent {
+					uint64_t time;
+					Synth* synth;
+					SynthCommand command;
+				};
+
+				bool Open();
+				void Close();
+
+				//opens the backend with 'frames' per block and sizes every buffer to what it grants, without starting it
+				bool OpenDevice(uint32_t frames);
+
+				//stops the audio thread and applies whatever it left in the queues
+				void Drain();
+
+				//the adaptive buffering thread, and the reopen it does with the control lock held
+				//Grow() returns true if it reopened the device, which resets the callback stats
+				void StartAdapting();
+				void StopAdapting();
+				void AdaptLoop();
+				bool Grow(uint32_t max_frames, uint64_t misses);
+
+				//hands the command to the callback, or applies it here when the device is closed
+				void Send(EngineCommand::TYPE type, Synth* synth, bool wait, EffectChain* effects = nullptr);
+
+				//audio thread, or any thread while the device is closed
+				void Apply(const EngineCommand& cmd);
+				void Insert(const ScheduledEvent& event);
+				//renders at the engine's rate, resampling on the way out when the device runs at another
+				void Fill(float* out, uint32_t frames);
+				void Mix(float* out, uint32_t frames);
+				void RenderSynths(float* out, uint32_t frames);
+
+				//serialises control threads, since the queue only allows one producer at a time
+				mutable std::mutex control_lock;
+				std::vector<Synth*> registered;
+
+				SPSCQueue<EngineCommand, 256> commands;
+				std::atomic<uint64_t> commands_sent;
+				std::atomic<uint64_t> commands_applied;
+
+				SPSCQueue<ScheduledEvent, MAX_EVENTS> incoming;
+
+				//audio thread only while the device is open
+				std::vector<Entry> active;
+				std::vector<float> scratch;
+
+				//only ever changed by a waited SET_EFFECTS sent under the control lock, so that lock is enough to read it
+				EffectChain* effects;
+				Limiter limiter;
+
+				//the limited block before it's converted, when the device doesn't take floats
+				OutputStage output;
+				std::vector<float> mixed;
+
+				//a block rendered at the engine's rate and not yet all resampled to the device's
+				Resampler resampler;
+				std::vector<float> rendered;
+				uint32_t rendered_read;
+				uint32_t rendered_available;
+
+				//sorted by time from 'next_event' onwards; equal times keep the order they were scheduled in
+				std::vector<ScheduledEvent> pending;
+				size_t next_event;
+				uint64_t sample_time;
+
+				std::atomic<uint64_t> published_sample_time;
+				std::atomic<uint64_t> dropped_events;
+
+				uint32_t render_rate;
+				uint32_t buffer_size;
+				bool running;
+				SDLBackend sdl_backend;
+				AudioBackend* backend;
+				AudioBackend::Specification specification;
+				CallbackStats stats;
+
+				//settings are guarded by 'adaptive_lock', which the thread never holds while it takes the control lock
+				std::mutex adaptive_lock;
+				std::condition_variable adaptive_wake;
+				std::thread adaptive_thread;
+				bool adaptive;
+				bool adaptive_stopping;
+				uint32_t adaptive_limit;
+				uint32_t adaptive_misses;
+		};
+
+		void engine_callback(void* engine_, uint8_t* stream_, int len_);
+
+	}
+}
+
+#endif // AUDIOENGINE_HPP
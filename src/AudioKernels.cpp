@@ -0,0 +1,321 @@
+#include "AudioKernels.hpp"
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define GEIGER_KERNELS_AVX
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GEIGER_KERNELS_SSE
+#endif
+
+namespace geiger {
+	namespace midi {
+
+		//one register's worth of samples; every kernel is written once against these and a scalar tail
+#if defined(GEIGER_KERNELS_AVX)
+		typedef __m256 Lane;
+		static const uint32_t WIDTH = 8;
+
+		static inline Lane Load(const float* p) { return _mm256_loadu_ps(p); }
+		static inline void Store(float* p, Lane v) { _mm256_storeu_ps(p, v); }
+		static inline Lane Splat(float x) { return _mm256_set1_ps(x); }
+		static inline Lane Add(Lane a, Lane b) { return _mm256_add_ps(a, b); }
+		static inline Lane Sub(Lane a, Lane b) { return _mm256_sub_ps(a, b); }
+		static inline Lane Mul(Lane a, Lane b) { return _mm256_mul_ps(a, b); }
+		static inline Lane Max(Lane a, Lane b) { return _mm256_max_ps(a, b); }
+		static inline Lane Abs(Lane a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		static inline Lane Steps() { return _mm256_setr_ps(1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f); }
+#elif defined(GEIGER_KERNELS_SSE)
+		typedef __m128 Lane;
+		static const uint32_t WIDTH = 4;
+
+		static inline Lane Load(const float* p) { return _mm_loadu_ps(p); }
+		static inline void Store(float* p, Lane v) { _mm_storeu_ps(p, v); }
+		static inline Lane Splat(float x) { return _mm_set1_ps(x); }
+		static inline Lane Add(Lane a, Lane b) { return _mm_add_ps(a, b); }
+		static inline Lane Sub(Lane a, Lane b) { return _mm_sub_ps(a, b); }
+		static inline Lane Mul(Lane a, Lane b) { return _mm_mul_ps(a, b); }
+		static inline Lane Max(Lane a, Lane b) { return _mm_max_ps(a, b); }
+		static inline Lane Abs(Lane a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		static inline Lane Steps() { return _mm_setr_ps(1.0f, 2.0f, 3.0f, 4.0f); }
+#else
+		struct Lane { float v; };
+		static const uint32_t WIDTH = 1;
+
+		static inline Lane Load(const float* p) { return Lane{*p}; }
+		static inline void Store(float* p, Lane v) { *p = v.v; }
+		static inline Lane Splat(float x) { return Lane{x}; }
+		static inline Lane Add(Lane a, Lane b) { return Lane{a.v + b.v}; }
+		static inline Lane Sub(Lane a, Lane b) { return Lane{a.v - b.v}; }
+		static inline Lane Mul(Lane a, Lane b) { return Lane{a.v * b.v}; }
+		static inline Lane Max(Lane a, Lane b) { return Lane{(a.v > b.v) ? a.v : b.v}; }
+		static inline Lane Abs(Lane a) { return Lane{std::fabs(a.v)}; }
+		static inline Lane Steps() { return Lane{1.0f}; }
+#endif
+
+		void MixBuffer(float* dst, const float* src, uint32_t frames) {
+			uint32_t i = 0;
+
+			for(; i + WIDTH <= frames; i += WIDTH) {
+				Store(dst + i, Add(Load(dst + i), Load(src + i)));
+			}
+
+			for(; i < frames; i++) {
+				dst[i] += src[i];
+			}
+		}
+
+		void MixBufferWithGain(float* dst, const float* src, float gain, uint32_t frames) {
+			Lane g = Splat(gain);
+			uint32_t i = 0;
+
+			for(; i + WIDTH <= frames; i += WIDTH) {
+				Store(dst + i, Add(Load(dst + i), Mul(Load(src + i), g)));
+			}
+
+			for(; i < frames; i++) {
+				dst[i] += src[i] * gain;
+			}
+		}
+
+		void PanGains(float pan, uint16_t channels, float* gains) {
+			for(uint16_t c = 0; c < channels; c++) {
+				gains[c] = 0.0f;
+			}
+
+			if(channels == 0) {
+				return;
+			}
+
+			if(channels == 1) {
+				gains[0] = 1.0f;
+				return;
+			}
+
+			pan = (pan < -1.0f) ? -1.0f : ((pan > 1.0f) ? 1.0f : pan);
+
+			//a quarter turn from hard left to hard right, so centre sits at -3 dB in each side
+			float angle = (pan + 1.0f) * (float)(M_PI / 4.0);
+			gains[0] = std::cos(angle);
+			gains[1] = std::sin(angle);
+		}
+
+		float ControllerToPan(uint8_t value) {
+			//64 steps below centre but only 63 above, so each side is scaled on its own
+			if(value >= 64) {
+				return (value - 64) / 63.0f;
+			}
+
+			return (value - 64) / 64.0f;
+		}
+
+		void MixBufferPanned(float* dst, uint16_t channels, const float* src, const float* gains, uint32_t frames) {
+			if(channels == 1) {
+				MixBufferWithGain(dst, src, gains[0], frames);
+				return;
+			}
+
+			uint32_t i = 0;
+
+#if defined(GEIGER_KERNELS_AVX) || defined(GEIGER_KERNELS_SSE)
+			//stereo: each group of four mono samples is duplicated into two registers of left/right pairs
+			if(channels == 2) {
+				__m128 g = _mm_setr_ps(gains[0], gains[1], gains[0], gains[1]);
+
+				for(; i + 4 <= frames; i += 4) {
+					__m128 s = _mm_loadu_ps(src + i);
+					float* out = dst + 2 * i;
+
+					_mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(out), _mm_mul_ps(_mm_unpacklo_ps(s, s), g)));
+					_mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(_mm_unpackhi_ps(s, s), g)));
+				}
+			}
+#endif
+
+			for(; i < frames; i++) {
+				float* out = dst + (size_t)(i) * channels;
+
+				for(uint16_t c = 0; c < channels; c++) {
+					out[c] += gains[c] * src[i];
+				}
+			}
+		}
+
+		void InterleaveBuffers(float* dst, const float* const* planes, uint16_t channels, uint32_t frames) {
+			for(uint16_t c = 0; c < channels; c++) {
+				const float* plane = planes[c];
+
+				for(uint32_t i = 0; i < frames; i++) {
+					dst[(size_t)(i) * channels + c] = plane[i];
+				}
+			}
+		}
+
+		void DeinterleaveBuffer(float* const* planes, const float* src, uint16_t channels, uint32_t frames) {
+			for(uint16_t c = 0; c < channels; c++) {
+				float* plane = planes[c];
+
+				for(uint32_t i = 0; i < frames; i++) {
+					plane[i] = src[(size_t)(i) * channels + c];
+				}
+			}
+		}
+
+		void ScaleBuffer(float* dst, float gain, uint32_t frames) {
+			Lane g = Splat(gain);
+			uint32_t i = 0;
+
+			for(; i + WIDTH <= frames; i += WIDTH) {
+				Store(dst + i, Mul(Load(dst + i), g));
+			}
+
+			for(; i < frames; i++) {
+				dst[i] *= gain;
+			}
+		}
+
+		void RampBuffer(float* dst, float start, float end, uint32_t frames) {
+			if(frames == 0) {
+				return;
+			}
+
+			//each gain is worked out from its own index, so no rounding error builds up along the block
+			float step = (end - start) / (float)(frames);
+			Lane s = Splat(start);
+			Lane d = Splat(step);
+			Lane steps = Steps();
+			uint32_t i = 0;
+
+			for(; i + WIDTH <= frames; i += WIDTH) {
+				Lane gain = Add(s, Mul(Add(Splat((float)(i)), steps), d));
+				Store(dst + i, Mul(Load(dst + i), gain));
+			}
+
+			for(; i < frames; i++) {
+				dst[i] *= start + step * (float)(i + 1);
+			}
+		}
+
+		void MultiplyBuffer(float* dst, const float* envelope, uint32_t frames) {
+			uint32_t i = 0;
+
+			for(; i + WIDTH <= frames; i += WIDTH) {
+				Store(dst + i, Mul(Load(dst + i), Load(envelope + i)));
+			}
+
+			for(; i < frames; i++) {
+				dst[i] *= envelope[i];
+			}
+		}
+
+		void CrossfadeBuffer(float* dst, const float* src, uint32_t frames) {
+			if(frames == 0) {
+				return;
+			}
+
+			//dst + w * (src - dst), with w rising to exactly 1 on the last sample
+			float step = 1.0f / (float)(frames);
+			Lane d = Splat(step);
+			Lane steps = Steps();
+			uint32_t i = 0;
+
+			for(; i + WIDTH <= frames; i += WIDTH) {
+				Lane w = Mul(Add(Splat((float)(i)), steps), d);
+				Lane a = Load(dst + i);
+				Store(dst + i, Add(a, Mul(w, Sub(Load(src + i), a))));
+			}
+
+			for(; i < frames; i++) {
+				float w = step * (float)(i + 1);
+				dst[i] += w * (src[i] - dst[i]);
+			}
+		}
+
+		float DotProduct(const float* a, const float* b, uint32_t frames) {
+			Lane sum = Splat(0.0f);
+			uint32_t i = 0;
+
+			for(; i + WIDTH <= frames; i += WIDTH) {
+				sum = Add(sum, Mul(Load(a + i), Load(b + i)));
+			}
+
+			float lanes[WIDTH];
+			Store(lanes, sum);
+
+			float result = 0.0f;
+
+			for(uint32_t k = 0; k < WIDTH; k++) {
+				result += lanes[k];
+			}
+
+			for(; i < frames; i++) {
+				result += a[i] * b[i];
+			}
+
+			return result;
+		}
+
+		float BufferPeak(const float* buffer, uint32_t frames) {
+			Lane peak = Splat(0.0f);
+			uint32_t i = 0;
+
+			//max returns its second operand when the first is NaN, so NaNs never replace the running peak
+			for(; i + WIDTH <= frames; i += WIDTH) {
+				peak = Max(Abs(Load(buffer + i)), peak);
+			}
+
+			float lanes[WIDTH];
+			Store(lanes, peak);
+
+			float result = 0.0f;
+
+			for(uint32_t k = 0; k < WIDTH; k++) {
+				result = (lanes[k] > result) ? lanes[k] : result;
+			}
+
+			for(; i < frames; i++) {
+				float a = std::fabs(buffer[i]);
+				result = (a > result) ? a : result;
+			}
+
+			return result;
+		}
+
+		float BufferRms(const float* buffer, uint32_t frames) {
+			if(frames == 0) {
+				return 0.0f;
+			}
+
+			static const uint32_t STRIDE = 4096;
+
+			//float lanes over short strides, then a double total, so long clips don't lose precision
+			double total = 0.0;
+			uint32_t i = 0;
+
+			while(i < frames) {
+				uint32_t stop = (frames - i < STRIDE) ? frames : i + STRIDE;
+				Lane sum = Splat(0.0f);
+
+				for(; i + WIDTH <= stop; i += WIDTH) {
+					Lane x = Load(buffer + i);
+					sum = Add(sum, Mul(x, x));
+				}
+
+				float lanes[WIDTH];
+				Store(lanes, sum);
+
+				for(uint32_t k = 0; k < WIDTH; k++) {
+					total += lanes[k];
+				}
+
+				for(; i < stop; i++) {
+					total += (double)(buffer[i]) * buffer[i];
+				}
+			}
+
+			return (float)(std::sqrt(total / frames));
+		}
+
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef AUDIOKERNELS_HPP
+#define AUDIOKERNELS_HPP
+
+#include <cstdint>
+
+namespace geiger {
+	namespace midi {
+
+		//in-place block operations on float buffers, vectorized with AVX or SSE when the compiler targets them
+		//source and destination may be the same buffer but must not otherwise overlap
+
+		//dst += src
+		void MixBuffer(float* dst, const float* src, uint32_t frames);
+
+		//dst += gain * src
+		void MixBufferWithGain(float* dst, const float* src, float gain, uint32_t frames);
+
+		//the largest channel count the multichannel kernels and pan law handle
+		const uint16_t MAX_CHANNELS = 8;
+
+		//constant-power pan law: pan runs from -1 (left) to 1 (right), and the squared gains always sum to one
+		//a mono destination gets unity gain; channels past the first two (left and right) get none
+		void PanGains(float pan, uint16_t channels, float* gains);
+
+		//MIDI CC10: 0 is hard left, 64 centre and 127 hard right
+		float ControllerToPan(uint8_t value);
+
+		//interleaved dst += gains[c] * mono src for each of 'channels' channels, 'frames' frames
+		void MixBufferPanned(float* dst, uint16_t channels, const float* src, const float* gains, uint32_t frames);
+
+		//between planar buffers, one per channel, and a single interleaved buffer
+		void InterleaveBuffers(float* dst, const float* const* planes, uint16_t channels, uint32_t frames);
+		void DeinterleaveBuffer(float* const* planes, const float* src, uint16_t channels, uint32_t frames);
+
+		//dst *= gain
+		void ScaleBuffer(float* dst, float gain, uint32_t frames);
+
+		//dst *= a gain moving in a straight line from 'start' to 'end', reaching 'end' on the last sample
+		void RampBuffer(float* dst, float start, float end, uint32_t frames);
+
+		//dst *= envelope
+		void MultiplyBuffer(float* dst, const float* envelope, uint32_t frames);
+
+		//fades dst out and src in linearly across the block, leaving the result in dst
+		void CrossfadeBuffer(float* dst, const float* src, uint32_t frames);
+
+		//the sum of a[i] * b[i]
+		float DotProduct(const float* a, const float* b, uint32_t frames);
+
+		//the largest absolute value, ignoring NaNs
+		float BufferPeak(const float* buffer, uint32_t frames);
+
+		//the root mean square level
+		float BufferRms(const float* buffer, uint32_t frames);
+
+	}
+}
+
+#endif // AUDIOKERNELS_HPP
@@ -0,0 +1,249 @@
+#include "BiquadBank.hpp"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEIGER_BIQUAD_SSE2
+#endif
+
+namespace geiger {
+	namespace midi {
+
+#if defined(GEIGER_BIQUAD_SSE2)
+		//the first 'lanes' channels of a frame, with the unused lanes zero
+		static inline __m128 LoadFrame(const float* p, uint32_t lanes) {
+			switch(lanes) {
+				case 4: return _mm_loadu_ps(p);
+				case 3: return _mm_setr_ps(p[0], p[1], p[2], 0.0f);
+				case 2: return _mm_castpd_ps(_mm_load_sd((const double*)(p)));
+				default: return _mm_load_ss(p);
+			}
+		}
+
+		static inline void StoreFrame(float* p, __m128 v, uint32_t lanes) {
+			switch(lanes) {
+				case 4:
+					_mm_storeu_ps(p, v);
+					break;
+				case 3:
+					_mm_store_sd((double*)(p), _mm_castps_pd(v));
+					_mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+					break;
+				case 2:
+					_mm_store_sd((double*)(p), _mm_castps_pd(v));
+					break;
+				default:
+					_mm_store_ss(p, v);
+					break;
+			}
+		}
+#endif
+
+		BiquadBank::BiquadBank() {
+			sample_rate = 44100;
+			channel_count = 1;
+
+			for(uint32_t i = 0; i < MAX_STAGES; i++) {
+				stages[i] = {false, LOWPASS, 1000.0f, 0.7071f, 0.0f};
+			}
+
+			Reset();
+		}
+
+		bool BiquadBank::SetStage(uint32_t index, TYPE type, float frequency, float q, float gain_decibels) {
+			if(index >= MAX_STAGES) {
+				return false;
+			}
+
+			stages[index] = {true, type, frequency, q, gain_decibels};
+			Publish();
+
+			return true;
+		}
+
+		void BiquadBank::ClearStage(uint32_t index) {
+			if(index >= MAX_STAGES) {
+				return;
+			}
+
+			stages[index].active = false;
+			Publish();
+		}
+
+		void BiquadBank::ClearStages() {
+			for(uint32_t i = 0; i < MAX_STAGES; i++) {
+				stages[i].active = false;
+			}
+
+			Publish();
+		}
+
+		void BiquadBank::Configure(uint32_t rate, uint16_t channels) {
+			sample_rate = (rate > 0) ? rate : 44100;
+			channel_count = (channels > 0) ? ((channels < MAX_CHANNELS) ? channels : MAX_CHANNELS) : 1;
+
+			Publish();
+			Reset();
+		}
+
+		void BiquadBank::Reset() {
+			for(uint32_t s = 0; s < MAX_STAGES; s++) {
+				for(uint32_t c = 0; c < MAX_CHANNELS; c++) {
+					z1[s][c] = 0.0f;
+					z2[s][c] = 0.0f;
+				}
+			}
+		}
+
+		void BiquadBank::Publish() {
+			Coefficients coefficients;
+			coefficients.count = 0;
+
+			for(uint32_t i = 0; i < MAX_STAGES; i++) {
+				const Stage& stage = stages[i];
+
+				if(!stage.active) {
+					continue;
+				}
+
+				//just under Nyquist, where the cookbook formulas stop being stable
+				double limit = 0.49 * sample_rate;
+				double frequency = (stage.frequency < limit) ? stage.frequency : limit;
+				frequency = (frequency > 1.0) ? frequency : 1.0;
+
+				double q = (stage.q > 0.01f) ? stage.q : 0.01;
+				double w = 2.0 * M_PI * frequency / sample_rate;
+				double c = std::cos(w);
+				double alpha = std::sin(w) / (2.0 * q);
+				double A = std::pow(10.0, stage.gain / 40.0);
+				double root = 2.0 * std::sqrt(A) * alpha;
+
+				double b0, b1, b2, a0, a1, a2;
+
+				switch(stage.type) {
+					case LOWPASS:
+						b0 = 0.5 * (1.0 - c); b1 = 1.0 - c; b2 = b0;
+						a0 = 1.0 + alpha; a1 = -2.0 * c; a2 = 1.0 - alpha;
+						break;
+
+					case HIGHPASS:
+						b0 = 0.5 * (1.0 + c); b1 = -(1.0 + c); b2 = b0;
+						a0 = 1.0 + alpha; a1 = -2.0 * c; a2 = 1.0 - alpha;
+						break;
+
+					case BANDPASS:
+						b0 = alpha; b1 = 0.0; b2 = -alpha;
+						a0 = 1.0 + alpha; a1 = -2.0 * c; a2 = 1.0 - alpha;
+						break;
+
+					case NOTCH:
+						b0 = 1.0; b1 = -2.0 * c; b2 = 1.0;
+						a0 = 1.0 + alpha; a1 = -2.0 * c; a2 = 1.0 - alpha;
+						break;
+
+					case PEAK:
+						b0 = 1.0 + alpha * A; b1 = -2.0 * c; b2 = 1.0 - alpha * A;
+						a0 = 1.0 + alpha / A; a1 = -2.0 * c; a2 = 1.0 - alpha / A;
+						break;
+
+					case LOW_SHELF:
+						b0 = A * ((A + 1.0) - (A - 1.0) * c + root);
+						b1 = 2.0 * A * ((A - 1.0) - (A + 1.0) * c);
+						b2 = A * ((A + 1.0) - (A - 1.0) * c - root);
+						a0 = (A + 1.0) + (A - 1.0) * c + root;
+						a1 = -2.0 * ((A - 1.0) + (A + 1.0) * c);
+						a2 = (A + 1.0) + (A - 1.0) * c - root;
+						break;
+
+					case HIGH_SHELF:
+					default:
+						b0 = A * ((A + 1.0) + (A - 1.0) * c + root);
+						b1 = -2.0 * A * ((A - 1.0) + (A + 1.0) * c);
+						b2 = A * ((A + 1.0) + (A - 1.0) * c - root);
+						a0 = (A + 1.0) - (A - 1.0) * c + root;
+						a1 = 2.0 * ((A - 1.0) - (A + 1.0) * c);
+						a2 = (A + 1.0) - (A - 1.0) * c - root;
+						break;
+				}
+
+				uint32_t n = coefficients.count++;
+
+				coefficients.b0[n] = (float)(b0 / a0);
+				coefficients.b1[n] = (float)(b1 / a0);
+				coefficients.b2[n] = (float)(b2 / a0);
+				coefficients.a1[n] = (float)(a1 / a0);
+				coefficients.a2[n] = (float)(a2 / a0);
+			}
+
+			snapshot.Publish(coefficients);
+		}
+
+		void BiquadBank::Process(float* buffer, uint32_t frames) {
+			const Coefficients& k = snapshot.Acquire();
+			uint32_t count = k.count;
+			uint32_t stride = channel_count;
+
+			if(count == 0) {
+				return;
+			}
+
+#if defined(GEIGER_BIQUAD_SSE2)
+			//four channels per register; each frame runs through the whole cascade before the next, so the state never leaves registers
+			for(uint32_t group = 0; group < stride; group += 4) {
+				uint32_t lanes = (stride - group < 4) ? (stride - group) : 4;
+
+				__m128 b0[MAX_STAGES], b1[MAX_STAGES], b2[MAX_STAGES], a1[MAX_STAGES], a2[MAX_STAGES];
+				__m128 s1[MAX_STAGES], s2[MAX_STAGES];
+
+				for(uint32_t s = 0; s < count; s++) {
+					b0[s] = _mm_set1_ps(k.b0[s]);
+					b1[s] = _mm_set1_ps(k.b1[s]);
+					b2[s] = _mm_set1_ps(k.b2[s]);
+					a1[s] = _mm_set1_ps(k.a1[s]);
+					a2[s] = _mm_set1_ps(k.a2[s]);
+					s1[s] = _mm_load_ps(&z1[s][group]);
+					s2[s] = _mm_load_ps(&z2[s][group]);
+				}
+
+				float* p = buffer + group;
+
+				for(uint32_t i = 0; i < frames; i++, p += stride) {
+					__m128 x = LoadFrame(p, lanes);
+
+					for(uint32_t s = 0; s < count; s++) {
+						__m128 y = _mm_add_ps(_mm_mul_ps(b0[s], x), s1[s]);
+						s1[s] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1[s], x), _mm_mul_ps(a1[s], y)), s2[s]);
+						s2[s] = _mm_sub_ps(_mm_mul_ps(b2[s], x), _mm_mul_ps(a2[s], y));
+						x = y;
+					}
+
+					StoreFrame(p, x, lanes);
+				}
+
+				for(uint32_t s = 0; s < count; s++) {
+					_mm_store_ps(&z1[s][group], s1[s]);
+					_mm_store_ps(&z2[s][group], s2[s]);
+				}
+			}
+#else
+			for(uint32_t c = 0; c < stride; c++) {
+				float* p = buffer + c;
+
+				for(uint32_t i = 0; i < frames; i++, p += stride) {
+					float x = *p;
+
+					for(uint32_t s = 0; s < count; s++) {
+						float y = k.b0[s] * x + z1[s][c];
+						z1[s][c] = k.b1[s] * x - k.a1[s] * y + z2[s][c];
+						z2[s][c] = k.b2[s] * x - k.a2[s] * y;
+						x = y;
+					}
+
+					*p = x;
+				}
+			}
+#endif
+		}
+
+	}
+}
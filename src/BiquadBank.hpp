@@ -0,0 +1,80 @@
+#ifndef BIQUADBANK_HPP
+#define BIQUADBANK_HPP
+
+#include "Effect.hpp"
+#include "AudioKernels.hpp"
+#include "Parameter.hpp"
+
+namespace geiger {
+	namespace midi {
+
+		//a cascade of up to MAX_STAGES biquad filters (the RBJ cookbook shapes) run on every channel at once
+		//the channels of a frame share one SIMD register, four at a time, so a stereo bus costs the same as a mono one
+		//each stage is a transposed direct form II section; its coefficients are worked out on the control thread
+		//and handed over as a snapshot, so retuning never blocks the audio thread
+		class BiquadBank : public Effect
+		{
+			public:
+				static const uint32_t MAX_STAGES = 8;
+
+				enum TYPE {
+					LOWPASS = 0,
+					HIGHPASS,
+					BANDPASS,
+					NOTCH,
+					PEAK,
+					LOW_SHELF,
+					HIGH_SHELF
+				};
+
+				BiquadBank();
+
+				//control thread: sets stage 'index' of the cascade; 'gain_decibels' only matters for PEAK and the shelves
+				//the frequency is kept below Nyquist and the Q above zero; returns false if 'index' is out of range
+				bool SetStage(uint32_t index, TYPE type, float frequency, float q = 0.7071f, float gain_decibels = 0.0f);
+
+				//control thread: takes the stage out of the cascade
+				void ClearStage(uint32_t index);
+				void ClearStages();
+
+				virtual void Configure(uint32_t sample_rate, uint16_t channels) override;
+				virtual void Process(float* buffer, uint32_t frames) override;
+				virtual void Reset() override;
+
+			private:
+				struct Stage {
+					bool active;
+					TYPE type;
+					float frequency;
+					float q;
+					float gain;
+				};
+
+				//the active stages, packed in order
+				struct Coefficients {
+					float b0[MAX_STAGES];
+					float b1[MAX_STAGES];
+					float b2[MAX_STAGES];
+					float a1[MAX_STAGES];
+					float a2[MAX_STAGES];
+					uint32_t count;
+				};
+
+				//control thread: turns 'stages' into coefficients for the current rate and publishes them
+				void Publish();
+
+				Stage stages[MAX_STAGES];
+				uint32_t sample_rate;
+
+				ParameterSnapshot<Coefficients> snapshot;
+
+				//audio thread: each stage's two state variables, per channel
+				uint16_t channel_count;
+				alignas(16) float z1[MAX_STAGES][MAX_CHANNELS];
+				alignas(16) float z2[MAX_STAGES][MAX_CHANNELS];
+		};
+
+	}
+}
+
+#endif // BIQUADBANK_HPP
@@ -0,0 +1,124 @@
+#include "BufferPool.hpp"
+#include <cstdlib>
+#include <iostream>
+
+namespace geiger {
+	namespace midi {
+
+		BufferPool& BufferPool::Get() {
+			static BufferPool pool;
+			return pool;
+		}
+
+		BufferPool::BufferPool() : allocations{0}, outstanding{0} {}
+
+		BufferPool::~BufferPool() {
+			Trim();
+		}
+
+		float* BufferPool::Acquire(uint32_t frames, uint32_t& capacity) {
+			uint32_t bits = MIN_CLASS_BITS;
+
+			while(bits <= MAX_CLASS_BITS && ((uint32_t)(1) << bits) < frames) {
+				bits++;
+			}
+
+			float* buffer = nullptr;
+
+			if(bits > MAX_CLASS_BITS) {
+				capacity = frames;
+			} else {
+				capacity = (uint32_t)(1) << bits;
+
+				std::lock_guard<std::mutex> guard(lock);
+				std::vector<float*>& free_list = free_lists[bits - MIN_CLASS_BITS];
+
+				if(!free_list.empty()) {
+					buffer = free_list.back();
+					free_list.pop_back();
+				}
+			}
+
+			if(!buffer) {
+				buffer = Allocate(capacity);
+
+				if(!buffer) {
+					std::cerr << "[BufferPool] Error allocating buffer\n\t";
+					std::cerr << "Reason: Out of memory for " << capacity << " samples.\n\n";
+					capacity = 0;
+					return nullptr;
+				}
+
+				allocations.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			outstanding.fetch_add(1, std::memory_order_relaxed);
+
+			return buffer;
+		}
+
+		void BufferPool::Release(float* buffer, uint32_t capacity) {
+			if(!buffer) {
+				return;
+			}
+
+			outstanding.fetch_sub(1, std::memory_order_relaxed);
+
+			//only exact class sizes go back on a list; oversized buffers were allocated to fit
+			uint32_t bits = MIN_CLASS_BITS;
+
+			while(bits <= MAX_CLASS_BITS && ((uint32_t)(1) << bits) != capacity) {
+				bits++;
+			}
+
+			if(bits > MAX_CLASS_BITS) {
+				Free(buffer);
+				return;
+			}
+
+			std::lock_guard<std::mutex> guard(lock);
+			free_lists[bits - MIN_CLASS_BITS].push_back(buffer);
+		}
+
+		void BufferPool::Trim() {
+			std::lock_guard<std::mutex> guard(lock);
+
+			for(std::vector<float*>& free_list : free_lists) {
+				for(float* buffer : free_list) {
+					Free(buffer);
+				}
+
+				free_list.clear();
+				free_list.shrink_to_fit();
+			}
+		}
+
+		uint64_t BufferPool::GetAllocationCount() const {
+			return allocations.load(std::memory_order_relaxed);
+		}
+
+		uint64_t BufferPool::GetOutstandingCount() const {
+			return outstanding.load(std::memory_order_relaxed);
+		}
+
+		float* BufferPool::Allocate(uint32_t frames) {
+			//over-allocate, round up to the alignment and keep the real address just below the buffer
+			size_t bytes = (size_t)(frames) * sizeof(float) + ALIGNMENT + sizeof(void*);
+			char* raw = (char*)(std::malloc(bytes));
+
+			if(!raw) {
+				return nullptr;
+			}
+
+			uintptr_t aligned = ((uintptr_t)(raw) + sizeof(void*) + ALIGNMENT - 1) & ~((uintptr_t)(ALIGNMENT) - 1);
+			((void**)(aligned))[-1] = raw;
+
+			return (float*)(aligned);
+		}
+
+		void BufferPool::Free(float* buffer) {
+			std::free(((void**)(buffer))[-1]);
+		}
+
+	}
+}
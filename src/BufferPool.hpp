@@ -0,0 +1,59 @@
+#ifndef BUFFERPOOL_HPP
+#define BUFFERPOOL_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace geiger {
+	namespace midi {
+
+		//recycles 64-byte aligned float buffers so rendering a clip doesn't go to the heap every time
+		//buffers come in power-of-two size classes; a released buffer waits in its class's free list for the next request that fits
+		class BufferPool
+		{
+			public:
+				static const uint32_t ALIGNMENT = 64;
+				static const uint32_t MIN_CLASS_BITS = 8;
+				static const uint32_t MAX_CLASS_BITS = 24;
+
+				static BufferPool& Get();
+
+				BufferPool(const BufferPool&) = delete;
+				BufferPool& operator=(const BufferPool&) = delete;
+
+				//a buffer of at least 'frames' floats; 'capacity' receives its real size, which Release needs back
+				//requests above the largest class are allocated to size and freed again on release
+				float* Acquire(uint32_t frames, uint32_t& capacity);
+				void Release(float* buffer, uint32_t capacity);
+
+				//frees every buffer waiting in the free lists
+				void Trim();
+
+				//how many times the pool has had to allocate from the heap; steady-state rendering leaves it unchanged
+				uint64_t GetAllocationCount() const;
+
+				//buffers currently handed out
+				uint64_t GetOutstandingCount() const;
+
+			private:
+				static const uint32_t CLASS_COUNT = MAX_CLASS_BITS - MIN_CLASS_BITS + 1;
+
+				BufferPool();
+				~BufferPool();
+
+				static float* Allocate(uint32_t frames);
+				static void Free(float* buffer);
+
+				std::mutex lock;
+				std::vector<float*> free_lists[CLASS_COUNT];
+
+				std::atomic<uint64_t> allocations;
+				std::atomic<uint64_t> outstanding;
+		};
+
+	}
+}
+
+#endif // BUFFERPOOL_HPP
@@ -0,0 +1,180 @@
+#include "CallbackStats.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace geiger {
+	namespace midi {
+
+		CallbackStats::CallbackStats(const std::string& name_) : name{name_} {
+			log_interval = 0.0f;
+			log_stopping = false;
+			logged_callbacks = 0;
+			logged_misses = 0;
+			logged_ns = 0;
+			logged_budget_ns = 0;
+
+			Reset();
+		}
+
+		CallbackStats::~CallbackStats() {
+			SetLogInterval(0.0f);
+		}
+
+		void CallbackStats::End(TimePoint start, uint32_t frames, uint32_t sample_rate) {
+			uint64_t elapsed = (uint64_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+			uint64_t budget = (sample_rate > 0) ? ((uint64_t)(frames) * 1000000000ull) / sample_rate : 0;
+
+			//only this thread writes, so plain loads and stores are enough; readers just see relaxed values
+			callbacks.store(callbacks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			last_ns.store(elapsed, std::memory_order_relaxed);
+			total_ns.store(total_ns.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+			budget_ns.store(budget, std::memory_order_relaxed);
+			total_budget_ns.store(total_budget_ns.load(std::memory_order_relaxed) + budget, std::memory_order_relaxed);
+
+			if(elapsed > max_ns.load(std::memory_order_relaxed)) {
+				max_ns.store(elapsed, std::memory_order_relaxed);
+			}
+
+			if(budget > 0) {
+				uint64_t load = (elapsed * 1000000ull) / budget;
+
+				if(load > peak_load_ppm.load(std::memory_order_relaxed)) {
+					peak_load_ppm.store(load, std::memory_order_relaxed);
+				}
+
+				if(elapsed > budget) {
+					deadline_misses.store(deadline_misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				}
+			}
+
+			//the bin is the position of the highest set bit of the duration in microseconds
+			uint64_t micros = elapsed / 1000;
+			uint32_t bin = 0;
+
+			while(micros > 1 && bin < HISTOGRAM_BINS - 1) {
+				micros >>= 1;
+				bin++;
+			}
+
+			histogram[bin].store(histogram[bin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		CallbackStats::Snapshot CallbackStats::GetSnapshot() const {
+			Snapshot snapshot;
+
+			snapshot.callbacks = callbacks.load(std::memory_order_relaxed);
+			snapshot.deadline_misses = deadline_misses.load(std::memory_order_relaxed);
+
+			uint64_t total = total_ns.load(std::memory_order_relaxed);
+			uint64_t total_budget = total_budget_ns.load(std::memory_order_relaxed);
+			uint64_t last = last_ns.load(std::memory_order_relaxed);
+			uint64_t budget = budget_ns.load(std::memory_order_relaxed);
+
+			snapshot.last_seconds = last * 1e-9;
+			snapshot.mean_seconds = (snapshot.callbacks > 0) ? (total * 1e-9) / snapshot.callbacks : 0.0;
+			snapshot.max_seconds = max_ns.load(std::memory_order_relaxed) * 1e-9;
+			snapshot.budget_seconds = budget * 1e-9;
+
+			snapshot.last_load = (budget > 0) ? (double)(last) / budget : 0.0;
+			snapshot.mean_load = (total_budget > 0) ? (double)(total) / total_budget : 0.0;
+			snapshot.peak_load = peak_load_ppm.load(std::memory_order_relaxed) * 1e-6;
+
+			for(uint32_t i = 0; i < HISTOGRAM_BINS; i++) {
+				snapshot.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+			}
+
+			return snapshot;
+		}
+
+		void CallbackStats::Reset() {
+			callbacks.store(0, std::memory_order_relaxed);
+			deadline_misses.store(0, std::memory_order_relaxed);
+			last_ns.store(0, std::memory_order_relaxed);
+			total_ns.store(0, std::memory_order_relaxed);
+			max_ns.store(0, std::memory_order_relaxed);
+			budget_ns.store(0, std::memory_order_relaxed);
+			total_budget_ns.store(0, std::memory_order_relaxed);
+			peak_load_ppm.store(0, std::memory_order_relaxed);
+
+			for(uint32_t i = 0; i < HISTOGRAM_BINS; i++) {
+				histogram[i].store(0, std::memory_order_relaxed);
+			}
+
+			std::lock_guard<std::mutex> guard(log_lock);
+			logged_callbacks = 0;
+			logged_misses = 0;
+			logged_ns = 0;
+			logged_budget_ns = 0;
+		}
+
+		void CallbackStats::SetLogInterval(float seconds) {
+			std::unique_lock<std::mutex> guard(log_lock);
+
+			log_interval = (seconds > 0.0f) ? seconds : 0.0f;
+
+			if(log_interval > 0.0f) {
+				if(!log_thread.joinable()) {
+					log_stopping = false;
+					log_thread = std::thread(&CallbackStats::LogLoop, this);
+				}
+
+				log_wake.notify_all();
+				return;
+			}
+
+			if(log_thread.joinable()) {
+				log_stopping = true;
+				log_wake.notify_all();
+				guard.unlock();
+
+				log_thread.join();
+			}
+		}
+
+		double CallbackStats::GetBinStart(uint32_t bin) {
+			return (bin == 0) ? 0.0 : (double)(1ull << bin) * 1e-6;
+		}
+
+		void CallbackStats::LogLoop() {
+			std::unique_lock<std::mutex> guard(log_lock);
+
+			while(!log_stopping) {
+				auto interval = std::chrono::duration<float>(log_interval);
+
+				if(log_wake.wait_for(guard, interval, [this] { return log_stopping; })) {
+					break;
+				}
+
+				Log();
+			}
+		}
+
+		void CallbackStats::Log() {
+			uint64_t count = callbacks.load(std::memory_order_relaxed);
+			uint64_t misses = deadline_misses.load(std::memory_order_relaxed);
+			uint64_t total = total_ns.load(std::memory_order_relaxed);
+			uint64_t total_budget = total_budget_ns.load(std::memory_order_relaxed);
+
+			//nothing's been called since the last line, e.g. with no synths playing
+			if(count == logged_callbacks) {
+				return;
+			}
+
+			double load = (total_budget > logged_budget_ns) ? (double)(total - logged_ns) / (double)(total_budget - logged_budget_ns) : 0.0;
+			char line[256];
+
+			std::snprintf(line, sizeof(line), "[%s] %llu callbacks, %.1f%% mean load, %.1f%% peak, worst %.3f ms of %.3f ms, %llu missed deadlines (%llu in all)\n",
+			              name.c_str(), (unsigned long long)(count - logged_callbacks), load * 100.0, peak_load_ppm.load(std::memory_order_relaxed) * 1e-4,
+			              max_ns.load(std::memory_order_relaxed) * 1e-6, budget_ns.load(std::memory_order_relaxed) * 1e-6,
+			              (unsigned long long)(misses - logged_misses), (unsigned long long)(misses));
+
+			std::clog << line;
+
+			logged_callbacks = count;
+			logged_misses = misses;
+			logged_ns = total;
+			logged_budget_ns = total_budget;
+		}
+
+	}
+}
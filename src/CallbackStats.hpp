@@ -0,0 +1,106 @@
+#ifndef CALLBACKSTATS_HPP
+#define CALLBACKSTATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace geiger {
+	namespace midi {
+
+		//times every audio callback against its deadline, the time the block it fills takes to play
+		//the audio thread only ever does relaxed stores, so reading the figures from any thread never holds it up
+		//a snapshot is read field by field, so one taken mid-callback can be a callback apart between fields
+		class CallbackStats
+		{
+			public:
+				//callback durations are counted in power-of-two bins: bin 0 is under 2 microseconds,
+				//bin k is from 2^k up to 2^(k+1) microseconds, and the last bin takes everything longer
+				static const uint32_t HISTOGRAM_BINS = 24;
+
+				typedef std::chrono::steady_clock::time_point TimePoint;
+
+				struct Snapshot {
+					uint64_t callbacks;
+
+					//callbacks that took longer than their block lasts: each one is an underrun on a real device
+					uint64_t deadline_misses;
+
+					double last_seconds;
+					double mean_seconds;
+					double max_seconds;
+
+					//the time the last callback's block lasts
+					double budget_seconds;
+
+					//duration over budget: 1 is a callback that only just made it
+					double last_load;
+					double mean_load;
+					double peak_load;
+
+					uint64_t histogram[HISTOGRAM_BINS];
+				};
+
+				//'name' starts each log line
+				explicit CallbackStats(const std::string& name);
+				~CallbackStats();
+
+				CallbackStats(const CallbackStats&) = delete;
+				CallbackStats& operator=(const CallbackStats&) = delete;
+
+				//audio thread: brackets one callback that filled 'frames' frames played at 'sample_rate'
+				static TimePoint Begin() { return std::chrono::steady_clock::now(); }
+				void End(TimePoint start, uint32_t frames, uint32_t sample_rate);
+
+				//any thread
+				Snapshot GetSnapshot() const;
+
+				//any thread; a callback in progress may still be counted afterwards
+				void Reset();
+
+				//any thread: every 'seconds', a thread of its own writes a line to std::clog about the callbacks since the last one
+				//0 (the default) stops it
+				void SetLogInterval(float seconds);
+
+				//'bin' as the shortest duration it holds, in seconds
+				static double GetBinStart(uint32_t bin);
+
+			private:
+				void Log();
+				void LogLoop();
+
+				std::string name;
+
+				std::atomic<uint64_t> callbacks;
+				std::atomic<uint64_t> deadline_misses;
+				std::atomic<uint64_t> last_ns;
+				std::atomic<uint64_t> total_ns;
+				std::atomic<uint64_t> max_ns;
+				std::atomic<uint64_t> budget_ns;
+				std::atomic<uint64_t> total_budget_ns;
+
+				//the highest duration over budget so far, in millionths
+				std::atomic<uint64_t> peak_load_ppm;
+
+				std::atomic<uint64_t> histogram[HISTOGRAM_BINS];
+
+				//the logging thread and the figures at its last line
+				std::mutex log_lock;
+				std::condition_variable log_wake;
+				std::thread log_thread;
+				float log_interval;
+				bool log_stopping;
+				uint64_t logged_callbacks;
+				uint64_t logged_misses;
+				uint64_t logged_ns;
+				uint64_t logged_budget_ns;
+		};
+
+	}
+}
+
+#endif // CALLBACKSTATS_HPP
@@ -0,0 +1,123 @@
+#ifndef COMMANDQUEUE_HPP
+#define COMMANDQUEUE_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace geiger {
+	namespace midi {
+
+		//a request from a control thread for the audio thread to change a synth's state
+		struct SynthCommand {
+			enum TYPE {
+				NOTE_ON = 0,
+				NOTE_OFF,
+				ALL_NOTES_OFF,
+				ALL_SOUND_OFF,
+				CONTROL_CHANGE,
+				PLUCK,
+				SILENCE,
+				FRET,
+				OPEN
+			};
+
+			TYPE type;
+
+			//sample number on the receiving synth's clock; the command is applied on exactly that sample, or as soon as possible if it has passed
+			uint64_t time;
+
+			//MIDI note number, controller number or string index, depending on the type
+			uint32_t target;
+
+			//velocity, controller value, pluck distance or fretted length
+			float value;
+
+			//pluck offset
+			float value2;
+		};
+
+		//a bounded ring between exactly one producer thread and exactly one consumer thread
+		//neither side ever blocks or allocates: Push fails when the ring is full and Front returns null when it's empty
+		template<typename T, uint32_t Capacity>
+		class SPSCQueue
+		{
+			static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+			public:
+				SPSCQueue() : head{0}, tail{0} {}
+
+				SPSCQueue(const SPSCQueue&) = delete;
+				SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+				//producer only
+				bool Push(const T& item) {
+					uint32_t h = head.load(std::memory_order_relaxed);
+
+					if(h - tail.load(std::memory_order_acquire) == Capacity) {
+						return false;
+					}
+
+					items[h & MASK] = item;
+					head.store(h + 1, std::memory_order_release);
+
+					return true;
+				}
+
+				//consumer only: the oldest item, which stays valid until Pop
+				const T* Front() const {
+					uint32_t t = tail.load(std::memory_order_relaxed);
+
+					if(t == head.load(std::memory_order_acquire)) {
+						return nullptr;
+					}
+
+					return &items[t & MASK];
+				}
+
+				//consumer only: call after Front returned an item
+				void Pop() {
+					tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+				}
+
+				bool Pop(T& item) {
+					const T* front = Front();
+
+					if(!front) {
+						return false;
+					}
+
+					item = *front;
+					Pop();
+
+					return true;
+				}
+
+				void Clear() {
+					while(Front()) {
+						Pop();
+					}
+				}
+
+				uint32_t GetCapacity() const {
+					return Capacity;
+				}
+
+			private:
+				static const uint32_t MASK = Capacity - 1;
+				static const uint32_t CACHE_LINE = 64;
+
+				//padded onto separate cache lines so the two threads don't invalidate each other's index
+				//(padding rather than alignas, since C++14 operator new ignores over-alignment)
+				std::atomic<uint32_t> head;
+				char head_padding[CACHE_LINE - sizeof(std::atomic<uint32_t>)];
+				std::atomic<uint32_t> tail;
+				char tail_padding[CACHE_LINE - sizeof(std::atomic<uint32_t>)];
+				T items[Capacity];
+		};
+
+		typedef SPSCQueue<SynthCommand, 256> CommandQueue;
+
+	}
+}
+
+#endif // COMMANDQUEUE_HPP
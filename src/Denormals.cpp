@@ -0,0 +1,46 @@
+#include "Denormals.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GEIGER_DENORMALS_SSE
+#elif defined(__aarch64__)
+#define GEIGER_DENORMALS_AARCH64
+#endif
+
+namespace geiger {
+	namespace midi {
+
+#if defined(GEIGER_DENORMALS_SSE)
+		//MXCSR flush-to-zero (bit 15) and denormals-are-zero (bit 6)
+		static const uint32_t FLUSH_BITS = 0x8040;
+#elif defined(GEIGER_DENORMALS_AARCH64)
+		//FPCR flush-to-zero (bit 24)
+		static const uint64_t FLUSH_BITS = (uint64_t)(1) << 24;
+#endif
+
+		DenormalGuard::DenormalGuard() {
+#if defined(GEIGER_DENORMALS_SSE)
+			saved_state = _mm_getcsr();
+			_mm_setcsr((uint32_t)(saved_state) | FLUSH_BITS);
+#elif defined(GEIGER_DENORMALS_AARCH64)
+			uint64_t fpcr;
+			__asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+			saved_state = fpcr;
+			fpcr |= FLUSH_BITS;
+			__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#else
+			saved_state = 0;
+#endif
+		}
+
+		DenormalGuard::~DenormalGuard() {
+#if defined(GEIGER_DENORMALS_SSE)
+			_mm_setcsr((uint32_t)(saved_state));
+#elif defined(GEIGER_DENORMALS_AARCH64)
+			uint64_t fpcr = saved_state;
+			__asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#endif
+		}
+
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef DENORMALS_HPP
+#define DENORMALS_HPP
+
+#include <cstdint>
+
+namespace geiger {
+	namespace midi {
+
+		//flushes denormal floats to zero on the current thread for as long as it's in scope
+		//decaying oscillators and filters otherwise spend most of their time on denormal arithmetic, which is many times slower
+		class DenormalGuard
+		{
+			public:
+				DenormalGuard();
+				~DenormalGuard();
+
+				DenormalGuard(const DenormalGuard&) = delete;
+				DenormalGuard& operator=(const DenormalGuard&) = delete;
+
+			private:
+				uint64_t saved_state;
+		};
+
+	}
+}
+
+#endif // DENORMALS_HPP
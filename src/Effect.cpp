@@ -0,0 +1,77 @@
+#include "Effect.hpp"
+
+namespace geiger {
+	namespace midi {
+
+		EffectChain::EffectChain() {
+			count = 0;
+			sample_rate = 0;
+			channel_count = 0;
+
+			for(uint32_t i = 0; i < MAX_EFFECTS; i++) {
+				effects[i] = nullptr;
+			}
+		}
+
+		bool EffectChain::Add(Effect* effect) {
+			if(effect == nullptr || count == MAX_EFFECTS) {
+				return false;
+			}
+
+			if(sample_rate > 0) {
+				effect->Configure(sample_rate, channel_count);
+			}
+
+			effects[count++] = effect;
+			return true;
+		}
+
+		void EffectChain::Clear() {
+			for(uint32_t i = 0; i < count; i++) {
+				effects[i] = nullptr;
+			}
+
+			count = 0;
+		}
+
+		void EffectChain::Configure(uint32_t rate, uint16_t channels) {
+			sample_rate = rate;
+			channel_count = (channels > 0) ? channels : 1;
+
+			for(uint32_t i = 0; i < count; i++) {
+				effects[i]->Configure(sample_rate, channel_count);
+			}
+		}
+
+		void EffectChain::Process(float* buffer, uint32_t frames) {
+			for(uint32_t i = 0; i < count; i++) {
+				if(!effects[i]->IsBypassed()) {
+					effects[i]->Process(buffer, frames);
+				}
+			}
+		}
+
+		void EffectChain::Reset() {
+			for(uint32_t i = 0; i < count; i++) {
+				effects[i]->Reset();
+			}
+		}
+
+		uint32_t EffectChain::GetEffectCount() const {
+			return count;
+		}
+
+		Effect* EffectChain::GetEffect(uint32_t index) const {
+			return (index < count) ? effects[index] : nullptr;
+		}
+
+		uint32_t EffectChain::GetSampleRate() const {
+			return sample_rate;
+		}
+
+		uint16_t EffectChain::GetChannelCount() const {
+			return channel_count;
+		}
+
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef EFFECT_HPP
+#define EFFECT_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace geiger {
+	namespace midi {
+
+		//a block processor that sits in the mix path after the synths, working in place on interleaved frames
+		//everything an effect needs is allocated in Configure(), so Process() never allocates or locks
+		class Effect
+		{
+			public:
+				Effect() : bypassed{false} {}
+				virtual ~Effect() {}
+
+				Effect(const Effect&) = delete;
+				Effect& operator=(const Effect&) = delete;
+
+				//only while nothing is processing: sizes the effect for 'channels' interleaved channels at 'sample_rate' and empties it
+				virtual void Configure(uint32_t sample_rate, uint16_t channels) = 0;
+
+				//audio thread: processes 'frames' interleaved frames in place
+				virtual void Process(float* buffer, uint32_t frames) = 0;
+
+				//audio thread, or any thread while nothing is processing: forgets any tail still ringing
+				virtual void Reset() = 0;
+
+				//any thread: a bypassed effect passes its input through untouched and keeps its state frozen
+				void SetBypass(bool bypass) { bypassed.store(bypass, std::memory_order_relaxed); }
+				bool IsBypassed() const { return bypassed.load(std::memory_order_relaxed); }
+
+			private:
+				std::atomic<bool> bypassed;
+		};
+
+		//effects run one after another on the same block, in the order they were added
+		//the chain doesn't own its effects; while the chain is attached to something that's processing, only bypass may change
+		class EffectChain
+		{
+			public:
+				static const uint32_t MAX_EFFECTS = 16;
+
+				EffectChain();
+
+				EffectChain(const EffectChain&) = delete;
+				EffectChain& operator=(const EffectChain&) = delete;
+
+				//only while nothing is processing; an effect added to a configured chain is configured to match
+				//returns false once MAX_EFFECTS are in the chain
+				bool Add(Effect* effect);
+				void Clear();
+
+				//only while nothing is processing: configures every effect in the chain
+				void Configure(uint32_t sample_rate, uint16_t channels);
+
+				//audio thread
+				void Process(float* buffer, uint32_t frames);
+				void Reset();
+
+				uint32_t GetEffectCount() const;
+				Effect* GetEffect(uint32_t index) const;
+
+				//0 until the chain has been configured
+				uint32_t GetSampleRate() const;
+				uint16_t GetChannelCount() const;
+
+			private:
+				Effect* effects[MAX_EFFECTS];
+				uint32_t count;
+
+				uint32_t sample_rate;
+				uint16_t channel_count;
+		};
+
+	}
+}
+
+#endif // EFFECT_HPP
@@ -0,0 +1,211 @@
+#include "Envelope.hpp"
+#include "AudioKernels.hpp"
+#include <cmath>
+
+namespace geiger {
+	namespace midi {
+
+		//how far past its goal each exponential segment aims, as a fraction of full scale, so it gets there in finite time
+		//the attack aims well past 1 for a nearly straight rise; decay and release aim 80 dB under their goal
+		static const float ATTACK_OVERSHOOT = 0.3f;
+		static const float DECAY_OVERSHOOT = 0.0001f;
+
+		static const Envelope::Settings DEFAULT_SETTINGS = {0.002f, 0.0f, 1.0f, 0.01f, Envelope::LINEAR};
+
+		//the coefficient that takes a capacitor-style segment from 0 to 1 (or back) in 'samples' steps
+		static float SegmentCoefficient(float samples, float overshoot) {
+			return std::exp(-std::log((1.0f + overshoot) / overshoot) / samples);
+		}
+
+		bool Envelope::Settings::operator==(const Settings& other) const {
+			return attack == other.attack && decay == other.decay && sustain == other.sustain && release == other.release && mode == other.mode;
+		}
+
+		Envelope::Envelope() : Envelope(DEFAULT_SETTINGS) {
+		}
+
+		Envelope::Envelope(const Settings& settings_) {
+			rate = 44100;
+			stage = IDLE;
+			level = 0.0f;
+			release_step = 0.0f;
+
+			SetSettings(settings_);
+		}
+
+		void Envelope::SetSettings(const Settings& settings_) {
+			settings = settings_;
+			settings.attack = (settings.attack > 0.0f) ? settings.attack : 0.0f;
+			settings.decay = (settings.decay > 0.0f) ? settings.decay : 0.0f;
+			settings.release = (settings.release > 0.0f) ? settings.release : 0.0f;
+			settings.sustain = (settings.sustain > 0.0f) ? ((settings.sustain < 1.0f) ? settings.sustain : 1.0f) : 0.0f;
+
+			Prepare();
+		}
+
+		const Envelope::Settings& Envelope::GetSettings() const {
+			return settings;
+		}
+
+		void Envelope::SetSampleRate(uint32_t sample_rate) {
+			if(sample_rate == 0) {
+				return;
+			}
+
+			rate = sample_rate;
+			Prepare();
+		}
+
+		void Envelope::NoteOn() {
+			stage = ATTACK;
+		}
+
+		void Envelope::NoteOff() {
+			if(stage == IDLE) {
+				return;
+			}
+
+			stage = RELEASE;
+
+			//a straight release takes the set time from whatever level it starts at
+			release_step = (settings.release > 0.0f) ? level / (settings.release * rate) : level;
+		}
+
+		void Envelope::Reset() {
+			stage = IDLE;
+			level = 0.0f;
+		}
+
+		void Envelope::Prepare() {
+			float attack = settings.attack * rate;
+			float decay = settings.decay * rate;
+			float release = settings.release * rate;
+
+			attack_step = (attack > 0.0f) ? 1.0f / attack : 1.0f;
+			decay_step = (decay > 0.0f) ? (1.0f - settings.sustain) / decay : 1.0f;
+
+			attack_coefficient = (attack > 0.0f) ? SegmentCoefficient(attack, ATTACK_OVERSHOOT) : 0.0f;
+			attack_base = (1.0f + ATTACK_OVERSHOOT) * (1.0f - attack_coefficient);
+
+			decay_coefficient = (decay > 0.0f) ? SegmentCoefficient(decay, DECAY_OVERSHOOT) : 0.0f;
+			decay_base = (settings.sustain - DECAY_OVERSHOOT) * (1.0f - decay_coefficient);
+
+			release_coefficient = (release > 0.0f) ? SegmentCoefficient(release, DECAY_OVERSHOOT) : 0.0f;
+			release_base = -DECAY_OVERSHOOT * (1.0f - release_coefficient);
+
+			if(stage == RELEASE) {
+				release_step = (release > 0.0f) ? level / release : level;
+			}
+		}
+
+		uint32_t Envelope::RenderStage(float* gains, uint32_t frames) {
+			bool linear = (settings.mode == LINEAR);
+			uint32_t i = 0;
+
+			switch(stage) {
+				case IDLE:
+					for(; i < frames; i++) {
+						gains[i] = 0.0f;
+					}
+					break;
+
+				case SUSTAIN:
+					for(; i < frames; i++) {
+						gains[i] = level;
+					}
+					break;
+
+				case ATTACK:
+					if(settings.attack <= 0.0f) {
+						level = 1.0f;
+						stage = DECAY;
+						break;
+					}
+
+					while(i < frames) {
+						gains[i++] = level;
+						level = linear ? (level + attack_step) : (attack_base + level * attack_coefficient);
+
+						if(level >= 1.0f) {
+							level = 1.0f;
+							stage = DECAY;
+							break;
+						}
+					}
+					break;
+
+				case DECAY:
+					if(settings.decay <= 0.0f || level <= settings.sustain) {
+						level = settings.sustain;
+						stage = SUSTAIN;
+						break;
+					}
+
+					while(i < frames) {
+						gains[i++] = level;
+						level = linear ? (level - decay_step) : (decay_base + level * decay_coefficient);
+
+						if(level <= settings.sustain) {
+							level = settings.sustain;
+							stage = SUSTAIN;
+							break;
+						}
+					}
+					break;
+
+				case RELEASE:
+					if(settings.release <= 0.0f || level <= 0.0f) {
+						level = 0.0f;
+						stage = IDLE;
+						break;
+					}
+
+					while(i < frames) {
+						gains[i++] = level;
+						level = linear ? (level - release_step) : (release_base + level * release_coefficient);
+
+						if(level <= 0.0f) {
+							level = 0.0f;
+							stage = IDLE;
+							break;
+						}
+					}
+					break;
+			}
+
+			return i;
+		}
+
+		void Envelope::Render(float* gains, uint32_t frames) {
+			uint32_t done = 0;
+
+			while(done < frames) {
+				done += RenderStage(gains + done, frames - done);
+			}
+		}
+
+		bool Envelope::Apply(float* buffer, uint32_t frames) {
+			float gains[CHUNK];
+			uint32_t done = 0;
+
+			while(done < frames) {
+				uint32_t count = (frames - done < CHUNK) ? (frames - done) : CHUNK;
+
+				//a held note at full level needs nothing, and a held one below it is a plain scale
+				if(stage == SUSTAIN) {
+					if(level != 1.0f) {
+						ScaleBuffer(buffer + done, level, count);
+					}
+				} else {
+					Render(gains, count);
+					MultiplyBuffer(buffer + done, gains, count);
+				}
+
+				done += count;
+			}
+
+			return stage != IDLE;
+		}
+
+	}
+}
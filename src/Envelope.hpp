@@ -0,0 +1,107 @@
+#ifndef ENVELOPE_HPP
+#define ENVELOPE_HPP
+
+#include <cstdint>
+
+namespace geiger {
+	namespace midi {
+
+		//an attack, decay, sustain, release gain envelope, produced a block of gains at a time and applied with one vectorized multiply
+		//LINEAR segments are straight lines; EXPONENTIAL segments are the curves of a charging and discharging capacitor,
+		//each one a single multiply-add per sample (x = base + x * coefficient) instead of an exp() per sample
+		//an envelope belongs to whatever renders it: nothing here is safe to call from two threads at once
+		class Envelope
+		{
+			public:
+				enum MODE {
+					LINEAR = 0,
+					EXPONENTIAL
+				};
+
+				enum STAGE {
+					IDLE = 0,
+					ATTACK,
+					DECAY,
+					SUSTAIN,
+					RELEASE
+				};
+
+				//times in seconds and the sustain level from 0 to 1
+				struct Settings {
+					float attack;
+					float decay;
+					float sustain;
+					float release;
+					MODE mode;
+
+					bool operator==(const Settings& other) const;
+					bool operator!=(const Settings& other) const { return !(*this == other); }
+				};
+
+				Envelope();
+				explicit Envelope(const Settings& settings);
+
+				//the segment in progress keeps its current level and carries on at the new rate
+				void SetSettings(const Settings& settings);
+				const Settings& GetSettings() const;
+
+				void SetSampleRate(uint32_t sample_rate);
+				uint32_t GetSampleRate() const { return rate; }
+
+				//attacks from wherever the level is now, so retriggering a sounding note doesn't click
+				void NoteOn();
+
+				//releases from wherever the level is now
+				void NoteOff();
+
+				//silent and idle straight away
+				void Reset();
+
+				//writes the next 'frames' gains; once the release finishes the rest are zero and the envelope is idle
+				void Render(float* gains, uint32_t frames);
+
+				//multiplies the next 'frames' samples of 'buffer' by the envelope; returns false once it's idle, i.e. the
+				//release has finished and the owner can stop rendering altogether
+				bool Apply(float* buffer, uint32_t frames);
+
+				STAGE GetStage() const { return stage; }
+				bool IsActive() const { return stage != IDLE; }
+				bool IsReleased() const { return stage == RELEASE; }
+
+				//the gain the next sample starts from
+				float GetLevel() const { return level; }
+
+			private:
+				//gains worked out per call to Apply(); longer blocks are done in pieces
+				static const uint32_t CHUNK = 256;
+
+				//works the per-sample steps out from the settings and the rate
+				void Prepare();
+
+				//writes up to 'frames' gains of the current stage and returns how many, moving on when the stage ends
+				uint32_t RenderStage(float* gains, uint32_t frames);
+
+				Settings settings;
+				uint32_t rate;
+
+				STAGE stage;
+				float level;
+
+				//LINEAR: the change per sample in each stage; release is worked out from the level it starts at
+				float attack_step;
+				float decay_step;
+				float release_step;
+
+				//EXPONENTIAL: the multiply-add for each stage
+				float attack_coefficient;
+				float attack_base;
+				float decay_coefficient;
+				float decay_base;
+				float release_coefficient;
+				float release_base;
+		};
+
+	}
+}
+
+#endif // ENVELOPE_HPP
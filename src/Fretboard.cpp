@@ -0,0 +1,305 @@
+#include "Fretboard.hpp"
+#include "Tuning.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace geiger {
+	namespace midi {
+
+		//a note this close above an open string (about a sixth of a semitone) is played open rather than not at all
+		static const float OPEN_TOLERANCE = 1.01f;
+
+		//how many of each chord's cheapest voicings the sequence solver weighs against each other
+		static const uint32_t SEQUENCE_CANDIDATES = 32;
+
+		Fretboard::Fretboard() {
+			for(uint32_t i = 0; i < 128; i++) {
+				position_counts[i] = 0;
+			}
+		}
+
+		void Fretboard::Build(const float* wave_speeds, const float* open_lengths, const Tuning* tuning) {
+			float highest_fret = std::pow(2.0f, -(float)(MAX_FRETS) / 12.0f);
+
+			for(uint32_t note = 0; note < 128; note++) {
+				float frequency = tuning ? tuning->GetFrequency((uint8_t)(note)) : EqualTemperedFrequency((uint8_t)(note));
+				uint8_t count = 0;
+
+				for(uint32_t s = 0; s < STRING_COUNT; s++) {
+					float open = open_lengths[s];
+					float length = wave_speeds[s] / (2.0f * frequency);
+
+					if(length > open * OPEN_TOLERANCE || length < open * highest_fret * 0.999f) {
+						continue;
+					}
+
+					length = (length < open) ? length : open;
+
+					Position& position = table[note][count++];
+					position.string = (uint8_t)(s);
+					position.fret = (uint8_t)(std::lround(12.0f * std::log2(open / length)));
+					position.length = length;
+				}
+
+				position_counts[note] = count;
+			}
+		}
+
+		uint32_t Fretboard::GetPositions(uint8_t note, const Position*& positions) const {
+			positions = table[note & 0x7F];
+			return position_counts[note & 0x7F];
+		}
+
+		bool Fretboard::FindPosition(uint8_t note, uint8_t hand, Position& position) const {
+			const Position* options = table[note & 0x7F];
+			uint32_t count = position_counts[note & 0x7F];
+			float best = 0.0f;
+
+			for(uint32_t i = 0; i < count; i++) {
+				//an open string needs no hand at all, and a fret already under the hand needs no move
+				float cost = (options[i].fret == 0) ? 0.0f : MoveCost(hand, MoveHand(hand, options[i].fret));
+				cost += 0.01f * options[i].fret;
+
+				if(i == 0 || cost < best) {
+					best = cost;
+					position = options[i];
+				}
+			}
+
+			return count > 0;
+		}
+
+		uint8_t Fretboard::MoveHand(uint8_t hand, uint8_t fret) {
+			if(fret == 0) {
+				return hand;
+			}
+
+			if(hand == 0 || fret < hand) {
+				return fret;
+			}
+
+			//the hand covers four frets from where the index finger sits
+			if(fret > hand + 3) {
+				return fret - 3;
+			}
+
+			return hand;
+		}
+
+		bool Fretboard::FindPositionOnString(uint8_t note, uint32_t string_, Position& position) const {
+			const Position* options = table[note & 0x7F];
+			uint32_t count = position_counts[note & 0x7F];
+
+			for(uint32_t i = 0; i < count; i++) {
+				if(options[i].string == string_) {
+					position = options[i];
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		bool Fretboard::VoiceChord(const uint8_t* notes, uint32_t count, uint8_t hand, Voicing& voicing) const {
+			std::vector<Voicing> voicings;
+			EnumerateVoicings(notes, count, voicings, 0);
+
+			float best = 0.0f;
+
+			for(size_t i = 0; i < voicings.size(); i++) {
+				float cost = StaticCost(voicings[i]) + MoveCost(hand, voicings[i].hand);
+
+				if(i == 0 || cost < best) {
+					best = cost;
+					voicing = voicings[i];
+				}
+			}
+
+			return !voicings.empty();
+		}
+
+		std::vector<Fretboard::Voicing> Fretboard::VoiceSequence(const std::vector<std::vector<uint8_t>>& chords) const {
+			Voicing silent;
+			silent.count = 0;
+			silent.hand = 0;
+
+			std::vector<Voicing> result(chords.size(), silent);
+
+			//per playable chord: its candidates, their best total cost so far, and which candidate of the previous playable chord that came from
+			std::vector<size_t> steps;
+			std::vector<std::vector<Voicing>> candidates;
+			std::vector<std::vector<uint32_t>> back;
+			std::vector<float> previous_costs;
+			std::vector<float> costs;
+
+			for(size_t t = 0; t < chords.size(); t++) {
+				std::vector<Voicing> options;
+
+				if(!chords[t].empty()) {
+					EnumerateVoicings(chords[t].data(), (uint32_t)(chords[t].size()), options, SEQUENCE_CANDIDATES);
+				}
+
+				//a rest or an unplayable chord leaves the hand where it was
+				if(options.empty()) {
+					continue;
+				}
+
+				costs.assign(options.size(), 0.0f);
+				back.emplace_back(options.size(), 0);
+
+				for(size_t j = 0; j < options.size(); j++) {
+					float best = 0.0f;
+					uint32_t from = 0;
+
+					for(size_t i = 0; i < previous_costs.size(); i++) {
+						float cost = previous_costs[i] + MoveCost(candidates.back()[i].hand, options[j].hand);
+
+						if(i == 0 || cost < best) {
+							best = cost;
+							from = (uint32_t)(i);
+						}
+					}
+
+					costs[j] = best + StaticCost(options[j]);
+					back.back()[j] = from;
+				}
+
+				steps.push_back(t);
+				candidates.push_back(std::move(options));
+				previous_costs.swap(costs);
+			}
+
+			if(steps.empty()) {
+				return result;
+			}
+
+			uint32_t pick = (uint32_t)(std::min_element(previous_costs.begin(), previous_costs.end()) - previous_costs.begin());
+
+			for(size_t k = steps.size(); k-- > 0; ) {
+				result[steps[k]] = candidates[k][pick];
+				pick = back[k][pick];
+			}
+
+			return result;
+		}
+
+		void Fretboard::EnumerateVoicings(const uint8_t* notes, uint32_t count, std::vector<Voicing>& voicings, uint32_t limit) const {
+			voicings.clear();
+
+			if(count == 0 || count > STRING_COUNT) {
+				return;
+			}
+
+			//the most constrained notes go first, so dead ends are found early
+			uint8_t order[STRING_COUNT];
+
+			for(uint32_t i = 0; i < count; i++) {
+				order[i] = notes[i] & 0x7F;
+
+				if(position_counts[order[i]] == 0) {
+					return;
+				}
+			}
+
+			std::sort(order, order + count, [this](uint8_t a, uint8_t b) {
+				return position_counts[a] < position_counts[b];
+			});
+
+			struct Frame {
+				uint32_t option;
+				uint32_t used;
+			};
+
+			Frame stack[STRING_COUNT];
+			Voicing current;
+			current.count = (uint8_t)(count);
+
+			uint32_t depth = 0;
+			stack[0] = {0, 0};
+
+			//depth-first over one position per note, never reusing a string and never stretching past MAX_SPAN
+			while(true) {
+				Frame& frame = stack[depth];
+				const Position* options = table[order[depth]];
+
+				if(frame.option == position_counts[order[depth]]) {
+					if(depth == 0) {
+						break;
+					}
+
+					depth--;
+					stack[depth].option++;
+					continue;
+				}
+
+				const Position& position = options[frame.option];
+
+				if(frame.used & (1u << position.string)) {
+					frame.option++;
+					continue;
+				}
+
+				current.positions[depth] = position;
+				current.notes[depth] = order[depth];
+
+				uint8_t low = 0xFF;
+				uint8_t high = 0;
+
+				for(uint32_t i = 0; i <= depth; i++) {
+					uint8_t fret = current.positions[i].fret;
+
+					if(fret > 0) {
+						low = (fret < low) ? fret : low;
+						high = (fret > high) ? fret : high;
+					}
+				}
+
+				if(low != 0xFF && (uint32_t)(high - low) > MAX_SPAN) {
+					frame.option++;
+					continue;
+				}
+
+				if(depth + 1 == count) {
+					current.hand = (low == 0xFF) ? 0 : low;
+					voicings.push_back(current);
+					frame.option++;
+					continue;
+				}
+
+				stack[depth + 1] = {0, frame.used | (1u << position.string)};
+				depth++;
+			}
+
+			std::stable_sort(voicings.begin(), voicings.end(), [](const Voicing& a, const Voicing& b) {
+				return StaticCost(a) < StaticCost(b);
+			});
+
+			if(limit > 0 && voicings.size() > limit) {
+				voicings.resize(limit);
+			}
+		}
+
+		float Fretboard::StaticCost(const Voicing& voicing) {
+			uint8_t low = 0xFF;
+			uint8_t high = 0;
+
+			for(uint32_t i = 0; i < voicing.count; i++) {
+				uint8_t fret = voicing.positions[i].fret;
+
+				if(fret > 0) {
+					low = (fret < low) ? fret : low;
+					high = (fret > high) ? fret : high;
+				}
+			}
+
+			//a wide stretch is harder than a move, and lower positions are easier to reach than high ones
+			float span = (low == 0xFF) ? 0.0f : (float)(high - low);
+			return 1.5f * span + 0.1f * voicing.hand;
+		}
+
+		float Fretboard::MoveCost(uint8_t from, uint8_t to) {
+			return (float)((from > to) ? (from - to) : (to - from));
+		}
+
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef FRETBOARD_HPP
+#define FRETBOARD_HPP
+
+#include <cstdint>
+#include <vector>
+
+namespace geiger {
+	namespace midi {
+
+		class Tuning;
+
+		//where every MIDI note can be played on a six-string neck, worked out once whenever the strings change
+		//so fretting a note is a table lookup; strings are numbered from 0, the highest
+		//on top of the table, a voicing solver picks which strings play a chord so the fretting hand moves as little as possible
+		class Fretboard
+		{
+			public:
+				static const uint32_t STRING_COUNT = 6;
+				static const uint32_t MAX_FRETS = 24;
+
+				//the widest stretch between the lowest and highest fretted notes of a voicing
+				static const uint32_t MAX_SPAN = 4;
+
+				struct Position {
+					uint8_t string;
+					uint8_t fret;
+					float length;
+				};
+
+				struct Voicing {
+					Position positions[STRING_COUNT];
+					uint8_t notes[STRING_COUNT];
+					uint8_t count;
+
+					//the lowest fretted fret, where the index finger sits; 0 when every string is open
+					uint8_t hand;
+				};
+
+				Fretboard();
+
+				//'wave_speeds' and 'open_lengths' are per string; a note is playable on a string if its length there falls
+				//between the open length and the length at MAX_FRETS
+				void Build(const float* wave_speeds, const float* open_lengths, const Tuning* tuning = nullptr);
+
+				//the ways to play 'note', at most one per string, in string order
+				uint32_t GetPositions(uint8_t note, const Position*& positions) const;
+
+				//the position needing the least hand movement from 'hand', preferring lower frets on a tie; false if the note is out of reach
+				bool FindPosition(uint8_t note, uint8_t hand, Position& position) const;
+
+				//where the hand sits after fretting 'fret' from 'hand', moving only if the fret is out of its reach
+				static uint8_t MoveHand(uint8_t hand, uint8_t fret);
+
+				//the position of 'note' on one string; false if that string can't play it
+				bool FindPositionOnString(uint8_t note, uint32_t string_, Position& position) const;
+
+				//the cheapest playable voicing of 'count' notes starting from a hand at 'hand'; false if there's none
+				bool VoiceChord(const uint8_t* notes, uint32_t count, uint8_t hand, Voicing& voicing) const;
+
+				//voicings for a whole sequence of chords (single notes are one-note chords), minimising total hand movement
+				//across the sequence rather than chord by chord; unplayable or empty chords come back with a count of 0
+				std::vector<Voicing> VoiceSequence(const std::vector<std::vector<uint8_t>>& chords) const;
+
+			private:
+				//every playable voicing of the chord, cheapest first, at most 'limit' of them
+				void EnumerateVoicings(const uint8_t* notes, uint32_t count, std::vector<Voicing>& voicings, uint32_t limit) const;
+
+				static float StaticCost(const Voicing& voicing);
+				static float MoveCost(uint8_t from, uint8_t to);
+
+				Position table[128][STRING_COUNT];
+				uint8_t position_counts[128];
+		};
+
+	}
+}
+
+#endif // FRETBOARD_HPP
@@ -1,21 +1,25 @@
 #include "GuitarSynth.hpp"
+#include "AudioEngine.hpp"
+#include "AudioKernels.hpp"
+#include <iostream>
+#include <limits>
 
 namespace geiger {
 	namespace midi {
 
-		GuitarSynth::GuitarSynth() {
+		//a full strum of six strings stays near full scale
+		static const float GUITAR_STRING_GAIN = 1.0f / 6.0f;
+
+		GuitarSynth::GuitarSynth() : volume{1.0f} {
 			max_length = 0.6477f;
 			string_density = 0.002f;
 			damping_ratio = 1.5f;
-			max_amplitude = 1.0f;
-            time_elapsed = 0.0f;
-            volume = 1.0f;
+            samples_elapsed = 0;
 
 			for(uint32_t i = 0; i < 6; i++) {
 				strings[i].SetActiveLength(max_length);
 				strings[i].SetLinearDensity(string_density);
 				strings[i].SetDampingRatio(damping_ratio);
-				time_offsets[i] = 0.0f;
             }
 
 			strings[0].TuneToFrequency(329.63f);
@@ -25,31 +29,23 @@ namespace geiger {
 			strings[4].TuneToFrequency(110.00f);
             strings[5].TuneToFrequency(82.41f);
 
-
-            Strum();
-            this->max_amplitude = Value(0.0f) / volume;
-
-            for(uint32_t i = 0; i < 6; i++) {
-				strings[i].Silence();
-            }
+			hand_position = 0;
+			RebuildFretboard();
 
             paused = false;
             stopped = true;
 		}
 
-		GuitarSynth::GuitarSynth(float length_meters, float linear_density, float damping) {
+		GuitarSynth::GuitarSynth(float length_meters, float linear_density, float damping) : volume{1.0f} {
 			max_length = length_meters;
 			string_density = linear_density;
 			damping_ratio = damping;
-			max_amplitude = 1.0f;
-            volume = 1.0f;
-            time_elapsed = 0.0f;
+            samples_elapsed = 0;
 
 			for(uint32_t i = 0; i < 6; i++) {
 				strings[i].SetActiveLength(max_length);
 				strings[i].SetLinearDensity(string_density);
 				strings[i].SetDampingRatio(damping_ratio);
-				time_offsets[i] = 0.0f;
             }
 
 			strings[0].TuneToFrequency(329.63f);
@@ -59,12 +55,8 @@ namespace geiger {
 			strings[4].TuneToFrequency(110.00f);
             strings[5].TuneToFrequency(82.41f);
 
-            Strum();
-            this->max_amplitude = Value(0.0f) / volume;
-
-            for(uint32_t i = 0; i < 6; i++) {
-				strings[i].Silence();
-            }
+			hand_position = 0;
+			RebuildFretboard();
 
             paused = false;
             stopped = true;
@@ -82,6 +74,7 @@ namespace geiger {
 				strings[i].SetActiveLength(max_length);
 			}
 
+			RebuildFretboard();
 		}
 
 		void GuitarSynth::SetStringDensity(float linear_density) {
@@ -92,6 +85,7 @@ namespace geiger {
 				strings[i].SetLinearDensity(string_density);
 			}
 
+			RebuildFretboard();
 		}
 
 		void GuitarSynth::SetDampingRatio(float damp) {
@@ -104,6 +98,14 @@ namespace geiger {
 
 		}
 
+		void GuitarSynth::SetSilenceThreshold(float decibels) {
+
+			for(uint32_t i = 0; i < 6; i++) {
+				strings[i].SetSilenceThreshold(decibels);
+			}
+
+		}
+
 		float GuitarSynth::GetStringLength() const {
 			return max_length;
 		}
@@ -116,11 +118,15 @@ namespace geiger {
 			return damping_ratio;
 		}
 
+		float GuitarSynth::GetSilenceThreshold() const {
+			return strings[0].GetSilenceThreshold();
+		}
+
 		void GuitarSynth::Strum(float time_offset_seconds) {
+			uint64_t time = SampleTime(time_offset_seconds);
 
 			for(uint32_t i = 0; i < 6; i++) {
-				strings[i].Pluck(0.23f * max_length, 0.01f);
-				time_offsets[i] = time_elapsed + time_offset_seconds;
+				Send(SynthCommand::PLUCK, i, time, 0.23f * max_length, 0.01f);
 			}
 
 		}
@@ -132,8 +138,7 @@ namespace geiger {
 
 			uint32_t idx = string_-1;
 
-            strings[idx].Pluck(0.23f * max_length, 0.01f);
-            time_offsets[idx] = time_elapsed + time_offset_seconds;
+            Send(SynthCommand::PLUCK, idx, SampleTime(time_offset_seconds), 0.23f * max_length, 0.01f);
 
 		}
 
@@ -144,18 +149,28 @@ namespace geiger {
 
 			uint32_t idx = string_-1;
 
-			strings[idx].Silence();
+			Send(SynthCommand::SILENCE, idx, SampleTime(0.0f));
 		}
 
 		void GuitarSynth::FretString(Note n, uint32_t string_) {
+			int32_t note = NoteNumber(n);
+
+			if(note < 0) {
+				return;
+			}
+
+			FretString((uint8_t)(note), string_);
+		}
+
+		void GuitarSynth::FretString(uint8_t note_number, uint32_t string_) {
 			if(string_ > 6 || string_ == 0) {
 				return;
 			}
 
-			float length = GetLengthForNote(string_, n);
+			Fretboard::Position position;
 
-			if(length < max_length && length > 0.23 * max_length) {
-				strings[string_-1].SetActiveLength(length);
+			if(fretboard.FindPositionOnString(note_number, string_-1, position) && position.fret > 0) {
+				Send(SynthCommand::FRET, string_-1, SampleTime(0.0f), position.length);
 			}
 		}
 
@@ -164,10 +179,14 @@ namespace geiger {
 				return;
 			}
 
-			strings[string_-1].SetActiveLength(max_length);
+			Send(SynthCommand::OPEN, string_-1, SampleTime(0.0f));
 		}
 
 		float GuitarSynth::Value(float t) {
+			return volume.GetTarget() * Amplitude(t);
+		}
+
+		float GuitarSynth::Amplitude(float t) {
 
 			if(t < 0.0f) {
 				return 0.0f;
@@ -176,210 +195,270 @@ namespace geiger {
 			float total_amplitude = 0.0f;
 
 			for(uint32_t i = 0; i < 6; i++) {
-				float string_amp = (strings[i].Value(t - time_offsets[i]));
-				total_amplitude += string_amp;
+				total_amplitude += strings[i].Amplitude(t);
 			}
 
-			if(total_amplitude > max_amplitude) {
-				this->max_amplitude = total_amplitude;
-			}
-
-			float result = volume * (total_amplitude / this->max_amplitude);
-
-			return result;
+			return total_amplitude * GUITAR_STRING_GAIN;
 		}
 
 		SoundSample GuitarSynth::GenerateSample(uint32_t sample_rate, uint32_t duration_milliseconds, int32_t offset_milliseconds) {
-            SoundSample complete(sample_rate, duration_milliseconds);
+            SoundSample complete(sample_rate, duration_milliseconds, false);
 
-			float dt = 1.0f / (float)(sample_rate);
-			float offset_t = ((float)(sample_rate) / 1000.0f) * offset_milliseconds;
-			offset_t += (time_elapsed * 1000.0f);
+			//starts 'offset_milliseconds' further on from each string's pluck, as StringSynth does
+			if(offset_milliseconds > 0) {
+				uint64_t offset = ((uint64_t)(sample_rate) * offset_milliseconds) / 1000;
 
-			for(uint32_t i = 0; i < complete.buffer_length; i++) {
-				complete.audio_buffer[i] += Value(i*dt + time_elapsed);
+				for(uint32_t i = 0; i < 6; i++) {
+					strings[i].Skip(offset);
+				}
 			}
 
+			//renders the guitar's next stretch of output, so queued plucks land where they would have while playing
+			Render(complete.audio_buffer, complete.buffer_length, sample_rate);
+
+			complete.ApplyGain(volume.GetTarget());
+
             return complete;
 		}
 
 		void GuitarSynth::PlayNote(Note n) {
-			const int min_semitone = (2 * 12) + (int)(Note::E);
-			const int max_semitone = (5 * 12) + (int)(Note::B);
+			int32_t note = NoteNumber(n);
 
-			int semitone = (n.octave * 12) + (int)(n.note) + (int)(n.acc);
-
-			if(semitone < min_semitone || semitone > max_semitone) {
+			if(note < 0) {
 				return;
 			}
 
-			float length = 0.0f;
-			uint32_t string_ = 0;
+			PlayNote((uint8_t)(note));
+		}
 
-			for(uint32_t i = 1; i <= 6; i++) {
-				length = GetLengthForNote(i, n);
+		void GuitarSynth::PlayNote(uint8_t note_number) {
+			Fretboard::Position position;
 
-				if(length < max_length && length > 0.23 * max_length) {
-					string_ = i;
-					break;
-				}
+			if(!fretboard.FindPosition(note_number, hand_position, position)) {
+				return;
 			}
 
-			//sort of simulates holding down the string on a fret
-            strings[string_-1].SetActiveLength(length);
-            PluckString(string_);
+			Fretboard::Voicing voicing;
+			voicing.positions[0] = position;
+			voicing.notes[0] = note_number;
+			voicing.count = 1;
+			voicing.hand = Fretboard::MoveHand(hand_position, position.fret);
+
+			PlayVoicing(voicing);
 		}
 
 		void GuitarSynth::PlayChord(Chord c) {
-			const int min_semitone = (2 * 12) + (int)(Note::E);
-			const int max_semitone = (5 * 12) + (int)(Note::B);
+			uint8_t notes[Fretboard::STRING_COUNT];
 
-			for(const Note& n : c.notes) {
+			if(c.notes.empty() || c.notes.size() > Fretboard::STRING_COUNT) {
+				return;
+			}
 
-				int semitone = (n.octave * 12) + (int)(n.note) + (int)(n.acc);
+			for(uint32_t i = 0; i < c.notes.size(); i++) {
+				int32_t note = NoteNumber(c.notes[i]);
 
-				if(semitone < min_semitone || semitone > max_semitone || c.notes.size() > 6) {
+				if(note < 0) {
 					return;
 				}
+
+				notes[i] = (uint8_t)(note);
 			}
 
-			bool string_taken[6] = { false };
-			float lengths[6] = { 0.0f };
-			uint32_t string_indices[6] = { 0 };
-			uint32_t strings_used = 0;
+			Fretboard::Voicing voicing;
 
-			for(uint32_t i = 0; i < c.notes.size(); i++) {
+			if(fretboard.VoiceChord(notes, (uint32_t)(c.notes.size()), hand_position, voicing)) {
+				PlayVoicing(voicing);
+			}
+		}
 
-				Note n = c.notes[i];
+		void GuitarSynth::PlayVoicing(const Fretboard::Voicing& voicing) {
+			uint64_t time = SampleTime(0.0f);
 
-				for(uint32_t j = 1; j <= 6; j++) {
-					lengths[strings_used] = GetLengthForNote(j, n);
+			for(uint32_t i = 0; i < voicing.count; i++) {
+				const Fretboard::Position& position = voicing.positions[i];
 
-					if(lengths[strings_used] < max_length && lengths[strings_used] > 0.23 * max_length && !string_taken[j-1]) {
-						string_indices[strings_used] = j;
-						string_taken[j-1] = true;
-						strings_used++;
-						break;
-					}
+				//sort of simulates holding down the string on a fret
+				if(position.fret > 0) {
+					Send(SynthCommand::FRET, position.string, time, position.length);
+				} else {
+					Send(SynthCommand::OPEN, position.string, time);
 				}
 
-				if(strings_used <= i) {
-					return;
-				}
+				Send(SynthCommand::PLUCK, position.string, time, 0.23f * max_length, 0.01f);
 			}
 
-			for(uint32_t i = 0; i < strings_used; i++) {
-				uint32_t string_ = string_indices[i];
-
-				//sort of simulates holding down the string on a fret
-				strings[string_-1].SetActiveLength(lengths[i]);
-				PluckString(string_);
+			if(voicing.hand > 0) {
+				hand_position = voicing.hand;
 			}
 		}
 
+		const Fretboard& GuitarSynth::GetFretboard() const {
+			return fretboard;
+		}
+
 		void GuitarSynth::Pause() {
 			if(!stopped) {
-				SDL_PauseAudioDevice(device_ID, 1);
+				AudioEngine::Get().SetPaused(this, true);
 				paused = true;
 			}
 		}
 
 		void GuitarSynth::Unpause() {
 			if(!stopped) {
-				SDL_PauseAudioDevice(device_ID, 0);
+				AudioEngine::Get().SetPaused(this, false);
 				paused = false;
 			}
 		}
 
 		void GuitarSynth::Play() {
-			SDL_AudioSpec want;
-			want.freq = 44100;
-			want.format = AUDIO_F32SYS;
-			want.channels = 1;
-			want.samples = 8192;
-			want.callback = guitar_callback;
-			want.userdata = (void*)(this);
-
-			device_ID = SDL_OpenAudioDevice(NULL, 0, &want, &specification, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
-			SDL_PauseAudioDevice(device_ID, 0);
+			if(!stopped) {
+				return;
+			}
+
 			paused = false;
-			stopped = false;
+			stopped = !AudioEngine::Get().Add(this);
 		}
 
 		void GuitarSynth::Stop() {
-			SDL_PauseAudioDevice(device_ID, 1);
-			SDL_CloseAudioDevice(device_ID);
+			if(stopped) {
+				return;
+			}
+
+			AudioEngine::Get().Remove(this);
 			stopped = true;
 			paused = false;
 
+			//the engine no longer renders this guitar, so this thread can take over as the consumer
+			commands.Clear();
+
 			for(uint32_t i = 0; i < 6; i++) {
-				strings[i].Silence();
+				strings[i].HandleCommand({SynthCommand::SILENCE, 0, 0, 0.0f, 0.0f});
 			}
 
-			time_elapsed = 0.0f;
+			samples_elapsed = 0;
 		}
 
 		void GuitarSynth::SetVolume(float percent) {
-			if(percent >= 0.0f) {
-				volume = percent;
-			} else {
-				volume = -percent;
+			if(percent < 0.0f) {
+				percent = -percent;
 			}
 
+			volume.Set(percent);
+
 			for(uint32_t i = 0; i < 6; i++) {
-				strings[i].SetVolume(volume);
+				strings[i].SetVolume(percent);
 			}
 		}
 
 		float GuitarSynth::GetVolume() const {
-			return volume;
+			return volume.GetTarget();
 		}
 
-		float GuitarSynth::GetLengthForNote(uint32_t string_, Note n) {
+		void GuitarSynth::RebuildFretboard() {
+			float wave_speeds[Fretboard::STRING_COUNT];
+			float open_lengths[Fretboard::STRING_COUNT];
 
-			if(string_ > 6 || string_ == 0) {
-				return -1.0f;
+			for(uint32_t i = 0; i < Fretboard::STRING_COUNT; i++) {
+				wave_speeds[i] = strings[i].GetWaveSpeed();
+				open_lengths[i] = max_length;
 			}
 
-			float velocity = std::sqrt(strings[string_-1].GetTension() / string_density);
+			fretboard.Build(wave_speeds, open_lengths);
+		}
 
-			float desired_frequency = NoteToFrequency(n);
+		void GuitarSynth::Send(SynthCommand::TYPE type, uint32_t idx, uint64_t time, float value, float value2) {
+			if(!commands.Push({type, time, idx, value, value2})) {
+				std::cerr << "[GuitarSynth] Error queueing command\n\t";
+				std::cerr << "Reason: The command queue is full; nothing is draining it.\n\n";
+			}
+		}
 
-            return velocity / (2.0f * desired_frequency);
+		uint64_t GuitarSynth::SampleTime(float offset_seconds) const {
+			uint64_t now = samples_elapsed.load(std::memory_order_relaxed);
+
+			if(offset_seconds <= 0.0f) {
+				return now;
+			}
+
+			return now + (uint64_t)(offset_seconds * AudioEngine::Get().GetSampleRate() + 0.5f);
 		}
 
-		void guitar_callback(void* synth_, Uint8* stream_, int len_) {
-			GuitarSynth* synth = (GuitarSynth*)(synth_);
+		void GuitarSynth::ApplyCommands(uint64_t now) {
+			const SynthCommand* cmd;
 
-			float dt = 1.0f / (float)(synth->specification.freq);
+			//commands are applied in the order they were sent, so one stamped later than its successor holds it back
+			while((cmd = commands.Front()) != nullptr && cmd->time <= now) {
+				HandleCommand(*cmd);
+				commands.Pop();
+			}
+		}
 
-			if(synth->time_elapsed < 0.0f) {
-				dt = 0.0f;
+		void GuitarSynth::HandleCommand(const SynthCommand& cmd) {
+			if(cmd.target < 6) {
+				strings[cmd.target].HandleCommand(cmd);
 			}
+		}
 
-			if(synth->specification.format != AUDIO_F32SYS) {
-				if(synth->specification.format == AUDIO_S16SYS) {
-					uint16_t* stream = (uint16_t*)(stream_);
+		uint64_t GuitarSynth::NextCommandTime() const {
+			const SynthCommand* cmd = commands.Front();
 
-					len_ = len_ / 2;
+			return cmd ? cmd->time : std::numeric_limits<uint64_t>::max();
+		}
 
-					for(int i = 0; i < len_; i++) {
-						stream[i] = (int16_t)(synth->Value(synth->time_elapsed) * std::numeric_limits<int16_t>::max());
-						synth->time_elapsed += dt;
-					}
+		void GuitarSynth::Render(float* buffer, uint32_t frames, uint32_t sample_rate) {
+			uint64_t start = samples_elapsed.load(std::memory_order_relaxed);
 
-				}
+			for(uint32_t i = 0; i < frames; i++) {
+				buffer[i] = 0.0f;
 			}
 
-			float* stream = (float*)(stream_);
+			bool idle = (NextCommandTime() >= start + frames);
 
-			len_ = len_ / sizeof(float);
+			for(uint32_t i = 0; i < 6; i++) {
+				strings[i].BeginBlock();
+				idle = idle && strings[i].IsSilent();
+			}
 
-			for(int i = 0; i < len_; i++) {
-				stream[i] = synth->Value(synth->time_elapsed);
-				synth->time_elapsed += dt;
+			//nothing plucked and nothing due: the block is silence
+			if(idle) {
+				samples_elapsed.store(start + frames, std::memory_order_relaxed);
+				return;
 			}
 
+			uint32_t done = 0;
+
+			//each string keeps its own sample count since its pluck, so a pluck only has to land on the right sample
+			while(done < frames) {
+				ApplyCommands(start + done);
+
+				uint32_t span = frames - done;
+				uint64_t next = NextCommandTime();
+
+				if(next - start - done < span) {
+					span = (uint32_t)(next - start - done);
+				}
+
+				for(uint32_t i = 0; i < 6; i++) {
+					strings[i].RenderAmplitude(buffer + done, span, sample_rate);
+				}
+
+				done += span;
+			}
+
+			ScaleBuffer(buffer, GUITAR_STRING_GAIN, frames);
+
+			samples_elapsed.store(start + frames, std::memory_order_relaxed);
+		}
+
+		void GuitarSynth::RenderBlock(float* buffer, uint32_t frames, uint32_t sample_rate) {
+			Render(buffer, frames, sample_rate);
+
+			volume.BeginBlock(frames);
+
+			for(uint32_t i = 0; i < frames; i++) {
+				buffer[i] *= volume.Current();
+				volume.Advance();
+			}
 		}
 
 	}
@@ -3,14 +3,13 @@
 
 #include "Synth.hpp"
 #include "StringSynth.hpp"
-
-#define NO_STDIO_REDIRECT
-
-#include "SDL2/SDL.h"
+#include "CommandQueue.hpp"
+#include "Fretboard.hpp"
 
 namespace geiger {
 	namespace midi {
 
+		//strum, pluck, fret and stop calls only queue a command; the audio thread applies it at its exact sample
 		class GuitarSynth : public Synth
 		{
 			public:
@@ -21,24 +20,40 @@ namespace geiger {
 				void SetStringLength(float length_meters);
 				void SetStringDensity(float linear_density);
 				void SetDampingRatio(float damp);
+				void SetSilenceThreshold(float decibels);
 
 				float GetStringLength() const;
 				float GetStringDensity() const;
 				float GetDampingRatio() const;
+				float GetSilenceThreshold() const;
 
 				void Strum(float time_offset_seconds = 0.0f);
 				void PluckString(uint32_t string_, float time_offset_seconds = 0.0f);
 				void StopString(uint32_t string_);
 				void FretString(Note n, uint32_t string_);
+				void FretString(uint8_t note_number, uint32_t string_);
 				void OpenString(uint32_t string_);
 
 				virtual float Value(float t) override;
 
 				virtual SoundSample GenerateSample(uint32_t sample_rate, uint32_t duration_milliseconds, int32_t offset_milliseconds) override;
+				virtual void RenderBlock(float* buffer, uint32_t frames, uint32_t sample_rate) override;
+
+				//audio thread: PLUCK, SILENCE, FRET and OPEN with the string index (0 to 5) as the target
+				virtual void HandleCommand(const SynthCommand& cmd) override;
 
+				//notes from E2 up to the 24th fret of the high string, each on the string nearest where the hand last fretted
 				virtual void PlayNote(Note n) override;
+				virtual void PlayNote(uint8_t note_number) override;
+
+				//the chord's cheapest voicing from the current hand position; nothing plays if it can't be fretted
 				void PlayChord(Chord c);
 
+				//a voicing worked out ahead of time, e.g. by GetFretboard().VoiceSequence() over a whole part
+				void PlayVoicing(const Fretboard::Voicing& voicing);
+
+				const Fretboard& GetFretboard() const;
+
 				virtual void Pause() override;
 				virtual void Unpause() override;
 
@@ -49,13 +64,35 @@ namespace geiger {
 				virtual float GetVolume() const override;
 
 			private:
-				float GetLengthForNote(uint32_t string_, Note n);
+				//works out every note's positions again; called whenever the strings' length or density changes
+				void RebuildFretboard();
+
+				void Send(SynthCommand::TYPE type, uint32_t idx, uint64_t time, float value = 0.0f, float value2 = 0.0f);
+
+				//control thread: the sample number 'offset_seconds' from the start of the next block
+				uint64_t SampleTime(float offset_seconds) const;
+
+				//audio thread: applies every queued command due at or before sample 'now'
+				void ApplyCommands(uint64_t now);
+				uint64_t NextCommandTime() const;
+
+				//audio thread: the next 'frames' samples before volume, splitting at each queued command
+				void Render(float* buffer, uint32_t frames, uint32_t sample_rate);
+
+				//the output t seconds after the strings' last plucks, before volume is applied
+				float Amplitude(float t);
 
 				StringSynth strings[6];
-				float time_offsets[6];
-				float time_elapsed;
-				float volume;
-				float max_amplitude;
+				CommandQueue commands;
+
+				Fretboard fretboard;
+
+				//control thread: the fret under the index finger after the last note or chord, 0 if nothing is fretted
+				uint8_t hand_position;
+
+				//only the audio thread advances this; control threads read it to place new plucks
+				std::atomic<uint64_t> samples_elapsed;
+				SmoothedParameter volume;
 
 				float max_length;
 				float string_density;
@@ -63,17 +100,8 @@ namespace geiger {
 
 				bool paused;
 				bool stopped;
-
-				//std::atomic<bool> parameter_change;
-
-				SDL_AudioDeviceID device_ID;
-				SDL_AudioSpec specification;
-
-				friend void guitar_callback(void* synth_, Uint8* stream_, int len_);
 		};
 
-		void guitar_callback(void* synth_, Uint8* stream_, int len_);
-
 	}
 }
 
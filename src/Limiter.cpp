@@ -0,0 +1,167 @@
+#include "Limiter.hpp"
+#include "AudioKernels.hpp"
+#include "Synth.hpp"
+#include <cmath>
+
+namespace geiger {
+	namespace midi {
+
+		Limiter::Limiter() : gain{1.0f}, ceiling{DecibelsToAmplitude(-1.0f)}, release_time{0.1f}, channel_count{1} {
+			Reset();
+		}
+
+		void Limiter::SetGain(float decibels) {
+			gain.store(DecibelsToAmplitude(decibels), std::memory_order_relaxed);
+		}
+
+		void Limiter::SetCeiling(float decibels) {
+			//anything above full scale would let the output clip after all
+			if(decibels > 0.0f) {
+				decibels = 0.0f;
+			}
+
+			ceiling.store(DecibelsToAmplitude(decibels), std::memory_order_relaxed);
+		}
+
+		void Limiter::SetReleaseTime(float seconds) {
+			if(seconds <= 0.0f) {
+				return;
+			}
+
+			release_time.store(seconds, std::memory_order_relaxed);
+		}
+
+		float Limiter::GetGain() const {
+			return 20.0f * std::log10(gain.load(std::memory_order_relaxed));
+		}
+
+		float Limiter::GetCeiling() const {
+			return 20.0f * std::log10(ceiling.load(std::memory_order_relaxed));
+		}
+
+		float Limiter::GetReleaseTime() const {
+			return release_time.load(std::memory_order_relaxed);
+		}
+
+		void Limiter::SetChannelCount(uint16_t channels) {
+			channel_count = (channels > 0) ? ((channels < MAX_CHANNELS) ? channels : MAX_CHANNELS) : 1;
+			Reset();
+		}
+
+		uint16_t Limiter::GetChannelCount() const {
+			return channel_count;
+		}
+
+		uint32_t Limiter::GetLatency() const {
+			return (LOOKAHEAD_CHUNKS + 1) * CHUNK;
+		}
+
+		float Limiter::GetGainReduction() const {
+			return 20.0f * std::log10(current_gain);
+		}
+
+		void Limiter::Process(float* buffer, uint32_t frames, uint32_t sample_rate) {
+			uint32_t done = 0;
+
+			while(done < frames) {
+				uint32_t span = CHUNK - fill;
+
+				if(frames - done < span) {
+					span = frames - done;
+				}
+
+				float* samples = buffer + (size_t)(done) * channel_count;
+				uint32_t offset = fill * channel_count;
+
+				for(uint32_t i = 0; i < span * channel_count; i++) {
+					input[offset + i] = samples[i];
+					samples[i] = output[offset + i];
+				}
+
+				fill += span;
+				done += span;
+
+				if(fill == CHUNK) {
+					ProcessChunk(sample_rate);
+					fill = 0;
+				}
+			}
+		}
+
+		void Limiter::Reset() {
+			for(uint32_t i = 0; i < CHUNK * MAX_CHANNELS; i++) {
+				input[i] = 0.0f;
+				output[i] = 0.0f;
+			}
+
+			for(uint32_t c = 0; c < LOOKAHEAD_CHUNKS; c++) {
+				for(uint32_t i = 0; i < CHUNK * MAX_CHANNELS; i++) {
+					delay[c][i] = 0.0f;
+				}
+
+				targets[c] = 1.0f;
+			}
+
+			fill = 0;
+			oldest = 0;
+			current_gain = 1.0f;
+		}
+
+		void Limiter::ProcessChunk(uint32_t sample_rate) {
+			float level = gain.load(std::memory_order_relaxed);
+			float limit = ceiling.load(std::memory_order_relaxed);
+
+			uint32_t samples = CHUNK * channel_count;
+
+			ScaleBuffer(input, level, samples);
+
+			float peak = BufferPeak(input, samples);
+			float target = (peak > limit) ? (limit / peak) : 1.0f;
+
+			//k = 0 is the chunk about to be played, k = LOOKAHEAD_CHUNKS the one just collected
+			float start = current_gain;
+			float end = start;
+			float lowest = target;
+			bool attacking = false;
+
+			for(uint32_t k = 0; k <= LOOKAHEAD_CHUNKS; k++) {
+				float t = (k < LOOKAHEAD_CHUNKS) ? targets[(oldest + k) % LOOKAHEAD_CHUNKS] : target;
+
+				lowest = (t < lowest) ? t : lowest;
+
+				//ramp down just steeply enough to reach each upcoming chunk's gain by the time it's played
+				if(k > 0 && t < start) {
+					float slope = start + (t - start) / (float)(k);
+					end = (slope < end) ? slope : end;
+					attacking = true;
+				}
+			}
+
+			//with nothing louder ahead, recover towards unity but never above what the lookahead allows
+			if(!attacking) {
+				float coefficient = 1.0f - std::exp(-(float)(CHUNK) / (release_time.load(std::memory_order_relaxed) * sample_rate));
+				end = start + (1.0f - start) * coefficient;
+				end = (lowest < end) ? lowest : end;
+			}
+
+			float* playing = delay[oldest];
+			float step = (end - start) / (float)(CHUNK);
+
+			for(uint32_t i = 0; i < CHUNK; i++) {
+				float g = start + step * (float)(i + 1);
+
+				for(uint16_t c = 0; c < channel_count; c++) {
+					uint32_t s = i * channel_count + c;
+
+					output[s] = playing[s] * g;
+					playing[s] = input[s];
+				}
+			}
+
+			targets[oldest] = target;
+			oldest = (oldest + 1) % LOOKAHEAD_CHUNKS;
+			current_gain = end;
+		}
+
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef LIMITER_HPP
+#define LIMITER_HPP
+
+#include "AudioKernels.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+namespace geiger {
+	namespace midi {
+
+		//the master bus stage: a fixed gain, then a lookahead peak limiter that holds the output under a ceiling
+		//the signal is delayed by GetLatency() samples so the gain is already down when a peak arrives
+		//the peak detector and gain ramp work on CHUNK-frame chunks, so the per-sample work is one multiply
+		//multichannel audio is interleaved and linked: every channel takes the gain of the loudest, so the image doesn't shift
+		class Limiter
+		{
+			public:
+				static const uint32_t CHUNK = 32;
+				static const uint32_t LOOKAHEAD_CHUNKS = 8;
+
+				Limiter();
+
+				Limiter(const Limiter&) = delete;
+				Limiter& operator=(const Limiter&) = delete;
+
+				//any thread: applied from the next chunk onwards
+				void SetGain(float decibels);
+				void SetCeiling(float decibels);
+				void SetReleaseTime(float seconds);
+
+				float GetGain() const;
+				float GetCeiling() const;
+				float GetReleaseTime() const;
+
+				//empties the delay line too, so only call it while nothing is processing
+				void SetChannelCount(uint16_t channels);
+				uint16_t GetChannelCount() const;
+
+				//frames between a sample going in and coming back out
+				uint32_t GetLatency() const;
+
+				//audio thread: how far the limiter is currently pulling the level down, in dB (0 or less)
+				float GetGainReduction() const;
+
+				//audio thread: limits 'frames' interleaved frames in place
+				void Process(float* buffer, uint32_t frames, uint32_t sample_rate);
+
+				//audio thread, or any thread while nothing is processing: empties the delay line
+				void Reset();
+
+			private:
+				void ProcessChunk(uint32_t sample_rate);
+
+				std::atomic<float> gain;
+				std::atomic<float> ceiling;
+				std::atomic<float> release_time;
+
+				uint16_t channel_count;
+
+				//the chunk being collected and the chunk being played out, 'fill' frames into each
+				float input[CHUNK * MAX_CHANNELS];
+				float output[CHUNK * MAX_CHANNELS];
+				uint32_t fill;
+
+				//the lookahead: chunks waiting to be played and the gain each one needs to stay under the ceiling
+				float delay[LOOKAHEAD_CHUNKS][CHUNK * MAX_CHANNELS];
+				float targets[LOOKAHEAD_CHUNKS];
+				uint32_t oldest;
+
+				float current_gain;
+		};
+
+	}
+}
+
+#endif // LIMITER_HPP
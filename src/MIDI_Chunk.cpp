@@ -8,6 +8,17 @@ namespace geiger
 		namespace detail
 		{
 
+			static byte MessageDataLength(byte status)
+			{
+				byte kind = status & 0xF0;
+
+				if(kind == 0xC0 || kind == 0xD0) {
+					return 1;
+				}
+
+				return 2;
+			}
+
 			MIDI_SysexEvent::MIDI_SysexEvent(byte t, MIDI_VLQ vlq, const byte* raw_data)
 			{
 				type = t;
@@ -168,7 +179,7 @@ namespace geiger
 				type = 0x70;
 			}
 
-			MIDI_Event::MIDI_Event(const byte* raw_data, bool running_status)
+			MIDI_Event::MIDI_Event(const byte* raw_data, byte running_status)
 			{
 				const byte* position = raw_data;
 				type = *position;
@@ -200,15 +211,23 @@ namespace geiger
 							{
 								byte MSB = *position;
 								position++;
-								byte LSB = *position;
-								position++;
 
 								data.midi_event.MSB = MSB;
-								data.midi_event.LSB = LSB;
+								data.midi_event.data_length = MessageDataLength(type);
 
-							} else if(running_status) {
+								if(data.midi_event.data_length == 2) {
+									data.midi_event.LSB = *position;
+									position++;
+								}
+
+							} else if(running_status >= 0x80 && running_status <= 0xEF) {
 								data.midi_event.MSB = type;
-								data.midi_event.LSB = *position;
+								data.midi_event.data_length = MessageDataLength(running_status);
+
+								if(data.midi_event.data_length == 2) {
+									data.midi_event.LSB = *position;
+								}
+
 								type = 0;
 							} else {
 								std::cerr << "[MIDI_Chunk] Error reading data into track message event\n\t";
@@ -414,10 +433,16 @@ namespace geiger
 							{
 								os.put((char)evt.type);
 								os.put((char)evt.data.midi_event.MSB);
-								os.put((char)evt.data.midi_event.LSB);
+
+								if(evt.data.midi_event.data_length == 2) {
+									os.put((char)evt.data.midi_event.LSB);
+								}
 							} else if(evt.type == 0) {
 								os.put((char)evt.data.midi_event.MSB);
-								os.put((char)evt.data.midi_event.LSB);
+
+								if(evt.data.midi_event.data_length == 2) {
+									os.put((char)evt.data.midi_event.LSB);
+								}
 							} else {
 								std::cerr << "[MIDI_Chunk] Error outputting MIDI_Event\n\t";
 								std::cerr << "Reason: Invalid event type.\n\n";
@@ -433,6 +458,7 @@ namespace geiger
 				//midi_event.type = 0;
 				midi_event.MSB = 0;
 				midi_event.LSB = 0;
+				midi_event.data_length = 2;
 			}
 
 			MIDI_Event::Event::~Event() {}
@@ -809,7 +835,7 @@ namespace geiger
 			} else if(IsTrack()) {
 
 				::new(&track) detail::MIDI_Track();
-				bool running_status = false;
+				byte running_status = 0;
 
 				while(position < (data + length)) {
 					MIDI_VLQ dt = MIDI_VLQ(position);
@@ -818,9 +844,11 @@ namespace geiger
 					detail::MIDI_Event evt(position, running_status);
 
 					if(evt.IsMidiEvent()) {
-                        running_status = true;
+						if(evt.type != 0) {
+							running_status = evt.type;
+						}
 					} else {
-						running_status = false;
+						running_status = 0;
 					}
 
 					position += evt.Length();
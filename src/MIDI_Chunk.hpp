@@ -32,8 +32,11 @@ namespace geiger {
                 byte MSB;
                 byte LSB;
 
+                //program change and channel pressure only carry one data byte
+                byte data_length;
+
                 inline uint32_t Length() const {
-                	return sizeof(byte) * 2;
+                	return sizeof(byte) * data_length;
                 }
 			};
 
@@ -79,7 +82,7 @@ namespace geiger {
 				MIDI_Event();
 				MIDI_Event(const MIDI_Event& e);
 				MIDI_Event(MIDI_Event&& e);
-				MIDI_Event(const byte* data, bool running_status = false);
+				MIDI_Event(const byte* data, byte running_status = 0);
 				~MIDI_Event();
 
 				MIDI_Event& operator=(const MIDI_Event& e);
@@ -0,0 +1,169 @@
+#include "NoteCache.hpp"
+#include "BufferPool.hpp"
+#include <cstring>
+
+namespace geiger {
+	namespace midi {
+
+		bool NoteCache::Key::operator==(const Key& other) const {
+			return sample_rate == other.sample_rate && harmonics == other.harmonics && frequency == other.frequency &&
+			       damping_ratio == other.damping_ratio && pluck_position == other.pluck_position && silence_level == other.silence_level;
+		}
+
+		size_t NoteCache::KeyHash::operator()(const Key& key) const {
+			uint32_t words[6];
+
+			words[0] = key.sample_rate;
+			words[1] = key.harmonics;
+			std::memcpy(&words[2], &key.frequency, sizeof(float));
+			std::memcpy(&words[3], &key.damping_ratio, sizeof(float));
+			std::memcpy(&words[4], &key.pluck_position, sizeof(float));
+			std::memcpy(&words[5], &key.silence_level, sizeof(float));
+
+			//FNV-1a over the fields' bits
+			uint64_t hash = 14695981039346656037ull;
+
+			for(uint32_t i = 0; i < 6; i++) {
+				hash = (hash ^ words[i]) * 1099511628211ull;
+			}
+
+			return (size_t)(hash);
+		}
+
+		NoteCache::Entry::Entry(uint32_t frames_) {
+			frames = frames_;
+			complete = false;
+			samples = BufferPool::Get().Acquire(frames, capacity);
+
+			//the pool has already said why; an empty entry is never cached and voices play it live
+			if(!samples) {
+				frames = 0;
+				return;
+			}
+
+			std::memset(samples, 0, (size_t)(frames) * sizeof(float));
+		}
+
+		NoteCache::Entry::~Entry() {
+			BufferPool::Get().Release(samples, capacity);
+		}
+
+		NoteCache::NoteCache(size_t budget_bytes, float seconds) : size{0}, budget{budget_bytes}, max_seconds{2.0f}, hits{0}, misses{0} {
+			SetMaxSeconds(seconds);
+		}
+
+		void NoteCache::SetBudget(size_t budget_bytes) {
+			std::lock_guard<std::mutex> guard(lock);
+
+			budget.store(budget_bytes, std::memory_order_relaxed);
+			Evict();
+		}
+
+		size_t NoteCache::GetBudget() const {
+			return budget.load(std::memory_order_relaxed);
+		}
+
+		bool NoteCache::IsEnabled() const {
+			return budget.load(std::memory_order_relaxed) > 0;
+		}
+
+		void NoteCache::SetMaxSeconds(float seconds) {
+			if(seconds <= 0.0f) {
+				return;
+			}
+
+			max_seconds.store(seconds, std::memory_order_relaxed);
+		}
+
+		float NoteCache::GetMaxSeconds() const {
+			return max_seconds.load(std::memory_order_relaxed);
+		}
+
+		std::shared_ptr<const NoteCache::Entry> NoteCache::Find(const Key& key) {
+			std::lock_guard<std::mutex> guard(lock);
+
+			auto it = index.find(key);
+
+			if(it == index.end()) {
+				misses.fetch_add(1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			//move to the front without touching the entry itself
+			entries.splice(entries.begin(), entries, it->second);
+			hits.fetch_add(1, std::memory_order_relaxed);
+
+			return it->second->second;
+		}
+
+		std::shared_ptr<const NoteCache::Entry> NoteCache::Insert(const Key& key, std::shared_ptr<const Entry> entry) {
+			std::lock_guard<std::mutex> guard(lock);
+
+			auto it = index.find(key);
+
+			if(it != index.end()) {
+				entries.splice(entries.begin(), entries, it->second);
+				return it->second->second;
+			}
+
+			//an entry whose buffer couldn't be had is handed back as it is, so the next lookup misses and tries again
+			if(entry->frames == 0) {
+				return entry;
+			}
+
+			size_t bytes = (size_t)(entry->capacity) * sizeof(float);
+
+			//something bigger than the whole budget would only push everything else out and then itself
+			if(bytes > budget.load(std::memory_order_relaxed)) {
+				return entry;
+			}
+
+			entries.emplace_front(key, entry);
+			index[key] = entries.begin();
+			size += bytes;
+
+			Evict();
+
+			return entry;
+		}
+
+		void NoteCache::Clear() {
+			std::lock_guard<std::mutex> guard(lock);
+
+			index.clear();
+			entries.clear();
+			size = 0;
+		}
+
+		uint64_t NoteCache::GetHitCount() const {
+			return hits.load(std::memory_order_relaxed);
+		}
+
+		uint64_t NoteCache::GetMissCount() const {
+			return misses.load(std::memory_order_relaxed);
+		}
+
+		size_t NoteCache::GetSize() const {
+			std::lock_guard<std::mutex> guard(lock);
+			return size;
+		}
+
+		size_t NoteCache::GetEntryCount() const {
+			std::lock_guard<std::mutex> guard(lock);
+			return entries.size();
+		}
+
+		void NoteCache::Evict() {
+			size_t limit = budget.load(std::memory_order_relaxed);
+
+			while(size > limit && !entries.empty()) {
+				const auto& oldest = entries.back();
+
+				size -= (size_t)(oldest.second->capacity) * sizeof(float);
+				index.erase(oldest.first);
+				entries.pop_back();
+			}
+		}
+
+	}
+}
@@ -0,0 +1,107 @@
+#ifndef NOTECACHE_HPP
+#define NOTECACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace geiger {
+	namespace midi {
+
+		//renders of plucked notes shared between voices, so a part that repeats the same notes synthesizes each one once
+		//entries are kept least recently used first out until their buffers fit in the budget; a voice still playing
+		//an evicted entry keeps it alive until it lets go
+		//any thread; a miss means the caller renders the note, so NoteOn allocates and a cache has no place on the audio thread
+		class NoteCache
+		{
+			public:
+				//what SetBudget() gives with no argument: room for about a hundred two-second notes at 44.1 kHz
+				static const size_t DEFAULT_BUDGET = (size_t)(64) << 20;
+
+				//everything the string model's output depends on apart from velocity, which only scales it
+				struct Key {
+					uint32_t sample_rate;
+					uint32_t harmonics;
+					float frequency;
+					float damping_ratio;
+					float pluck_position;
+					float silence_level;
+
+					bool operator==(const Key& other) const;
+				};
+
+				//the first 'frames' samples of a note at unit velocity, in a buffer from the BufferPool
+				//'complete' means the note fell silent within them; otherwise a voice carries on with live synthesis
+				//'frames' is 0 if the pool couldn't supply a buffer
+				struct Entry {
+					float* samples;
+					uint32_t frames;
+					uint32_t capacity;
+					bool complete;
+
+					Entry(uint32_t frames);
+					~Entry();
+
+					Entry(const Entry&) = delete;
+					Entry& operator=(const Entry&) = delete;
+				};
+
+				//a budget of 0 turns the cache off
+				NoteCache(size_t budget_bytes = 0, float max_seconds = 2.0f);
+
+				NoteCache(const NoteCache&) = delete;
+				NoteCache& operator=(const NoteCache&) = delete;
+
+				void SetBudget(size_t budget_bytes = DEFAULT_BUDGET);
+				size_t GetBudget() const;
+				bool IsEnabled() const;
+
+				//how much of each note is cached; longer notes hand over to live synthesis after this
+				void SetMaxSeconds(float seconds);
+				float GetMaxSeconds() const;
+
+				//null on a miss
+				std::shared_ptr<const Entry> Find(const Key& key);
+
+				//returns the entry now cached for 'key', which is an earlier one if another thread got there first
+				std::shared_ptr<const Entry> Insert(const Key& key, std::shared_ptr<const Entry> entry);
+
+				void Clear();
+
+				uint64_t GetHitCount() const;
+				uint64_t GetMissCount() const;
+				size_t GetSize() const;
+				size_t GetEntryCount() const;
+
+			private:
+				struct KeyHash {
+					size_t operator()(const Key& key) const;
+				};
+
+				typedef std::list<std::pair<Key, std::shared_ptr<const Entry>>> EntryList;
+
+				//with the lock held
+				void Evict();
+
+				mutable std::mutex lock;
+
+				//most recently used at the front
+				EntryList entries;
+				std::unordered_map<Key, EntryList::iterator, KeyHash> index;
+				size_t size;
+
+				std::atomic<size_t> budget;
+				std::atomic<float> max_seconds;
+
+				std::atomic<uint64_t> hits;
+				std::atomic<uint64_t> misses;
+		};
+
+	}
+}
+
+#endif // NOTECACHE_HPP
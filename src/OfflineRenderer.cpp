@@ -0,0 +1,453 @@
+#include "OfflineRenderer.hpp"
+#include "AudioKernels.hpp"
+#include "Denormals.hpp"
+#include <algorithm>
+
+namespace geiger {
+	namespace midi {
+
+		//a channel at full CC7 volume plays at PolySynth's default level
+		static const float CHANNEL_HEADROOM = 0.5f;
+		static const uint32_t DEFAULT_TEMPO = 500000;
+
+		OfflineRenderer::OfflineRenderer(uint32_t sample_rate, uint32_t voices_per_channel, PolySynth::VoiceFactory factory) {
+			rate = (sample_rate > 0) ? sample_rate : 44100;
+			tail_milliseconds = 2000;
+			output_channels = 1;
+			effects = nullptr;
+
+			position = 0;
+			song_length = 0;
+			last_event = 0;
+
+			if(!factory) {
+				factory = [this] {
+					StringVoice* voice = new StringVoice();
+					voice->SetNoteCache(&note_cache);
+					return (Voice*)(voice);
+				};
+			}
+
+			channels.resize(CHANNEL_COUNT);
+
+			for(ChannelState& channel : channels) {
+				channel.synth = new PolySynth(voices_per_channel, factory, PolySynth::STEAL_QUIETEST);
+				channel.synth->SetSampleRate(rate);
+				channel.synth->SetVolume(CHANNEL_HEADROOM);
+				channel.next_event = 0;
+				channel.buffer.assign(SEGMENT_SIZE, 0.0f);
+				channel.rendered = false;
+			}
+		}
+
+		OfflineRenderer::~OfflineRenderer() {
+			pool.reset();
+
+			for(ChannelState& channel : channels) {
+				delete channel.synth;
+			}
+		}
+
+		bool OfflineRenderer::Load(const MIDI_Chunk& header, const std::vector<MIDI_Chunk>& tracks) {
+			if(!header.IsHeader()) {
+				std::cerr << "[OfflineRenderer] Error loading MIDI data\n\t";
+				std::cerr << "Reason: The first chunk is not a header chunk.\n\n";
+				return false;
+			}
+
+			const detail::MIDI_Header& head = header.GetHeader();
+
+			if(head.divisions == 0) {
+				std::cerr << "[OfflineRenderer] Error loading MIDI data\n\t";
+				std::cerr << "Reason: The header's division field is zero.\n\n";
+				return false;
+			}
+
+			struct TrackEvent {
+				uint64_t tick;
+				uint32_t tempo;
+				byte status;
+				byte data1;
+				byte data2;
+			};
+
+			std::vector<TrackEvent> merged;
+			uint64_t track_start = 0;
+
+			for(const MIDI_Chunk& chunk : tracks) {
+				if(!chunk.IsTrack()) {
+					continue;
+				}
+
+				uint64_t tick = track_start;
+				byte running_status = 0;
+
+				for(const detail::MIDI_Message& msg : chunk.GetTrack().data) {
+					const detail::MIDI_Event& evt = msg.event;
+					tick += (uint32_t)(msg.delta_ticks);
+
+					if(evt.IsMidiEvent()) {
+						if(evt.type != 0) {
+							running_status = evt.type;
+						}
+
+						if(running_status == 0) {
+							continue;
+						}
+
+						merged.push_back(TrackEvent{tick, 0, running_status, evt.data.midi_event.MSB, evt.data.midi_event.LSB});
+					} else if(evt.IsMetaEvent()) {
+						const detail::MIDI_MetaEvent& meta = evt.data.meta_event;
+
+						//set tempo, in microseconds per quarter note
+						if(meta.type == 0x51 && (uint32_t)(meta.length) >= 3) {
+							uint32_t tempo = ((uint32_t)(meta.data[0]) << 16) | ((uint32_t)(meta.data[1]) << 8) | meta.data[2];
+							merged.push_back(TrackEvent{tick, tempo, 0, 0, 0});
+						}
+					}
+				}
+
+				//format 2 files hold independent songs that play one after another
+				if(head.format == detail::MIDI_FORMAT::MULTI_TRACK_SEQNTL) {
+					track_start = tick;
+				}
+			}
+
+			//tracks were appended in order, so a stable sort keeps same-tick events in file order
+			std::stable_sort(merged.begin(), merged.end(), [](const TrackEvent& a, const TrackEvent& b) {
+				return a.tick < b.tick;
+			});
+
+			bool smpte = (head.divisions & 0x8000) != 0;
+			double seconds_per_tick;
+
+			if(smpte) {
+				//negative frames per second in the upper byte, ticks per frame in the lower
+				int fps = -(int8_t)(head.divisions >> 8);
+				double frames_per_second = (fps == 29) ? 29.97 : (double)(fps);
+				uint32_t ticks_per_frame = head.divisions & 0xFF;
+
+				if(fps <= 0 || ticks_per_frame == 0) {
+					std::cerr << "[OfflineRenderer] Error loading MIDI data\n\t";
+					std::cerr << "Reason: Invalid SMPTE division.\n\n";
+					return false;
+				}
+
+				seconds_per_tick = 1.0 / (frames_per_second * ticks_per_frame);
+			} else {
+				seconds_per_tick = (DEFAULT_TEMPO / 1000000.0) / head.divisions;
+			}
+
+			for(ChannelState& channel : channels) {
+				channel.events.clear();
+			}
+
+			last_event = 0;
+
+			uint64_t last_tick = 0;
+			double seconds = 0.0;
+
+			for(const TrackEvent& e : merged) {
+				seconds += (e.tick - last_tick) * seconds_per_tick;
+				last_tick = e.tick;
+
+				if(e.status == 0) {
+					if(!smpte) {
+						seconds_per_tick = (e.tempo / 1000000.0) / head.divisions;
+					}
+					continue;
+				}
+
+				uint64_t sample = (uint64_t)(seconds * rate + 0.5);
+				channels[e.status & 0x0F].events.push_back(ScheduledEvent{sample, e.status, e.data1, e.data2});
+				last_event = sample;
+			}
+
+			Rewind();
+
+			return true;
+		}
+
+		void OfflineRenderer::SetThreadCount(uint32_t thread_count) {
+			if(thread_count <= 1) {
+				pool.reset();
+			} else if(!pool || pool->GetThreadCount() != thread_count) {
+				pool.reset(new ThreadPool(thread_count));
+			}
+		}
+
+		uint32_t OfflineRenderer::GetThreadCount() const {
+			return pool ? pool->GetThreadCount() : 1;
+		}
+
+		void OfflineRenderer::SetTailMilliseconds(uint32_t tail) {
+			tail_milliseconds = tail;
+			Rewind();
+		}
+
+		void OfflineRenderer::SetOutputChannels(uint16_t count) {
+			output_channels = (count > 0) ? ((count < MAX_CHANNELS) ? count : MAX_CHANNELS) : 1;
+
+			if(effects) {
+				effects->Configure(rate, output_channels);
+			}
+		}
+
+		uint16_t OfflineRenderer::GetOutputChannels() const {
+			return output_channels;
+		}
+
+		void OfflineRenderer::SetNoteCacheBudget(size_t budget_bytes) {
+			note_cache.SetBudget(budget_bytes);
+		}
+
+		NoteCache& OfflineRenderer::GetNoteCache() {
+			return note_cache;
+		}
+
+		void OfflineRenderer::SetEffects(EffectChain* chain) {
+			effects = chain;
+
+			if(effects) {
+				effects->Configure(rate, output_channels);
+			}
+		}
+
+		void OfflineRenderer::SetTuning(const Tuning* tuning) {
+			for(ChannelState& channel : channels) {
+				channel.synth->SetTuning(tuning);
+			}
+		}
+
+		void OfflineRenderer::SetSilenceThreshold(float decibels) {
+			for(ChannelState& channel : channels) {
+				channel.synth->SetSilenceThreshold(decibels);
+			}
+		}
+
+		uint32_t OfflineRenderer::GetSampleRate() const {
+			return rate;
+		}
+
+		uint64_t OfflineRenderer::GetLengthInSamples() const {
+			return song_length;
+		}
+
+		uint64_t OfflineRenderer::GetPosition() const {
+			return position;
+		}
+
+		PolySynth& OfflineRenderer::GetChannel(uint8_t channel) {
+			return *channels[channel % CHANNEL_COUNT].synth;
+		}
+
+		void OfflineRenderer::Rewind() {
+			position = 0;
+			song_length = last_event + ((uint64_t)(rate) * tail_milliseconds) / 1000;
+
+			for(ChannelState& channel : channels) {
+				channel.next_event = 0;
+				channel.rendered = false;
+				channel.synth->AllSoundOff();
+				channel.synth->SetVolume(CHANNEL_HEADROOM);
+				channel.synth->SetPan(0.0f);
+			}
+
+			if(effects) {
+				effects->Reset();
+			}
+		}
+
+		uint32_t OfflineRenderer::RenderBlock(float* buffer, uint32_t frames) {
+			if(position >= song_length) {
+				return 0;
+			}
+
+			if(song_length - position < frames) {
+				frames = (uint32_t)(song_length - position);
+			}
+
+			for(uint32_t done = 0; done < frames; ) {
+				uint32_t count = (frames - done < SEGMENT_SIZE) ? (frames - done) : SEGMENT_SIZE;
+
+				for(ChannelState& channel : channels) {
+					if(pool) {
+						ChannelState* state = &channel;
+						pool->Submit([this, state, count] { RenderChannel(*state, count); });
+					} else {
+						RenderChannel(channel, count);
+					}
+				}
+
+				if(pool) {
+					pool->Wait();
+				}
+
+				//fixed channel order keeps the floating point sum identical for any thread count
+				float* out = buffer + (size_t)(done) * output_channels;
+				float gains[MAX_CHANNELS];
+
+				for(uint32_t i = 0; i < count * output_channels; i++) {
+					out[i] = 0.0f;
+				}
+
+				for(ChannelState& channel : channels) {
+					if(!channel.rendered) {
+						continue;
+					}
+
+					if(output_channels == 1) {
+						MixBuffer(out, channel.buffer.data(), count);
+					} else {
+						PanGains(channel.synth->GetPan(), output_channels, gains);
+						MixBufferPanned(out, output_channels, channel.buffer.data(), gains, count);
+					}
+				}
+
+				if(effects) {
+					effects->Process(out, count);
+				}
+
+				done += count;
+				position += count;
+			}
+
+			return frames;
+		}
+
+		SoundSample OfflineRenderer::Render() {
+			Rewind();
+
+			uint32_t duration = (uint32_t)((song_length * 1000 + rate - 1) / rate);
+			SoundSample sample{rate, duration, output_channels, true};
+
+			uint32_t frames = sample.GetFrameCount();
+			uint32_t written = 0;
+
+			while(written < frames) {
+				uint32_t count = RenderBlock(sample.audio_buffer + (size_t)(written) * output_channels, frames - written);
+
+				if(count == 0) {
+					break;
+				}
+
+				written += count;
+			}
+
+			return sample;
+		}
+
+		bool OfflineRenderer::RenderToStream(std::ostream& os) {
+			Rewind();
+
+			std::vector<float> block((size_t)(SEGMENT_SIZE) * output_channels);
+			uint32_t count;
+
+			while((count = RenderBlock(block.data(), SEGMENT_SIZE)) > 0) {
+				os.write((const char*)(block.data()), (size_t)(count) * output_channels * sizeof(float));
+
+				if(!os) {
+					std::cerr << "[OfflineRenderer] Error writing rendered audio\n\t";
+					std::cerr << "Reason: Output stream failure.\n\n";
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		bool OfflineRenderer::RenderToFile(const std::string& path, WavWriter::SAMPLE_FORMAT format) {
+			WavWriter writer;
+
+			if(!writer.Open(path, rate, output_channels, format)) {
+				return false;
+			}
+
+			Rewind();
+
+			std::vector<float> block((size_t)(SEGMENT_SIZE) * output_channels);
+			uint32_t count;
+
+			while((count = RenderBlock(block.data(), SEGMENT_SIZE)) > 0) {
+				if(!writer.Write(block.data(), count)) {
+					return false;
+				}
+			}
+
+			return writer.Close();
+		}
+
+		void OfflineRenderer::Dispatch(PolySynth* synth, const ScheduledEvent& evt) {
+			switch(evt.status & 0xF0) {
+				case 0x80: {
+					synth->NoteOff(evt.data1);
+					break;
+				}
+
+				case 0x90: {
+					//a note on with zero velocity is a note off
+					if(evt.data2 == 0) {
+						synth->NoteOff(evt.data1);
+					} else {
+						synth->NoteOn(evt.data1, evt.data2 / 127.0f);
+					}
+					break;
+				}
+
+				case 0xB0: {
+					if(evt.data1 == 7) {
+						synth->SetVolume(CHANNEL_HEADROOM * (evt.data2 / 127.0f));
+					} else if(evt.data1 == 10) {
+						synth->SetPan(ControllerToPan(evt.data2));
+					} else if(evt.data1 == 120) {
+						synth->AllSoundOff();
+					} else if(evt.data1 == 123) {
+						synth->AllNotesOff();
+					}
+					break;
+				}
+
+				default:
+					break;
+			}
+		}
+
+		void OfflineRenderer::RenderChannel(ChannelState& channel, uint32_t frames) {
+			//pool threads don't inherit the caller's floating point mode, so each task sets it
+			DenormalGuard guard;
+
+			uint64_t start = position;
+			uint64_t end = position + frames;
+
+			//a silent channel with nothing to play in this block costs nothing
+			bool has_events = channel.next_event < channel.events.size() && channel.events[channel.next_event].sample < end;
+
+			if(!has_events && channel.synth->GetActiveVoiceCount() == 0) {
+				channel.rendered = false;
+				return;
+			}
+
+			uint64_t now = start;
+
+			while(now < end) {
+				while(channel.next_event < channel.events.size() && channel.events[channel.next_event].sample <= now) {
+					Dispatch(channel.synth, channel.events[channel.next_event]);
+					channel.next_event++;
+				}
+
+				//render only up to the next event so it lands on its exact sample
+				uint64_t until = end;
+
+				if(channel.next_event < channel.events.size() && channel.events[channel.next_event].sample < until) {
+					until = channel.events[channel.next_event].sample;
+				}
+
+				channel.synth->RenderBlock(channel.buffer.data() + (now - start), (uint32_t)(until - now));
+				now = until;
+			}
+
+			channel.rendered = true;
+		}
+
+	}
+}
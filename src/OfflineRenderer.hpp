@@ -0,0 +1,119 @@
+#ifndef OFFLINERENDERER_HPP
+#define OFFLINERENDERER_HPP
+
+#include "MIDI_Chunk.hpp"
+#include "PolySynth.hpp"
+#include "NoteCache.hpp"
+#include "ThreadPool.hpp"
+#include "Effect.hpp"
+#include "WavWriter.hpp"
+
+namespace geiger {
+	namespace midi {
+
+		//renders a parsed MIDI file to audio as fast as the CPU allows
+		//each of the 16 MIDI channels plays on its own PolySynth, and every event
+		//is applied on the exact sample its tick maps to through the tempo map
+		//channels render independently (optionally on a thread pool) into their own buffers,
+		//which are then summed in channel order, so the output never depends on the thread count
+		class OfflineRenderer
+		{
+			public:
+				static const uint32_t CHANNEL_COUNT = 16;
+				static const uint32_t BLOCK_SIZE = 256;
+				static const uint32_t SEGMENT_SIZE = BLOCK_SIZE * 64;
+
+				OfflineRenderer(uint32_t sample_rate = 44100, uint32_t voices_per_channel = 16,
+				                PolySynth::VoiceFactory factory = PolySynth::VoiceFactory());
+				~OfflineRenderer();
+
+				OfflineRenderer(const OfflineRenderer&) = delete;
+				OfflineRenderer& operator=(const OfflineRenderer&) = delete;
+
+				bool Load(const MIDI_Chunk& header, const std::vector<MIDI_Chunk>& tracks);
+
+				//0 or 1 renders on the calling thread
+				void SetThreadCount(uint32_t thread_count);
+				uint32_t GetThreadCount() const;
+
+				void SetTailMilliseconds(uint32_t tail_milliseconds);
+
+				//interleaved channels in the output, 1 (the default) to MAX_CHANNELS
+				//each MIDI channel renders mono and is panned across them by its CC10
+				void SetOutputChannels(uint16_t output_channels);
+				uint16_t GetOutputChannels() const;
+
+				//the default voices play repeated notes back from a shared cache of this many bytes; 0 (the default) turns it off
+				//and no argument gives NoteCache::DEFAULT_BUDGET
+				//the cache stays filled between renders, and custom voice factories can hand their voices GetNoteCache() too
+				void SetNoteCacheBudget(size_t budget_bytes = NoteCache::DEFAULT_BUDGET);
+				NoteCache& GetNoteCache();
+
+				//run on the summed output of every channel, configured here for the renderer's rate and output channels
+				//the chain has to outlive the renderer or be replaced first; null takes the effects out
+				void SetEffects(EffectChain* chain);
+
+				//applied to every channel; the tuning has to outlive the renderer, and null is equal temperament
+				void SetTuning(const Tuning* tuning);
+
+				//applied to every channel; voices below it stop rendering
+				void SetSilenceThreshold(float decibels);
+				uint32_t GetSampleRate() const;
+				uint64_t GetLengthInSamples() const;
+				uint64_t GetPosition() const;
+
+				PolySynth& GetChannel(uint8_t channel);
+
+				void Rewind();
+
+				//renders up to 'frames' frames of the song into buffer, returning how many were written
+				//returns 0 once the song (and its tail) has been fully rendered
+				uint32_t RenderBlock(float* buffer, uint32_t frames);
+
+				SoundSample Render();
+
+				//writes raw interleaved 32-bit float samples in the machine's byte order
+				bool RenderToStream(std::ostream& os);
+
+				//streams the song into a WAV file one segment at a time, so memory use doesn't depend on its length
+				bool RenderToFile(const std::string& path, WavWriter::SAMPLE_FORMAT format = WavWriter::PCM_16);
+
+			private:
+				struct ScheduledEvent {
+					uint64_t sample;
+					byte status;
+					byte data1;
+					byte data2;
+				};
+
+				struct ChannelState {
+					PolySynth* synth;
+					std::vector<ScheduledEvent> events;
+					size_t next_event;
+
+					//this channel's share of the current block, only valid when 'rendered' is set
+					std::vector<float> buffer;
+					bool rendered;
+				};
+
+				void Dispatch(PolySynth* synth, const ScheduledEvent& evt);
+				void RenderChannel(ChannelState& channel, uint32_t frames);
+
+				NoteCache note_cache;
+				EffectChain* effects;
+				std::vector<ChannelState> channels;
+				std::unique_ptr<ThreadPool> pool;
+
+				uint64_t position;
+				uint64_t song_length;
+				uint64_t last_event;
+
+				uint32_t rate;
+				uint32_t tail_milliseconds;
+				uint16_t output_channels;
+		};
+
+	}
+}
+
+#endif // OFFLINERENDERER_HPP
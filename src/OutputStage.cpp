@@ -0,0 +1,185 @@
+#include "OutputStage.hpp"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEIGER_OUTPUT_SSE2
+#endif
+
+namespace geiger {
+	namespace midi {
+
+		//full scale for each integer format; INT_32 stops at the largest float below 2^31 so the conversion can't wrap
+		static const float INT16_SCALE = 32767.0f;
+		static const float INT32_SCALE = 2147483648.0f;
+		static const float INT32_LIMIT = 2147483520.0f;
+
+		static inline uint32_t NextNoise(uint32_t& state) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		//uniform in [-0.5, 0.5), from the top 23 bits of the generator
+		static inline float UniformNoise(uint32_t& state) {
+			uint32_t bits = (NextNoise(state) >> 9) | 0x3F800000u;
+			float f;
+			std::memcpy(&f, &bits, sizeof(f));
+			return f - 1.5f;
+		}
+
+		static inline float ClampSample(float x) {
+			//written so a NaN comes out as silence rather than full scale
+			return (x > -1.0f) ? ((x < 1.0f) ? x : 1.0f) : ((x <= -1.0f) ? -1.0f : 0.0f);
+		}
+
+#if defined(GEIGER_OUTPUT_SSE2)
+		static inline __m128 ClampSamples(__m128 v) {
+			//the ordered compare masks a NaN to zero first, matching ClampSample
+			v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+			return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+		}
+#endif
+
+		OutputStage::OutputStage() {
+			format = FLOAT_32;
+			channel_count = 1;
+			dither = true;
+
+			noise_state[0] = 0x9E3779B9u;
+			noise_state[1] = 0x85EBCA6Bu;
+			noise_state[2] = 0xC2B2AE35u;
+			noise_state[3] = 0x27D4EB2Fu;
+		}
+
+		void OutputStage::Configure(FORMAT format_, uint16_t channels) {
+			format = format_;
+			channel_count = (channels > 0) ? channels : 1;
+		}
+
+		void OutputStage::SetDither(bool enabled) {
+			dither.store(enabled, std::memory_order_relaxed);
+		}
+
+		bool OutputStage::GetDither() const {
+			return dither.load(std::memory_order_relaxed);
+		}
+
+		OutputStage::FORMAT OutputStage::GetFormat() const {
+			return format;
+		}
+
+		uint16_t OutputStage::GetChannelCount() const {
+			return channel_count;
+		}
+
+		uint32_t OutputStage::GetBytesPerSample() const {
+			return (format == INT_16) ? 2 : 4;
+		}
+
+		void OutputStage::Convert(const float* input, void* output, uint32_t frames) {
+			uint32_t samples = frames * channel_count;
+
+			//interleaving doesn't matter to a per-sample conversion, so every format runs over the whole block at once
+			switch(format) {
+				case INT_16:
+					ConvertInt16(input, (int16_t*)(output), samples);
+					break;
+
+				case INT_32:
+					ConvertInt32(input, (int32_t*)(output), samples);
+					break;
+
+				default:
+					ConvertFloat(input, (float*)(output), samples);
+					break;
+			}
+		}
+
+		void OutputStage::ConvertFloat(const float* input, float* output, uint32_t samples) {
+			uint32_t i = 0;
+
+#if defined(GEIGER_OUTPUT_SSE2)
+			for(; i + 4 <= samples; i += 4) {
+				_mm_storeu_ps(output + i, ClampSamples(_mm_loadu_ps(input + i)));
+			}
+#endif
+
+			for(; i < samples; i++) {
+				output[i] = ClampSample(input[i]);
+			}
+		}
+
+		void OutputStage::ConvertInt16(const float* input, int16_t* output, uint32_t samples) {
+			uint32_t i = 0;
+			bool dithered = dither.load(std::memory_order_relaxed);
+
+#if defined(GEIGER_OUTPUT_SSE2)
+			const __m128 scale = _mm_set1_ps(INT16_SCALE);
+			const __m128i one = _mm_set1_epi32(0x3F800000);
+			const __m128 offset = _mm_set1_ps(3.0f);
+
+			__m128i state = _mm_loadu_si128((const __m128i*)(noise_state));
+
+			//two uniform draws per sample sum to triangular noise of +-1 LSB; packs saturates anything the noise pushed past full scale
+			for(; i + 8 <= samples; i += 8) {
+				__m128i r[4];
+
+				for(uint32_t k = 0; k < 4; k++) {
+					state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+					state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+					state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+					r[k] = _mm_or_si128(_mm_srli_epi32(state, 9), one);
+				}
+
+				__m128 a = _mm_mul_ps(ClampSamples(_mm_loadu_ps(input + i)), scale);
+				__m128 b = _mm_mul_ps(ClampSamples(_mm_loadu_ps(input + i + 4)), scale);
+
+				if(dithered) {
+					a = _mm_add_ps(a, _mm_sub_ps(_mm_add_ps(_mm_castsi128_ps(r[0]), _mm_castsi128_ps(r[1])), offset));
+					b = _mm_add_ps(b, _mm_sub_ps(_mm_add_ps(_mm_castsi128_ps(r[2]), _mm_castsi128_ps(r[3])), offset));
+				}
+
+				__m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+				_mm_storeu_si128((__m128i*)(output + i), packed);
+			}
+
+			_mm_storeu_si128((__m128i*)(noise_state), state);
+#endif
+
+			for(; i < samples; i++) {
+				float v = ClampSample(input[i]) * INT16_SCALE;
+
+				if(dithered) {
+					v += UniformNoise(noise_state[0]) + UniformNoise(noise_state[0]);
+				}
+
+				long rounded = std::lrint(v);
+				output[i] = (int16_t)((rounded > 32767) ? 32767 : ((rounded < -32768) ? -32768 : rounded));
+			}
+		}
+
+		void OutputStage::ConvertInt32(const float* input, int32_t* output, uint32_t samples) {
+			uint32_t i = 0;
+
+			//a float only carries 24 bits, so its rounding error is already far below an INT_32 step and there's nothing to dither
+#if defined(GEIGER_OUTPUT_SSE2)
+			const __m128 scale = _mm_set1_ps(INT32_SCALE);
+			const __m128 limit = _mm_set1_ps(INT32_LIMIT);
+
+			for(; i + 4 <= samples; i += 4) {
+				__m128 v = _mm_mul_ps(ClampSamples(_mm_loadu_ps(input + i)), scale);
+				_mm_storeu_si128((__m128i*)(output + i), _mm_cvtps_epi32(_mm_min_ps(v, limit)));
+			}
+#endif
+
+			for(; i < samples; i++) {
+				float v = ClampSample(input[i]) * INT32_SCALE;
+				output[i] = (int32_t)(std::lrint((v < INT32_LIMIT) ? v : INT32_LIMIT));
+			}
+		}
+
+	}
+}
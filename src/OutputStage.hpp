@@ -0,0 +1,54 @@
+#ifndef OUTPUTSTAGE_HPP
+#define OUTPUTSTAGE_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace geiger {
+	namespace midi {
+
+		//the last step before the device: turns a block of interleaved float samples into the format the device asked for
+		//samples are clamped to full scale, and integer formats narrower than the float mantissa get TPDF dither
+		//so the rounding error becomes a constant noise floor instead of distortion that follows the signal
+		class OutputStage
+		{
+			public:
+				enum FORMAT {
+					FLOAT_32 = 0,
+					INT_16,
+					INT_32
+				};
+
+				OutputStage();
+
+				//audio thread, or any thread while nothing is converting
+				void Configure(FORMAT format, uint16_t channels);
+
+				//any thread: dither is on by default and only ever applies to INT_16
+				void SetDither(bool enabled);
+				bool GetDither() const;
+
+				FORMAT GetFormat() const;
+				uint16_t GetChannelCount() const;
+				uint32_t GetBytesPerSample() const;
+
+				//writes 'frames' interleaved frames to 'output'; with FLOAT_32, input and output may be the same buffer
+				void Convert(const float* input, void* output, uint32_t frames);
+
+			private:
+				void ConvertFloat(const float* input, float* output, uint32_t samples);
+				void ConvertInt16(const float* input, int16_t* output, uint32_t samples);
+				void ConvertInt32(const float* input, int32_t* output, uint32_t samples);
+
+				FORMAT format;
+				uint16_t channel_count;
+				std::atomic<bool> dither;
+
+				//xorshift generators for the dither, one per vector lane so the lanes don't correlate
+				uint32_t noise_state[4];
+		};
+
+	}
+}
+
+#endif // OUTPUTSTAGE_HPP
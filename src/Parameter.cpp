@@ -0,0 +1,78 @@
+#include "Parameter.hpp"
+#include "AudioKernels.hpp"
+
+namespace geiger {
+	namespace midi {
+
+		SmoothedParameter::SmoothedParameter(float initial) : target{initial} {
+			current = initial;
+			goal = initial;
+			step = 0.0f;
+			remaining = 0;
+		}
+
+		void SmoothedParameter::Set(float value) {
+			target.store(value, std::memory_order_relaxed);
+		}
+
+		float SmoothedParameter::GetTarget() const {
+			return target.load(std::memory_order_relaxed);
+		}
+
+		void SmoothedParameter::BeginBlock(uint32_t frames) {
+			goal = target.load(std::memory_order_relaxed);
+
+			if(frames == 0 || goal == current) {
+				current = goal;
+				step = 0.0f;
+				remaining = 0;
+				return;
+			}
+
+			step = (goal - current) / (float)(frames);
+			remaining = frames;
+		}
+
+		float SmoothedParameter::Current() const {
+			return current;
+		}
+
+		void SmoothedParameter::Advance() {
+			if(remaining == 0) {
+				return;
+			}
+
+			remaining--;
+
+			//land exactly on the target rather than accumulating rounding error
+			if(remaining == 0) {
+				current = goal;
+				step = 0.0f;
+			} else {
+				current += step;
+			}
+		}
+
+		void SmoothedParameter::Apply(float* buffer, uint32_t frames) {
+			goal = target.load(std::memory_order_relaxed);
+
+			if(goal == current) {
+				ScaleBuffer(buffer, current, frames);
+			} else {
+				RampBuffer(buffer, current, goal, frames);
+			}
+
+			current = goal;
+			step = 0.0f;
+			remaining = 0;
+		}
+
+		void SmoothedParameter::Snap() {
+			current = target.load(std::memory_order_relaxed);
+			goal = current;
+			step = 0.0f;
+			remaining = 0;
+		}
+
+	}
+}
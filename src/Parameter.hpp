@@ -0,0 +1,81 @@
+#ifndef PARAMETER_HPP
+#define PARAMETER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace geiger {
+	namespace midi {
+
+		//a scalar set from any thread and read by the audio thread without locking
+		//the audio thread ramps from the previous value to the new target across one block
+		class SmoothedParameter
+		{
+			public:
+				explicit SmoothedParameter(float initial = 0.0f);
+
+				void Set(float value);
+				float GetTarget() const;
+
+				//audio thread only
+				void BeginBlock(uint32_t frames);
+				float Current() const;
+				void Advance();
+				void Snap();
+
+				//audio thread: multiplies a block by the value, ramping to the target across it in one vectorized pass,
+				//in place of BeginBlock() and a Current() and Advance() per sample
+				void Apply(float* buffer, uint32_t frames);
+
+			private:
+				std::atomic<float> target;
+
+				float current;
+				float goal;
+				float step;
+				uint32_t remaining;
+		};
+
+		//a set of parameters handed from one control thread to the audio thread
+		//three copies rotate between the writer, the reader and a shared middle slot, so neither side ever waits
+		template<typename T>
+		class ParameterSnapshot
+		{
+			public:
+				explicit ParameterSnapshot(const T& initial = T()) : middle{1}, write_index{2}, read_index{0} {
+					for(int i = 0; i < 3; i++) {
+						buffers[i] = initial;
+					}
+				}
+
+				//control thread: makes 'value' the next snapshot the reader picks up
+				void Publish(const T& value) {
+					buffers[write_index] = value;
+					uint8_t previous = middle.exchange(write_index | FRESH, std::memory_order_acq_rel);
+					write_index = previous & INDEX_MASK;
+				}
+
+				//audio thread: returns the newest published snapshot, which stays valid until the next Acquire
+				const T& Acquire() {
+					if(middle.load(std::memory_order_relaxed) & FRESH) {
+						uint8_t previous = middle.exchange(read_index, std::memory_order_acq_rel);
+						read_index = previous & INDEX_MASK;
+					}
+
+					return buffers[read_index];
+				}
+
+			private:
+				static const uint8_t INDEX_MASK = 0x03;
+				static const uint8_t FRESH = 0x04;
+
+				T buffers[3];
+				std::atomic<uint8_t> middle;
+				uint8_t write_index;
+				uint8_t read_index;
+		};
+
+	}
+}
+
+#endif // PARAMETER_HPP
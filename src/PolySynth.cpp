@@ -0,0 +1,429 @@
+#include "PolySynth.hpp"
+#include "AudioEngine.hpp"
+#include "AudioKernels.hpp"
+#include <iostream>
+
+namespace geiger {
+	namespace midi {
+
+		PolySynth::PolySynth() : PolySynth(16) {}
+
+		PolySynth::PolySynth(uint32_t voice_count, VoiceFactory factory, STEAL_POLICY policy) : volume{0.5f}, silence_threshold{DEFAULT_SILENCE_THRESHOLD}, pan{0.0f}, tuning{nullptr} {
+			if(voice_count == 0) {
+				voice_count = 1;
+			}
+
+			steal_policy = policy;
+			note_counter = 0;
+			rate = 44100;
+			voice_silence_threshold = DEFAULT_SILENCE_THRESHOLD;
+
+			paused = false;
+			stopped = true;
+
+			slots.resize(voice_count);
+
+			for(VoiceSlot& slot : slots) {
+				slot.voice = factory ? factory() : new WaveVoice();
+				slot.voice->SetSampleRate(rate);
+				slot.voice->SetSilenceThreshold(voice_silence_threshold);
+				slot.started = 0;
+				slot.note = 0;
+				slot.held = false;
+			}
+		}
+
+		PolySynth::~PolySynth() {
+			Stop();
+
+			for(VoiceSlot& slot : slots) {
+				delete slot.voice;
+			}
+		}
+
+		void PolySynth::NoteOn(uint8_t note, float velocity) {
+			if(note > 127) {
+				return;
+			}
+
+			if(velocity <= 0.0f) {
+				NoteOff(note);
+				return;
+			}
+
+			if(!stopped) {
+				Send(SynthCommand::NOTE_ON, note, velocity);
+				return;
+			}
+
+			StartVoice(note, velocity);
+		}
+
+		void PolySynth::NoteOff(uint8_t note) {
+			if(!stopped) {
+				Send(SynthCommand::NOTE_OFF, note);
+				return;
+			}
+
+			ReleaseVoices(note);
+		}
+
+		void PolySynth::AllNotesOff() {
+			if(!stopped) {
+				Send(SynthCommand::ALL_NOTES_OFF);
+				return;
+			}
+
+			ReleaseAllVoices();
+		}
+
+		void PolySynth::AllSoundOff() {
+			if(!stopped) {
+				Send(SynthCommand::ALL_SOUND_OFF);
+				return;
+			}
+
+			KillAllVoices();
+		}
+
+		void PolySynth::StartVoice(uint8_t note, float velocity) {
+			VoiceSlot& slot = slots[FindVoice(note)];
+
+			const Tuning* table = tuning.load(std::memory_order_acquire);
+			float frequency = table ? table->GetFrequency(note) : EqualTemperedFrequency(note);
+
+			slot.voice->NoteOn(frequency, velocity);
+			slot.note = note;
+			slot.held = true;
+			slot.started = ++note_counter;
+		}
+
+		void PolySynth::ReleaseVoices(uint8_t note) {
+			for(VoiceSlot& slot : slots) {
+				if(slot.held && slot.note == note) {
+					slot.voice->NoteOff();
+					slot.held = false;
+				}
+			}
+		}
+
+		void PolySynth::ReleaseAllVoices() {
+			for(VoiceSlot& slot : slots) {
+				if(slot.held) {
+					slot.voice->NoteOff();
+					slot.held = false;
+				}
+			}
+		}
+
+		void PolySynth::KillAllVoices() {
+			for(VoiceSlot& slot : slots) {
+				slot.voice->Kill();
+				slot.held = false;
+			}
+		}
+
+		void PolySynth::SetStealPolicy(STEAL_POLICY policy) {
+			steal_policy = policy;
+		}
+
+		PolySynth::STEAL_POLICY PolySynth::GetStealPolicy() const {
+			return steal_policy;
+		}
+
+		void PolySynth::SetSilenceThreshold(float decibels) {
+			silence_threshold.store(decibels, std::memory_order_relaxed);
+		}
+
+		float PolySynth::GetSilenceThreshold() const {
+			return silence_threshold.load(std::memory_order_relaxed);
+		}
+
+		void PolySynth::SetPan(float p) {
+			p = (p < -1.0f) ? -1.0f : ((p > 1.0f) ? 1.0f : p);
+			pan.store(p, std::memory_order_relaxed);
+		}
+
+		float PolySynth::GetPan() const {
+			return pan.load(std::memory_order_relaxed);
+		}
+
+		void PolySynth::SetTuning(const Tuning* table) {
+			tuning.store(table, std::memory_order_release);
+		}
+
+		void PolySynth::SetSampleRate(uint32_t sample_rate) {
+			if(sample_rate == 0 || sample_rate == rate) {
+				return;
+			}
+
+			rate = sample_rate;
+
+			for(VoiceSlot& slot : slots) {
+				slot.voice->SetSampleRate(rate);
+			}
+		}
+
+		uint32_t PolySynth::GetSampleRate() const {
+			return rate;
+		}
+
+		uint32_t PolySynth::GetVoiceCount() const {
+			return (uint32_t)(slots.size());
+		}
+
+		uint32_t PolySynth::GetActiveVoiceCount() const {
+			uint32_t count = 0;
+
+			for(const VoiceSlot& slot : slots) {
+				if(slot.voice->IsActive()) {
+					count++;
+				}
+			}
+
+			return count;
+		}
+
+		void PolySynth::RenderBlock(float* buffer, uint32_t frames) {
+			for(uint32_t i = 0; i < frames; i++) {
+				buffer[i] = 0.0f;
+			}
+
+			float threshold = silence_threshold.load(std::memory_order_relaxed);
+
+			if(threshold != voice_silence_threshold) {
+				voice_silence_threshold = threshold;
+
+				for(VoiceSlot& slot : slots) {
+					slot.voice->SetSilenceThreshold(threshold);
+				}
+			}
+
+			bool sounding = false;
+
+			for(VoiceSlot& slot : slots) {
+				if(slot.voice->IsActive()) {
+					slot.voice->Render(buffer, frames);
+					sounding = true;
+				} else {
+					slot.held = false;
+				}
+			}
+
+			//an idle synth only has to write silence
+			if(!sounding) {
+				volume.Snap();
+				return;
+			}
+
+			//volume changes ramp across the block instead of jumping
+			volume.Apply(buffer, frames);
+		}
+
+		void PolySynth::RenderBlock(float* buffer, uint32_t frames, uint32_t sample_rate) {
+			ApplyCommands();
+			SetSampleRate(sample_rate);
+			RenderBlock(buffer, frames);
+		}
+
+		float PolySynth::Value(float t) {
+			if(t < 0.0f) {
+				return 0.0f;
+			}
+
+			float value;
+			RenderBlock(&value, 1);
+
+			return value;
+		}
+
+		SoundSample PolySynth::GenerateSample(uint32_t sample_rate, uint32_t duration_milliseconds, int32_t offset_milliseconds) {
+			SoundSample sample{sample_rate, duration_milliseconds, false};
+
+			if(sample.buffer_length == 0) {
+				return sample;
+			}
+
+			SetSampleRate(sample_rate);
+
+			//voices can't seek backwards, so a positive offset is rendered and thrown away
+			if(offset_milliseconds > 0) {
+				uint32_t skip = (uint32_t)(((uint64_t)(sample_rate) * offset_milliseconds) / 1000);
+
+				while(skip > 0) {
+					uint32_t frames = (skip < sample.buffer_length) ? skip : sample.buffer_length;
+					RenderBlock(sample.audio_buffer, frames);
+					skip -= frames;
+				}
+			}
+
+			RenderBlock(sample.audio_buffer, sample.buffer_length);
+
+			return sample;
+		}
+
+		void PolySynth::PlayNote(Note n) {
+			int32_t note = NoteNumber(n);
+
+			if(note < 0) {
+				return;
+			}
+
+			NoteOn((uint8_t)(note));
+		}
+
+		void PolySynth::PlayNote(uint8_t note_number) {
+			NoteOn(note_number);
+		}
+
+		void PolySynth::Pause() {
+			if(!stopped) {
+				AudioEngine::Get().SetPaused(this, true);
+				paused = true;
+			}
+		}
+
+		void PolySynth::Unpause() {
+			if(!stopped) {
+				AudioEngine::Get().SetPaused(this, false);
+				paused = false;
+			}
+		}
+
+		void PolySynth::Play() {
+			if(!stopped) {
+				return;
+			}
+
+			paused = false;
+			stopped = !AudioEngine::Get().Add(this);
+		}
+
+		void PolySynth::Stop() {
+			if(stopped) {
+				return;
+			}
+
+			AudioEngine::Get().Remove(this);
+			stopped = true;
+			paused = false;
+
+			//the engine no longer renders this synth, so this thread can take over as the consumer
+			commands.Clear();
+			KillAllVoices();
+		}
+
+		void PolySynth::SetVolume(float percent) {
+			if(percent >= 0.0f) {
+				volume.Set(percent);
+			} else {
+				volume.Set(-percent);
+			}
+		}
+
+		float PolySynth::GetVolume() const {
+			return volume.GetTarget();
+		}
+
+		uint32_t PolySynth::FindVoice(uint8_t note) {
+			uint32_t count = (uint32_t)(slots.size());
+
+			//retrigger a voice already sounding this note rather than doubling it
+			for(uint32_t i = 0; i < count; i++) {
+				if(slots[i].voice->IsActive() && slots[i].note == note) {
+					return i;
+				}
+			}
+
+			for(uint32_t i = 0; i < count; i++) {
+				if(!slots[i].voice->IsActive()) {
+					return i;
+				}
+			}
+
+			//every voice is busy: released voices are stolen before held ones
+			uint32_t best = 0;
+			bool best_released = false;
+
+			for(uint32_t i = 0; i < count; i++) {
+				bool released = !slots[i].held;
+
+				if(released != best_released) {
+					if(released) {
+						best = i;
+						best_released = true;
+					}
+					continue;
+				}
+
+				if(steal_policy == STEAL_QUIETEST) {
+					if(slots[i].voice->Level() < slots[best].voice->Level()) {
+						best = i;
+					}
+				} else if(slots[i].started < slots[best].started) {
+					best = i;
+				}
+			}
+
+			return best;
+		}
+
+		void PolySynth::Send(SynthCommand::TYPE type, uint8_t note, float velocity) {
+			if(!commands.Push({type, 0, note, velocity, 0.0f})) {
+				std::cerr << "[PolySynth] Error queueing command\n\t";
+				std::cerr << "Reason: The command queue is full; the audio engine isn't draining it.\n\n";
+			}
+		}
+
+		void PolySynth::ApplyCommands() {
+			SynthCommand cmd;
+
+			while(commands.Pop(cmd)) {
+				HandleCommand(cmd);
+			}
+		}
+
+		void PolySynth::HandleCommand(const SynthCommand& cmd) {
+			switch(cmd.type) {
+				case SynthCommand::NOTE_ON:
+					if(cmd.target <= 127) {
+						if(cmd.value > 0.0f) {
+							StartVoice((uint8_t)(cmd.target), cmd.value);
+						} else {
+							ReleaseVoices((uint8_t)(cmd.target));
+						}
+					}
+					break;
+
+				case SynthCommand::NOTE_OFF:
+					ReleaseVoices((uint8_t)(cmd.target));
+					break;
+
+				case SynthCommand::ALL_NOTES_OFF:
+					ReleaseAllVoices();
+					break;
+
+				case SynthCommand::ALL_SOUND_OFF:
+					KillAllVoices();
+					break;
+
+				case SynthCommand::CONTROL_CHANGE:
+					//channel volume, pan, all sound off and all notes off
+					if(cmd.target == 7) {
+						volume.Set(cmd.value / 127.0f);
+					} else if(cmd.target == 10) {
+						SetPan(ControllerToPan((uint8_t)(cmd.value)));
+					} else if(cmd.target == 120) {
+						KillAllVoices();
+					} else if(cmd.target == 123) {
+						ReleaseAllVoices();
+					}
+					break;
+
+				default:
+					break;
+			}
+		}
+
+	}
+}
@@ -0,0 +1,127 @@
+#ifndef POLYSYNTH_HPP
+#define POLYSYNTH_HPP
+
+#include "Synth.hpp"
+#include "Voice.hpp"
+#include "Parameter.hpp"
+#include "CommandQueue.hpp"
+
+#include <functional>
+
+namespace geiger {
+	namespace midi {
+
+		//a polyphonic instrument playing MIDI note numbers on a fixed pool of voices
+		//all voices are created in the constructor; note on/off and rendering never allocate
+		//while the synth is playing, note calls are queued and applied by the audio engine at the start of its next block
+		class PolySynth : public Synth
+		{
+			public:
+
+				enum STEAL_POLICY {
+					STEAL_OLDEST = 0,
+					STEAL_QUIETEST
+				};
+
+				typedef std::function<Voice*()> VoiceFactory;
+
+				PolySynth();
+				PolySynth(uint32_t voice_count, VoiceFactory factory = VoiceFactory(), STEAL_POLICY policy = STEAL_OLDEST);
+				virtual ~PolySynth();
+
+				PolySynth(const PolySynth&) = delete;
+				PolySynth& operator=(const PolySynth&) = delete;
+
+				void NoteOn(uint8_t note, float velocity = 1.0f);
+				void NoteOff(uint8_t note);
+				void AllNotesOff();
+				void AllSoundOff();
+
+				void SetStealPolicy(STEAL_POLICY policy);
+				STEAL_POLICY GetStealPolicy() const;
+
+				//voices that can no longer be heard above this level stop and cost nothing to render
+				void SetSilenceThreshold(float decibels);
+				float GetSilenceThreshold() const;
+
+				//-1 is hard left, 0 centre and 1 hard right; the voices render mono and the mix spreads them
+				void SetPan(float pan);
+
+				//pitches for note numbers; the tuning has to outlive the synth, and null (the default) is equal temperament
+				void SetTuning(const Tuning* tuning);
+				virtual float GetPan() const override;
+
+				void SetSampleRate(uint32_t sample_rate);
+				uint32_t GetSampleRate() const;
+
+				uint32_t GetVoiceCount() const;
+				uint32_t GetActiveVoiceCount() const;
+
+				//overwrites 'frames' samples of buffer with the mix of every active voice
+				void RenderBlock(float* buffer, uint32_t frames);
+
+				//the engine's entry point: applies queued note commands, then renders at the engine's rate
+				virtual void RenderBlock(float* buffer, uint32_t frames, uint32_t sample_rate) override;
+
+				//audio thread: note on/off, all notes/sound off, and controllers 7, 10, 120 and 123
+				virtual void HandleCommand(const SynthCommand& cmd) override;
+
+				//voices are stateful, so this renders the next sample; t is only checked for sign
+				virtual float Value(float t) override;
+
+				virtual SoundSample GenerateSample(uint32_t sample_rate, uint32_t duration_milliseconds, int32_t offset_milliseconds) override;
+
+				virtual void PlayNote(Note n) override;
+				virtual void PlayNote(uint8_t note_number) override;
+
+				virtual void Pause() override;
+				virtual void Unpause() override;
+
+				virtual void Play() override;
+				virtual void Stop() override;
+
+				virtual void SetVolume(float percent) override;
+				virtual float GetVolume() const override;
+
+			private:
+				struct VoiceSlot {
+					Voice* voice;
+					uint64_t started;
+					uint8_t note;
+					bool held;
+				};
+
+				uint32_t FindVoice(uint8_t note);
+
+				void StartVoice(uint8_t note, float velocity);
+				void ReleaseVoices(uint8_t note);
+				void ReleaseAllVoices();
+				void KillAllVoices();
+
+				void Send(SynthCommand::TYPE type, uint8_t note = 0, float velocity = 0.0f);
+
+				//audio thread: applies every queued note command
+				void ApplyCommands();
+
+				std::vector<VoiceSlot> slots;
+
+				STEAL_POLICY steal_policy;
+				uint64_t note_counter;
+				uint32_t rate;
+				SmoothedParameter volume;
+				CommandQueue commands;
+
+				//set from any thread; the render thread hands it to the voices when it changes
+				std::atomic<float> silence_threshold;
+				std::atomic<float> pan;
+				std::atomic<const Tuning*> tuning;
+				float voice_silence_threshold;
+
+				bool paused;
+				bool stopped;
+		};
+
+	}
+}
+
+#endif // POLYSYNTH_HPP
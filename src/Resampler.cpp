@@ -0,0 +1,257 @@
+#include "Resampler.hpp"
+#include "AudioKernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace geiger {
+	namespace midi {
+
+		struct QualityTier {
+			uint32_t taps;
+			uint32_t phases;
+			double passband;
+			double beta;
+		};
+
+		//taps at unity ratio; downsampling widens the filter by the ratio so the cutoff can drop below the new Nyquist
+		static const QualityTier QUALITY_TIERS[] = {
+			{ 16, 32, 0.85, 6.0 },
+			{ 32, 128, 0.90, 8.0 },
+			{ 64, 512, 0.95, 10.0 }
+		};
+
+		//zeroth order modified Bessel function of the first kind, for the Kaiser window
+		static double BesselI0(double x) {
+			double sum = 1.0;
+			double term = 1.0;
+
+			for(uint32_t k = 1; k < 64; k++) {
+				term *= (x / (2.0 * k)) * (x / (2.0 * k));
+				sum += term;
+
+				if(term < sum * 1e-12) {
+					break;
+				}
+			}
+
+			return sum;
+		}
+
+		Resampler::Resampler() {
+			Configure(44100, 44100, MEDIUM);
+		}
+
+		Resampler::Resampler(uint32_t input_rate, uint32_t output_rate, QUALITY quality, uint16_t channels) {
+			Configure(input_rate, output_rate, quality, channels);
+		}
+
+		void Resampler::Configure(uint32_t input_rate_, uint32_t output_rate_, QUALITY quality_, uint16_t channels) {
+			input_rate = (input_rate_ > 0) ? input_rate_ : 1;
+			output_rate = (output_rate_ > 0) ? output_rate_ : 1;
+			quality = quality_;
+			channel_count = (channels > 0) ? ((channels < MAX_CHANNELS) ? channels : MAX_CHANNELS) : 1;
+
+			const QualityTier& tier = QUALITY_TIERS[(uint32_t)(quality) <= (uint32_t)(BEST) ? (uint32_t)(quality) : (uint32_t)(MEDIUM)];
+
+			double ratio = (double)(output_rate) / (double)(input_rate);
+			double scale = (ratio < 1.0) ? ratio : 1.0;
+			double cutoff = tier.passband * scale;
+
+			//rounded up to whole vectors so the dot products never run a scalar tail
+			taps = (uint32_t)(std::ceil(tier.taps / scale));
+			taps = (taps + 7) & ~7u;
+			phases = tier.phases;
+
+			step = ((uint64_t)(input_rate) << FRACTION_BITS) / output_rate;
+
+			uint32_t half = taps / 2;
+			double norm = BesselI0(tier.beta);
+
+			bank.assign((size_t)(phases + 1) * taps, 0.0f);
+
+			for(uint32_t p = 0; p <= phases; p++) {
+				double offset = (double)(p) / (double)(phases);
+				float* row = &bank[(size_t)(p) * taps];
+				double sum = 0.0;
+
+				for(uint32_t k = 0; k < taps; k++) {
+					//distance in input samples from this tap to the output's position
+					double d = (double)(k) - (double)(half - 1) - offset;
+					double x = d / (double)(half);
+
+					if(x <= -1.0 || x >= 1.0) {
+						continue;
+					}
+
+					double arg = M_PI * cutoff * d;
+					double sinc = (d == 0.0) ? 1.0 : std::sin(arg) / arg;
+					double window = BesselI0(tier.beta * std::sqrt(1.0 - x * x)) / norm;
+
+					row[k] = (float)(sinc * window);
+					sum += row[k];
+				}
+
+				//unity gain at DC for every phase, so a constant signal comes out constant
+				for(uint32_t k = 0; k < taps; k++) {
+					row[k] = (float)(row[k] / sum);
+				}
+			}
+
+			stride = taps + HISTORY_BLOCK;
+			history.assign((size_t)(stride) * channel_count, 0.0f);
+
+			Reset();
+		}
+
+		void Resampler::Reset() {
+			uint32_t half = taps / 2;
+
+			//the window is centred on the output, so it starts half a filter of silence before the first input
+			std::fill(history.begin(), history.end(), 0.0f);
+			fill = half - 1;
+			position = (uint64_t)(half - 1) << FRACTION_BITS;
+		}
+
+		uint32_t Resampler::Process(const float* input, uint32_t frames, float* output, uint32_t capacity, uint32_t& consumed) {
+			if(input_rate == output_rate) {
+				consumed = (frames < capacity) ? frames : capacity;
+				std::memcpy(output, input, (size_t)(consumed) * channel_count * sizeof(float));
+				return consumed;
+			}
+
+			const uint64_t fraction_mask = ((uint64_t)(1) << FRACTION_BITS) - 1;
+			uint32_t half = taps / 2;
+			uint32_t produced = 0;
+
+			consumed = 0;
+
+			while(produced < capacity) {
+				uint32_t n = (uint32_t)(position >> FRACTION_BITS);
+
+				if(n + half < fill) {
+					float* out = output + (size_t)(produced) * channel_count;
+
+					for(uint16_t c = 0; c < channel_count; c++) {
+						out[c] = Interpolate(&history[(size_t)(c) * stride + n + 1 - half], position & fraction_mask);
+					}
+
+					produced++;
+					position += step;
+					continue;
+				}
+
+				if(consumed == frames) {
+					break;
+				}
+
+				//slide out everything the window has moved past, keeping the buffer a fixed size
+				if(fill == stride) {
+					uint32_t drop = n + 1 - half;
+
+					for(uint16_t c = 0; c < channel_count; c++) {
+						float* channel = &history[(size_t)(c) * stride];
+						std::memmove(channel, channel + drop, (fill - drop) * sizeof(float));
+					}
+
+					fill -= drop;
+					position -= (uint64_t)(drop) << FRACTION_BITS;
+				}
+
+				uint32_t count = (frames - consumed < stride - fill) ? (frames - consumed) : (stride - fill);
+
+				if(channel_count == 1) {
+					std::memcpy(&history[fill], input + consumed, count * sizeof(float));
+				} else {
+					float* planes[MAX_CHANNELS];
+
+					for(uint16_t c = 0; c < channel_count; c++) {
+						planes[c] = &history[(size_t)(c) * stride + fill];
+					}
+
+					DeinterleaveBuffer(planes, input + (size_t)(consumed) * channel_count, channel_count, count);
+				}
+
+				fill += count;
+				consumed += count;
+			}
+
+			return produced;
+		}
+
+		uint32_t Resampler::GetLatency() const {
+			return (input_rate == output_rate) ? 0 : taps / 2;
+		}
+
+		uint32_t Resampler::GetInputRate() const {
+			return input_rate;
+		}
+
+		uint32_t Resampler::GetOutputRate() const {
+			return output_rate;
+		}
+
+		Resampler::QUALITY Resampler::GetQuality() const {
+			return quality;
+		}
+
+		uint16_t Resampler::GetChannelCount() const {
+			return channel_count;
+		}
+
+		uint32_t Resampler::GetTapCount() const {
+			return taps;
+		}
+
+		SoundSample Resampler::Convert(const SampleView& clip, uint32_t output_rate, QUALITY quality) {
+			if(clip.length == 0 || clip.sample_rate == 0 || output_rate == 0) {
+				return SoundSample();
+			}
+
+			if(clip.sample_rate == output_rate) {
+				return SoundSample(clip);
+			}
+
+			if(clip.channels > MAX_CHANNELS) {
+				std::cerr << "[Resampler] Error converting clip\n\t";
+				std::cerr << "Reason: Clips with more than " << MAX_CHANNELS << " channels aren't supported.\n\n";
+				return SoundSample();
+			}
+
+			uint32_t frames = clip.GetFrameCount();
+			uint32_t duration = (uint32_t)(((uint64_t)(frames) * 1000 + clip.sample_rate - 1) / clip.sample_rate);
+			SoundSample converted{output_rate, duration, clip.channels, false};
+
+			Resampler resampler(clip.sample_rate, output_rate, quality, clip.channels);
+
+			uint32_t wanted = converted.GetFrameCount();
+			uint32_t consumed = 0;
+			uint32_t produced = resampler.Process(clip.data, frames, converted.audio_buffer, wanted, consumed);
+
+			//whatever's left comes from the filter running out over the silence after the clip
+			static const float silence[HISTORY_BLOCK] = { 0.0f };
+			uint32_t silent_frames = HISTORY_BLOCK / converted.channels;
+
+			while(produced < wanted) {
+				produced += resampler.Process(silence, silent_frames, converted.audio_buffer + (size_t)(produced) * converted.channels, wanted - produced, consumed);
+			}
+
+			return converted;
+		}
+
+		float Resampler::Interpolate(const float* window, uint64_t fraction) const {
+			//which pair of phases the fraction falls between, and how far between them
+			uint64_t scaled = fraction * phases;
+			uint32_t p = (uint32_t)(scaled >> FRACTION_BITS);
+			float blend = (float)(scaled & (((uint64_t)(1) << FRACTION_BITS) - 1)) * (1.0f / 4294967296.0f);
+
+			const float* lower = &bank[(size_t)(p) * taps];
+			float a = DotProduct(window, lower, taps);
+			float b = DotProduct(window, lower + taps, taps);
+
+			return a + blend * (b - a);
+		}
+
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef RESAMPLER_HPP
+#define RESAMPLER_HPP
+
+#include "Synth.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace geiger {
+	namespace midi {
+
+		//converts a stream of samples from one rate to another with a Kaiser-windowed sinc filter
+		//the filter is precomputed at a fixed number of fractional positions (phases); each output sample
+		//interpolates between the two nearest phases, so any pair of rates works without rebuilding the bank
+		//multichannel input and output are interleaved, up to MAX_CHANNELS; each channel keeps its own history and shares the bank
+		class Resampler
+		{
+			public:
+				enum QUALITY {
+					FAST = 0,
+					MEDIUM,
+					BEST
+				};
+
+				Resampler();
+				Resampler(uint32_t input_rate, uint32_t output_rate, QUALITY quality = MEDIUM, uint16_t channels = 1);
+
+				//builds the filter bank, so call it off the audio thread; also resets the stream
+				void Configure(uint32_t input_rate, uint32_t output_rate, QUALITY quality = MEDIUM, uint16_t channels = 1);
+
+				//forgets the stream's history, as if no input had been seen yet
+				void Reset();
+
+				//converts up to 'frames' input frames into at most 'capacity' output frames
+				//'consumed' receives how many input frames were taken; returns how many output frames were written
+				//output lines up with input in time: the first output sample is input sample 0
+				uint32_t Process(const float* input, uint32_t frames, float* output, uint32_t capacity, uint32_t& consumed);
+
+				//input samples the filter reads ahead of each output; feeding this many zeros after the last sample flushes the stream
+				uint32_t GetLatency() const;
+
+				uint32_t GetInputRate() const;
+				uint32_t GetOutputRate() const;
+				QUALITY GetQuality() const;
+				uint16_t GetChannelCount() const;
+				uint32_t GetTapCount() const;
+
+				//a whole clip converted in one pass, with the filter's delay compensated
+				static SoundSample Convert(const SampleView& clip, uint32_t output_rate, QUALITY quality = MEDIUM);
+
+			private:
+				static const uint32_t FRACTION_BITS = 32;
+				static const uint32_t HISTORY_BLOCK = 1024;
+
+				float Interpolate(const float* window, uint64_t fraction) const;
+
+				uint32_t input_rate;
+				uint32_t output_rate;
+				QUALITY quality;
+				uint16_t channel_count;
+
+				uint32_t taps;
+				uint32_t phases;
+
+				//(phases + 1) rows of 'taps' coefficients; row p is the filter for an output p / phases of the way between two inputs
+				std::vector<float> bank;
+
+				//recent input, one 'stride'-sample stretch per channel, with the current output time as a 32.32 fixed point index into it
+				std::vector<float> history;
+				uint32_t stride;
+				uint32_t fill;
+				uint64_t position;
+				uint64_t step;
+		};
+
+	}
+}
+
+#endif // RESAMPLER_HPP
@@ -0,0 +1,165 @@
+#include "Reverb.hpp"
+#include <cmath>
+
+namespace geiger {
+	namespace midi {
+
+		constexpr float Reverb::MIN_SIZE;
+		constexpr float Reverb::MAX_SIZE;
+
+		//line lengths at 44.1kHz and size 1, between 32 and 64 milliseconds and all prime, so their echoes rarely line up
+		static const uint32_t BASE_LENGTHS[Reverb::LINE_COUNT] = {1433, 1601, 1867, 2053, 2251, 2399, 2617, 2797};
+
+		//the matrix is scaled by 1/sqrt(8) to stay lossless; the outputs sum four lines each
+		static const float HADAMARD_SCALE = 0.35355339f;
+		static const float OUTPUT_SCALE = 0.5f;
+
+		//in place: multiplies by the 8x8 Hadamard matrix in three rounds of butterflies
+		static inline void Hadamard(float* x) {
+			for(uint32_t half = 1; half < Reverb::LINE_COUNT; half <<= 1) {
+				for(uint32_t i = 0; i < Reverb::LINE_COUNT; i += half << 1) {
+					for(uint32_t j = i; j < i + half; j++) {
+						float a = x[j];
+						float b = x[j + half];
+						x[j] = a + b;
+						x[j + half] = a - b;
+					}
+				}
+			}
+		}
+
+		Reverb::Reverb() : decay_time{1.8f}, damping{0.4f}, size{1.0f}, mix{0.25f} {
+			sample_rate = 0;
+			channel_count = 1;
+			capacity = 0;
+			write = 0;
+
+			Reset();
+		}
+
+		void Reverb::SetDecayTime(float seconds) {
+			if(seconds <= 0.0f) {
+				return;
+			}
+
+			decay_time.store(seconds, std::memory_order_relaxed);
+		}
+
+		void Reverb::SetDamping(float value) {
+			value = (value > 0.0f) ? ((value < 1.0f) ? value : 1.0f) : 0.0f;
+			damping.store(value, std::memory_order_relaxed);
+		}
+
+		void Reverb::SetSize(float value) {
+			value = (value > MIN_SIZE) ? ((value < MAX_SIZE) ? value : MAX_SIZE) : MIN_SIZE;
+			size.store(value, std::memory_order_relaxed);
+		}
+
+		void Reverb::SetMix(float value) {
+			value = (value > 0.0f) ? ((value < 1.0f) ? value : 1.0f) : 0.0f;
+			mix.store(value, std::memory_order_relaxed);
+		}
+
+		float Reverb::GetDecayTime() const {
+			return decay_time.load(std::memory_order_relaxed);
+		}
+
+		float Reverb::GetDamping() const {
+			return damping.load(std::memory_order_relaxed);
+		}
+
+		float Reverb::GetSize() const {
+			return size.load(std::memory_order_relaxed);
+		}
+
+		float Reverb::GetMix() const {
+			return mix.load(std::memory_order_relaxed);
+		}
+
+		void Reverb::Configure(uint32_t rate, uint16_t channels) {
+			sample_rate = (rate > 0) ? rate : 44100;
+			channel_count = (channels > 0) ? channels : 1;
+
+			//a power of two past the longest line at MAX_SIZE, so reading behind the write position is a mask
+			double longest = BASE_LENGTHS[LINE_COUNT - 1] * (double)(MAX_SIZE) * sample_rate / 44100.0;
+			capacity = 1;
+
+			while(capacity <= (uint32_t)(longest) + 1) {
+				capacity <<= 1;
+			}
+
+			lines.assign((size_t)(capacity) * LINE_COUNT, 0.0f);
+			Reset();
+		}
+
+		void Reverb::Reset() {
+			for(float& sample : lines) {
+				sample = 0.0f;
+			}
+
+			for(uint32_t k = 0; k < LINE_COUNT; k++) {
+				lowpass[k] = 0.0f;
+			}
+
+			write = 0;
+		}
+
+		void Reverb::Process(float* buffer, uint32_t frames) {
+			if(capacity == 0) {
+				return;
+			}
+
+			float scale = size.load(std::memory_order_relaxed) * sample_rate / 44100.0f;
+			float decay = decay_time.load(std::memory_order_relaxed);
+			float wet = mix.load(std::memory_order_relaxed);
+			float dry = 1.0f - wet;
+
+			//the lowpass pole; kept below 1 so even full damping leaves some signal in the loop
+			float pole = 0.9f * damping.load(std::memory_order_relaxed);
+
+			uint32_t lengths[LINE_COUNT];
+			float gains[LINE_COUNT];
+
+			//per block: each line's length and the loss per pass that gives a 60 dB fall over the decay time
+			for(uint32_t k = 0; k < LINE_COUNT; k++) {
+				lengths[k] = (uint32_t)(BASE_LENGTHS[k] * scale);
+				gains[k] = std::pow(10.0f, -3.0f * lengths[k] / (decay * sample_rate)) * HADAMARD_SCALE;
+			}
+
+			uint32_t mask = capacity - 1;
+			uint32_t stride = channel_count;
+			bool stereo = (stride > 1);
+			float y[LINE_COUNT];
+
+			for(uint32_t i = 0; i < frames; i++) {
+				float* frame = buffer + (size_t)(i) * stride;
+				float input = stereo ? 0.5f * (frame[0] + frame[1]) : frame[0];
+
+				for(uint32_t k = 0; k < LINE_COUNT; k++) {
+					float out = lines[(size_t)(k) * capacity + ((write - lengths[k]) & mask)];
+					lowpass[k] = out + pole * (lowpass[k] - out);
+					y[k] = lowpass[k];
+				}
+
+				float left = (y[0] + y[2] + y[4] + y[6]) * OUTPUT_SCALE;
+				float right = (y[1] + y[3] + y[5] + y[7]) * OUTPUT_SCALE;
+
+				Hadamard(y);
+
+				for(uint32_t k = 0; k < LINE_COUNT; k++) {
+					lines[(size_t)(k) * capacity + write] = input + gains[k] * y[k];
+				}
+
+				write = (write + 1) & mask;
+
+				if(stereo) {
+					frame[0] = dry * frame[0] + wet * left;
+					frame[1] = dry * frame[1] + wet * right;
+				} else {
+					frame[0] = dry * frame[0] + wet * 0.5f * (left + right);
+				}
+			}
+		}
+
+	}
+}
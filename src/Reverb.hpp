@@ -0,0 +1,68 @@
+#ifndef REVERB_HPP
+#define REVERB_HPP
+
+#include "Effect.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace geiger {
+	namespace midi {
+
+		//a feedback delay network: eight delay lines of mutually prime lengths, fed back into each other through a Hadamard matrix
+		//each line loses just enough per pass to fall 60 dB over the decay time, and a one-pole lowpass in the loop
+		//makes the highs die first, the way air and soft walls do
+		//the input is the average of the first two channels; even lines feed the left output and odd lines the right
+		//channels past the first two pass through untouched
+		class Reverb : public Effect
+		{
+			public:
+				static const uint32_t LINE_COUNT = 8;
+				static constexpr float MIN_SIZE = 0.25f;
+				static constexpr float MAX_SIZE = 2.0f;
+
+				Reverb();
+
+				//any thread: applied from the next block
+				//seconds for the tail to fall 60 dB
+				void SetDecayTime(float seconds);
+
+				//0 keeps the highs as long as the lows, 1 darkens the tail quickly
+				void SetDamping(float damping);
+
+				//scales every line's length; 1 is a mid-sized room, and the range is MIN_SIZE to MAX_SIZE
+				void SetSize(float size);
+
+				//0 is dry only and 1 is reverb only
+				void SetMix(float mix);
+
+				float GetDecayTime() const;
+				float GetDamping() const;
+				float GetSize() const;
+				float GetMix() const;
+
+				virtual void Configure(uint32_t sample_rate, uint16_t channels) override;
+				virtual void Process(float* buffer, uint32_t frames) override;
+				virtual void Reset() override;
+
+			private:
+				std::atomic<float> decay_time;
+				std::atomic<float> damping;
+				std::atomic<float> size;
+				std::atomic<float> mix;
+
+				uint32_t sample_rate;
+				uint16_t channel_count;
+
+				//LINE_COUNT lines of 'capacity' samples each, all written at the same position
+				std::vector<float> lines;
+				uint32_t capacity;
+				uint32_t write;
+
+				float lowpass[LINE_COUNT];
+		};
+
+	}
+}
+
+#endif // REVERB_HPP
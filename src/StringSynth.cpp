@@ -1,9 +1,11 @@
 #include "StringSynth.hpp"
+#include "AudioEngine.hpp"
+#include <iostream>
 
 namespace geiger {
 	namespace midi {
 
-		StringSynth::StringSynth()
+		StringSynth::StringSynth() : volume{0.5f}
 		{
 			active_length = 0.6069f;
 			linear_density = 0.002f;
@@ -11,21 +13,23 @@ namespace geiger {
 
 			mass = linear_density * active_length;
 
-			TuneToFrequency(110.0f);
-
-			max_amplitude = 0.0f;
-			volume = 0.5f;
-
+			fretted_length = 0.0f;
 			distance_struck = 0.5f * active_length;
 			initial_offset = 0.0f;
 			number_of_harmonics = 18;
-			time_elapsed = 0.0f;
+			position = 0;
+			silent = true;
+			silence_threshold = DEFAULT_SILENCE_THRESHOLD;
+			queue_full = false;
+
+			TuneToFrequency(110.0f);
+			BeginBlock();
 
 			paused = false;
 			stopped = true;
 		}
 
-		StringSynth::StringSynth(float L, float ten, float mu, float gamma)
+		StringSynth::StringSynth(float L, float ten, float mu, float gamma) : volume{0.5f}
 		{
 			tension = ten;
 			active_length = L;
@@ -38,12 +42,17 @@ namespace geiger {
 			float natural_frequency = 2 * M_PI * fundamental_frequency;
 			spring_constant = (natural_frequency * natural_frequency * mass);
 
-			max_amplitude = 0.0f;
-			volume = 0.5f;
-			distance_struck = 0.0f;
+			fretted_length = 0.0f;
+			distance_struck = 0.5f * active_length;
 			initial_offset = 0.0f;
 			number_of_harmonics = 15;
-			time_elapsed = 0.0f;
+			position = 0;
+			silent = true;
+			silence_threshold = DEFAULT_SILENCE_THRESHOLD;
+			queue_full = false;
+
+			PublishParameters();
+			BeginBlock();
 
 			paused = false;
 			stopped = true;
@@ -56,8 +65,9 @@ namespace geiger {
 
 		void StringSynth::SetHarmonicCount(uint32_t harmonics) {
 
-			number_of_harmonics = harmonics;
+			number_of_harmonics = (harmonics < MAX_HARMONICS) ? harmonics : MAX_HARMONICS;
 
+			PublishParameters();
 		}
 
 		void StringSynth::SetActiveLength(float len) {
@@ -72,6 +82,7 @@ namespace geiger {
 			float natural_frequency = 2 * M_PI * fundamental_frequency;
 			spring_constant = (natural_frequency * natural_frequency * mass);
 
+			PublishParameters();
 		}
 
 		void StringSynth::SetTension(float ten) {
@@ -82,7 +93,11 @@ namespace geiger {
 			tension = ten;
 
 			velocity = std::sqrt(tension / linear_density);
+			fundamental_frequency = velocity / (2 * active_length);
+			float natural_frequency = 2 * M_PI * fundamental_frequency;
+			spring_constant = (natural_frequency * natural_frequency * mass);
 
+			PublishParameters();
 		}
 
 		void StringSynth::SetLinearDensity(float mu) {
@@ -97,6 +112,8 @@ namespace geiger {
 			fundamental_frequency = velocity / (2 * active_length);
 			float natural_frequency = 2 * M_PI * fundamental_frequency;
 			spring_constant = (natural_frequency * natural_frequency * mass);
+
+			PublishParameters();
 		}
 
 		void StringSynth::SetDampingRatio(float gamma) {
@@ -105,6 +122,14 @@ namespace geiger {
             }
 
 			damping_ratio = gamma;
+
+			PublishParameters();
+		}
+
+		void StringSynth::SetSilenceThreshold(float decibels) {
+			silence_threshold = decibels;
+
+			PublishParameters();
 		}
 
 		uint32_t StringSynth::GetHarmonicCount() const {
@@ -124,14 +149,26 @@ namespace geiger {
 			return linear_density;
 		}
 
+		float StringSynth::GetWaveSpeed() const {
+			return velocity;
+		}
+
 		float StringSynth::GetDampingRatio() const {
 			return damping_ratio;
 		}
 
+		float StringSynth::GetSilenceThreshold() const {
+			return silence_threshold;
+		}
+
 		void StringSynth::TuneToNote(Note n) {
 			TuneToFrequency(NoteToFrequency(n));
 		}
 
+		void StringSynth::TuneToNote(uint8_t note_number) {
+			TuneToFrequency(EqualTemperedFrequency(note_number));
+		}
+
 		void StringSynth::TuneToFrequency(float freq) {
             fundamental_frequency = freq;
             float natural_frequency = 2 * M_PI * fundamental_frequency;
@@ -139,6 +176,8 @@ namespace geiger {
             velocity = 2.0f * active_length * fundamental_frequency;
 
             tension = linear_density * (velocity * velocity);
+
+            PublishParameters();
 		}
 
 		void StringSynth::Pluck(float dist, float offset) {
@@ -146,9 +185,7 @@ namespace geiger {
 				return;
 			}
 
-			distance_struck = dist;
-			initial_offset = offset;
-			time_elapsed = 0.0f;
+			Send({SynthCommand::PLUCK, 0, 0, dist, offset});
 		}
 
 		void StringSynth::Strike(float dist, float force) {
@@ -157,17 +194,63 @@ namespace geiger {
 				return;
 			}
 
-			distance_struck = dist;
-			initial_offset = (force / spring_constant);
-			time_elapsed = 0.0f;
+			Send({SynthCommand::PLUCK, 0, 0, dist, force / spring_constant});
 		}
 
 		void StringSynth::Silence() {
-			distance_struck = 0.5f * active_length;
-			initial_offset = 0.0f;
+			Send({SynthCommand::SILENCE, 0, 0, 0.0f, 0.0f});
+		}
+
+		void StringSynth::BeginBlock() {
+			params = snapshot.Acquire();
+
+			SynthCommand cmd;
+
+			while(commands.Pop(cmd)) {
+				HandleCommand(cmd);
+			}
+		}
+
+		void StringSynth::HandleCommand(const SynthCommand& cmd) {
+			switch(cmd.type) {
+				case SynthCommand::PLUCK:
+					distance_struck = cmd.value;
+					initial_offset = cmd.value2;
+					position = 0;
+					silent = false;
+					break;
+
+				case SynthCommand::SILENCE:
+					distance_struck = 0.5f * SoundingLength();
+					initial_offset = 0.0f;
+					silent = true;
+					break;
+
+				case SynthCommand::FRET:
+					if(cmd.value > 0.0f) {
+						fretted_length = cmd.value;
+					}
+					break;
+
+				case SynthCommand::OPEN:
+					fretted_length = 0.0f;
+					break;
+
+				default:
+					break;
+			}
 		}
 
 		float StringSynth::Value(float t) {
+			//with no engine rendering the string, this thread is the only consumer and picks up plucks and parameter changes itself
+			if(stopped) {
+				BeginBlock();
+			}
+
+			return volume.GetTarget() * Amplitude(t);
+		}
+
+		float StringSynth::Amplitude(float t) {
 
 			if(t < 0.0f) {
 				return 0.0f;
@@ -175,42 +258,133 @@ namespace geiger {
 
 			float total_amplitude = 0.0f;
 
-			for(uint32_t i = 0; i < number_of_harmonics; i++) {
+			for(uint32_t i = 0; i < params.harmonics; i++) {
+				uint32_t j = i + 1;
+				total_amplitude += HarmonicAmplitude(j) * std::cos(2.0f * M_PI * HarmonicFrequency(j) * t) * std::exp(-params.damping_ratio * j * t);
+			}
+
+			return total_amplitude / STRING_REFERENCE_DISPLACEMENT;
+		}
+
+		void StringSynth::Skip(uint64_t samples) {
+			position += samples;
+		}
+
+		bool StringSynth::IsSilent() const {
+			return silent;
+		}
+
+		void StringSynth::RenderAmplitude(float* buffer, uint32_t frames, uint32_t sample_rate) {
+			const double two_pi = 2.0 * M_PI;
+
+			if(silent) {
+				position += frames;
+				return;
+			}
+
+			uint32_t harmonics = (params.harmonics < MAX_HARMONICS) ? params.harmonics : MAX_HARMONICS;
+
+			double silence_bound = (double)(params.silence_level);
+			double harmonic_bound = (harmonics > 0) ? silence_bound / harmonics : 0.0;
+			double bound = 0.0;
+			uint32_t used = 0;
+
+			float re[MAX_HARMONICS];
+			float im[MAX_HARMONICS];
+			float rot_re[MAX_HARMONICS];
+			float rot_im[MAX_HARMONICS];
+
+			//each phasor is re-anchored from the integer position every call, so rounding never builds up past one block
+			double t0 = (double)(position) / (double)(sample_rate);
+
+			for(uint32_t i = 0; i < harmonics; i++) {
 				uint32_t j = i + 1;
-				total_amplitude += HarmonicAmplitude(j) * std::cos(2.0f * M_PI * HarmonicFrequency(j) * t) * std::exp(-damping_ratio * j * t);
+				double amplitude = HarmonicAmplitude(j) * std::exp(-params.damping_ratio * j * t0) / STRING_REFERENCE_DISPLACEMENT;
+
+				//harmonics only decay from here, so one that's already inaudible is left out of the block
+				if(std::abs(amplitude) < harmonic_bound) {
+					continue;
+				}
+
+				double omega = two_pi * HarmonicFrequency(j) / (double)(sample_rate);
+				double phase = std::fmod(omega * (double)(position), two_pi);
+				double decay = std::exp(-params.damping_ratio * j / (double)(sample_rate));
+
+				re[used] = (float)(amplitude * std::cos(phase));
+				im[used] = (float)(amplitude * std::sin(phase));
+				rot_re[used] = (float)(decay * std::cos(omega));
+				rot_im[used] = (float)(decay * std::sin(omega));
+				used++;
+
+				bound += std::abs(amplitude);
 			}
 
-			if(total_amplitude > max_amplitude) {
-				max_amplitude = total_amplitude;
+			//the sum of the harmonic amplitudes bounds the output, and it never grows again until the next pluck
+			if(bound <= silence_bound) {
+				silent = true;
+				position += frames;
+				return;
 			}
 
-			float result = volume * (total_amplitude / max_amplitude);
+			for(uint32_t n = 0; n < frames; n++) {
+				float total_amplitude = 0.0f;
+
+				for(uint32_t i = 0; i < used; i++) {
+					total_amplitude += re[i];
+
+					float r = re[i] * rot_re[i] - im[i] * rot_im[i];
+					im[i] = re[i] * rot_im[i] + im[i] * rot_re[i];
+					re[i] = r;
+				}
+
+				buffer[n] += total_amplitude;
+			}
 
-			return result;
+			position += frames;
 		}
 
 		SoundSample StringSynth::GenerateSample(uint32_t sample_rate, uint32_t duration_milliseconds, int32_t offset_milliseconds) {
 			SoundSample sample{sample_rate, duration_milliseconds};
 
-			float dt = 1.0f / (float)(sample_rate);
-			float offset_t = ((float)(sample_rate) / 1000.0f) * offset_milliseconds;
+			if(sample.buffer_length == 0) {
+				return sample;
+			}
 
-			for(uint32_t i = 0; i < sample.buffer_length; i++) {
-				sample.audio_buffer[i] = Value(i*dt + offset_t);
+			//while the engine plays the string only its callback may drain the queue
+			if(stopped) {
+				BeginBlock();
 			}
 
+			//render from the requested point after the pluck without disturbing the playing position
+			uint64_t saved_position = position;
+			bool saved_silent = silent;
+			position = (offset_milliseconds > 0) ? ((uint64_t)(sample_rate) * offset_milliseconds) / 1000 : 0;
+
+			RenderAmplitude(sample.audio_buffer, sample.buffer_length, sample_rate);
+
+			position = saved_position;
+			silent = saved_silent;
+
+			sample.ApplyGain(volume.GetTarget());
+
 			return sample;
 		}
 
 		void StringSynth::PlayNote(Note n) {
-			float old_freq = fundamental_frequency;
+			PlayFrequency(NoteToFrequency(n));
+		}
 
-			float frequency = NoteToFrequency(n);
+		void StringSynth::PlayNote(uint8_t note_number) {
+			PlayFrequency(EqualTemperedFrequency(note_number));
+		}
+
+		void StringSynth::PlayFrequency(float frequency) {
+			float old_freq = fundamental_frequency;
 
 			TuneToFrequency(frequency);
 
 			Play();
-			Pluck(0.5f * active_length, 0.05f);
+			Pluck(0.5f * active_length, STRING_REFERENCE_DISPLACEMENT);
 
 			std::this_thread::sleep_for(std::chrono::milliseconds(2000));
 
@@ -221,93 +395,109 @@ namespace geiger {
 
 		void StringSynth::Pause() {
 			if(!stopped) {
-				SDL_PauseAudioDevice(device_ID, 1);
+				AudioEngine::Get().SetPaused(this, true);
 				paused = true;
 			}
 		}
 
 		void StringSynth::Unpause() {
 			if(!stopped) {
-				SDL_PauseAudioDevice(device_ID, 0);
+				AudioEngine::Get().SetPaused(this, false);
 				paused = false;
 			}
 		}
 
 		void StringSynth::Play() {
-			SDL_AudioSpec want;
-			want.freq = 44100;
-			want.format = AUDIO_F32SYS;
-			want.channels = 1;
-			want.samples = 4096;
-			want.callback = stringsynth_callback;
-			want.userdata = (void*)(this);
-
-			device_ID = SDL_OpenAudioDevice(NULL, 0, &want, &specification, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
-			SDL_PauseAudioDevice(device_ID, 0);
+			if(!stopped) {
+				return;
+			}
+
 			paused = false;
-			stopped = false;
+			stopped = !AudioEngine::Get().Add(this);
 		}
 
 		void StringSynth::Stop() {
-			SDL_PauseAudioDevice(device_ID, 1);
-			SDL_CloseAudioDevice(device_ID);
+			if(stopped) {
+				return;
+			}
+
+			AudioEngine::Get().Remove(this);
 			stopped = true;
 			paused = false;
-			time_elapsed = -1.0f;
-			distance_struck = 0.0f;
-			initial_offset = 0.0f;
+
+			//the engine no longer renders this string, so this thread can take over as the consumer
+			commands.Clear();
+			HandleCommand({SynthCommand::SILENCE, 0, 0, 0.0f, 0.0f});
 		}
 
 		void StringSynth::SetVolume(float percent) {
 			if(percent >= 0.0f) {
-				volume = percent;
+				volume.Set(percent);
 			} else {
-                volume = -percent;
+                volume.Set(-percent);
 			}
 		}
 
 		float StringSynth::GetVolume() const {
-			return volume;
+			return volume.GetTarget();
 		}
 
 		float StringSynth::HarmonicAmplitude(uint32_t harmonic) {
-			float numer = 2.0f * initial_offset * (active_length * active_length);
-			float denom = (M_PI * M_PI) * (harmonic * harmonic) * (distance_struck * (active_length - distance_struck));
-			float factor = std::sin(harmonic * M_PI * (distance_struck / active_length));
+			float length = SoundingLength();
+			float numer = 2.0f * initial_offset * (length * length);
+			float denom = (M_PI * M_PI) * (harmonic * harmonic) * (distance_struck * (length - distance_struck));
+			float factor = std::sin(harmonic * M_PI * (distance_struck / length));
 
 			return (numer / denom) * factor;
 		}
 
 		float StringSynth::HarmonicFrequency(uint32_t harmonic) {
-			return harmonic * fundamental_frequency;
+			//same tension and density, so the pitch scales inversely with the length left vibrating
+			return harmonic * params.fundamental_frequency * (params.active_length / SoundingLength());
 		}
 
+		float StringSynth::SoundingLength() const {
+			return (fretted_length > 0.0f) ? fretted_length : params.active_length;
+		}
 
-		void stringsynth_callback(void* synth_, Uint8* stream_, int len_) {
-			StringSynth* synth = (StringSynth*)(synth_);
+		void StringSynth::PublishParameters() {
+			StringParameters p;
+			p.harmonics = number_of_harmonics;
+			p.active_length = active_length;
+			p.fundamental_frequency = fundamental_frequency;
+			p.damping_ratio = damping_ratio;
+			p.silence_level = DecibelsToAmplitude(silence_threshold);
 
-			float dt = 1.0f / (float)(synth->specification.freq);
+			snapshot.Publish(p);
+		}
 
-			if(synth->specification.format != AUDIO_F32SYS) {
-				if(synth->specification.format == AUDIO_S16SYS) {
-					uint16_t* stream = (uint16_t*)(stream_);
+		void StringSynth::Send(const SynthCommand& cmd) {
+			if(commands.Push(cmd)) {
+				queue_full = false;
+				return;
+			}
 
-					len_ = len_ / 2;
+			//said once per overflow rather than for every command dropped
+			if(!queue_full) {
+				std::cerr << "[StringSynth] Error queueing command\n\t";
+				std::cerr << "Reason: The command queue is full; nothing is draining it.\n\n";
+				queue_full = true;
+			}
+		}
 
-					for(int i = 0; i < len_; i++) {
-						stream[i] = (int16_t)(synth->Value(synth->time_elapsed) * std::numeric_limits<int16_t>::max());
-						synth->time_elapsed += dt;
-					}
-				}
+		void StringSynth::RenderBlock(float* buffer, uint32_t frames, uint32_t sample_rate) {
+			for(uint32_t i = 0; i < frames; i++) {
+				buffer[i] = 0.0f;
 			}
 
-			float* stream = (float*)(stream_);
+			BeginBlock();
+			RenderAmplitude(buffer, frames, sample_rate);
 
-			len_ = len_ / sizeof(float);
+			volume.BeginBlock(frames);
 
-			for(int i = 0; i < len_; i++) {
-				stream[i] = synth->Value(synth->time_elapsed);
-				synth->time_elapsed += dt;
+			for(uint32_t i = 0; i < frames; i++) {
+				buffer[i] *= volume.Current();
+				volume.Advance();
 			}
 		}
 
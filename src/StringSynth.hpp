@@ -2,19 +2,33 @@
 #define STRINGSYNTH_HPP
 
 #include "Synth.hpp"
+#include "Parameter.hpp"
+#include "CommandQueue.hpp"
 
-#define NO_STDIO_REDIRECT
-
-#include "SDL2/SDL.h"
 #include <thread>
 #include <chrono>
 
 namespace geiger {
 	namespace midi {
 
+		//the string's physical setup, published as one snapshot
+		//plucks, frets and silencing are performance events and travel through the command queue instead
+		struct StringParameters {
+			uint32_t harmonics;
+			float active_length;
+			float fundamental_frequency;
+			float damping_ratio;
+			float silence_level;
+		};
+
+		//strings output their displacement relative to this, in metres, so a typical pluck peaks near full scale
+		const float STRING_REFERENCE_DISPLACEMENT = 0.01f;
+
 		class StringSynth : public Synth
 		{
 			public:
+				static const uint32_t MAX_HARMONICS = 64;
+
 				StringSynth();
 				StringSynth(float L, float ten, float mu, float gamma);
 				virtual ~StringSynth();
@@ -25,23 +39,55 @@ namespace geiger {
 				void SetLinearDensity(float mu);
 				void SetDampingRatio(float gamma);
 
+				//once the string's output can no longer exceed this level it stops rendering until the next pluck
+				void SetSilenceThreshold(float decibels);
+
 				uint32_t GetHarmonicCount() const;
 				float GetActiveLength() const;
 				float GetTension() const;
 				float GetLinearDensity() const;
+
+				//sqrt(tension / linear density), kept up to date so fretting doesn't recompute it
+				float GetWaveSpeed() const;
 				float GetDampingRatio() const;
+				float GetSilenceThreshold() const;
 
 				void TuneToNote(Note n);
+				void TuneToNote(uint8_t note_number);
 				void TuneToFrequency(float freq);
 				void Pluck(float dist, float offset);
 				void Strike(float dist, float force);
 				void Silence();
 
+				//audio thread: picks up parameter changes published since the last block and applies queued commands
+				void BeginBlock();
+
+				//audio thread: applies a PLUCK, SILENCE, FRET or OPEN command to the string immediately
+				//used by instruments that own strings and schedule the commands themselves
+				virtual void HandleCommand(const SynthCommand& cmd) override;
+
+				//audio thread: adds the next 'frames' samples of the string's output, before volume, to buffer
+				//each harmonic's phase and decay are advanced incrementally from the integer sample position
+				void RenderAmplitude(float* buffer, uint32_t frames, uint32_t sample_rate);
+
+				//audio thread: moves the string 'samples' further on from its last pluck without rendering them
+				void Skip(uint64_t samples);
+
+				//the output t seconds after the last pluck, before volume is applied
+				float Amplitude(float t);
+
+				//audio thread: true once the string has decayed below the silence threshold
+				bool IsSilent() const;
+
+				//when the string isn't playing through the engine, Value() and GenerateSample() apply queued commands and
+				//parameter changes themselves; a string rendered by an owner such as GuitarSynth only sees them in BeginBlock()
 				virtual float Value(float t) override;
 
 				virtual SoundSample GenerateSample(uint32_t sample_rate, uint32_t duration_milliseconds, int32_t offset_milliseconds) override;
+				virtual void RenderBlock(float* buffer, uint32_t frames, uint32_t sample_rate) override;
 
 				virtual void PlayNote(Note n) override;
+				virtual void PlayNote(uint8_t note_number) override;
 
 				virtual void Pause() override;
 				virtual void Unpause() override;
@@ -54,13 +100,34 @@ namespace geiger {
 
 			private:
 
-				friend void stringsynth_callback(void* synth_, Uint8* stream_, int len_);
+				//tunes to 'frequency', plucks, and blocks for the two seconds the note rings
+				void PlayFrequency(float frequency);
 
 				float HarmonicAmplitude(uint32_t harmonic);
 				float HarmonicFrequency(uint32_t harmonic);
+				float SoundingLength() const;
+
+				void PublishParameters();
+				void Send(const SynthCommand& cmd);
 
-				float max_amplitude;
-				float volume;
+				SmoothedParameter volume;
+
+				//the audio thread's copy, refreshed from 'snapshot' by BeginBlock()
+				StringParameters params;
+				ParameterSnapshot<StringParameters> snapshot;
+				CommandQueue commands;
+
+				//control thread: set once a full queue has been reported, until a push succeeds again
+				bool queue_full;
+
+				//owned by the audio thread and changed only by commands
+				float fretted_length;
+				float distance_struck;
+				float initial_offset;
+
+				//samples since the last pluck
+				uint64_t position;
+				bool silent;
 
 				bool paused;
 				bool stopped;
@@ -75,20 +142,9 @@ namespace geiger {
 				float spring_constant;
 				float damping_ratio;
 				float fundamental_frequency;
-
-				float distance_struck;
-				float initial_offset;
-
-				float time_elapsed;
-
-				SDL_AudioDeviceID device_ID;
-				SDL_AudioSpec specification;
-
-				//std::atomic<bool> parameter_change;
+				float silence_threshold;
 		};
 
-		void stringsynth_callback(void* synth_, Uint8* stream_, int len_);
-
 	}
 }
 
@@ -1,162 +1,403 @@
 #include "Synth.hpp"
+#include "BufferPool.hpp"
+#include "AudioKernels.hpp"
+#include "Resampler.hpp"
+#include <algorithm>
+#include <iostream>
 
 namespace geiger {
 	namespace midi {
 
+		SampleView::SampleView() : data(nullptr), length(0), sample_rate(0), channels(1) {}
+
+		SampleView::SampleView(const float* samples, uint32_t len, uint32_t rate, uint16_t channel_count) :
+			data(samples), length(len), sample_rate(rate), channels((channel_count > 0) ? channel_count : 1) {}
+
+		uint32_t SampleView::GetFrameCount() const {
+			return length / channels;
+		}
+
+		const float& SampleView::operator[](size_t index) const {
+			return data[index];
+		}
+
 		SoundSample::SoundSample() {
 			audio_buffer = nullptr;
 			buffer_length = 0;
 			sample_rate = 0;
 			duration_milliseconds = 0;
+			capacity = 0;
+			channels = 1;
 		}
 
-		SoundSample::SoundSample(uint32_t rate, uint32_t dur_milli) {
-
-			if(dur_milli == 0 || rate == 0) {
-				audio_buffer = nullptr;
-				buffer_length = 0;
-				sample_rate = 0;
-				duration_milliseconds = 0;
-				return;
-			}
+		SoundSample::SoundSample(uint32_t rate, uint32_t dur_milli, bool zeroed) {
+			Initialise(rate, dur_milli, 1, zeroed);
+		}
 
-			sample_rate = rate;
-			duration_milliseconds = dur_milli;
-			float sample_per_milli = (float)(sample_rate) / 1000.0f;
-			float sample_count = sample_per_milli * dur_milli;
+		SoundSample::SoundSample(uint32_t rate, uint32_t dur_milli, uint16_t channel_count, bool zeroed) {
+			Initialise(rate, dur_milli, channel_count, zeroed);
+		}
 
-			buffer_length = (uint32_t)(sample_count);
-			if(sample_count > buffer_length) {
-				buffer_length++;
-			}
+		SoundSample::SoundSample(const SampleView& view) {
+			audio_buffer = nullptr;
+			buffer_length = 0;
+			capacity = 0;
+			channels = view.channels;
+			sample_rate = view.sample_rate;
+			duration_milliseconds = (view.sample_rate > 0) ? (uint32_t)(((uint64_t)(view.GetFrameCount()) * 1000) / view.sample_rate) : 0;
 
-			audio_buffer = new float[buffer_length];
+			Allocate(view.length);
 
-			for(uint32_t i = 0; i < buffer_length; i++) {
-				audio_buffer[i] = 0.0f;
+			if(audio_buffer) {
+				std::copy(view.data, view.data + buffer_length, audio_buffer);
 			}
 		}
 
 		SoundSample::SoundSample(const SoundSample& other) {
-			buffer_length = other.buffer_length;
+			audio_buffer = nullptr;
+			buffer_length = 0;
+			capacity = 0;
+			channels = other.channels;
 			sample_rate = other.sample_rate;
 			duration_milliseconds = other.duration_milliseconds;
 
-			audio_buffer = new float[buffer_length];
+			Allocate(other.buffer_length);
 
-			for(uint32_t i = 0; i < buffer_length; i++) {
-				audio_buffer[i] = other.audio_buffer[i];
+			if(audio_buffer) {
+				std::copy(other.audio_buffer, other.audio_buffer + buffer_length, audio_buffer);
 			}
 		}
 
-		SoundSample::SoundSample(SoundSample&& other) {
+		SoundSample::SoundSample(SoundSample&& other) noexcept {
 			buffer_length = other.buffer_length;
 			sample_rate = other.sample_rate;
 			duration_milliseconds = other.duration_milliseconds;
-
 			audio_buffer = other.audio_buffer;
+			capacity = other.capacity;
+			channels = other.channels;
+
 			other.audio_buffer = nullptr;
+			other.buffer_length = 0;
+			other.capacity = 0;
 		}
 
         SoundSample::~SoundSample() {
-			if(audio_buffer) {
-				delete[] audio_buffer;
-			}
+			Release();
 		}
 
         SoundSample& SoundSample::operator=(const SoundSample& s) {
-			buffer_length = s.buffer_length;
+			if(this == &s) {
+				return *this;
+			}
+
+			//the buffer we already hold is reused whenever it's big enough
+			if(s.buffer_length > capacity) {
+				Release();
+				Allocate(s.buffer_length);
+			} else {
+				buffer_length = s.buffer_length;
+			}
+
 			sample_rate = s.sample_rate;
 			duration_milliseconds = s.duration_milliseconds;
+			channels = s.channels;
 
-			audio_buffer = new float[buffer_length];
-
-			for(uint32_t i = 0; i < buffer_length; i++) {
-				audio_buffer[i] = s.audio_buffer[i];
+			if(audio_buffer) {
+				std::copy(s.audio_buffer, s.audio_buffer + buffer_length, audio_buffer);
 			}
 
 			return *this;
         }
 
-		SoundSample& SoundSample::operator=(SoundSample&& s) {
+		SoundSample& SoundSample::operator=(SoundSample&& s) noexcept {
+			if(this == &s) {
+				return *this;
+			}
+
+			Release();
+
 			buffer_length = s.buffer_length;
 			sample_rate = s.sample_rate;
 			duration_milliseconds = s.duration_milliseconds;
-
 			audio_buffer = s.audio_buffer;
+			capacity = s.capacity;
+			channels = s.channels;
+
 			s.audio_buffer = nullptr;
+			s.buffer_length = 0;
+			s.capacity = 0;
 
 			return *this;
 		}
 
-		SoundSample SoundSample::operator+(SoundSample other) {
-			//always choose the higher quality sound
-			uint32_t new_rate = (sample_rate > other.sample_rate) ? sample_rate : other.sample_rate;
+		uint32_t SoundSample::GetFrameCount() const {
+			return buffer_length / channels;
+		}
 
-			//choose the longer clip- we're adding samples together, after all
-			uint32_t new_dur = (duration_milliseconds > other.duration_milliseconds) ?
-                                duration_milliseconds :
-								other.duration_milliseconds;
+		SampleView SoundSample::View() const {
+			return SampleView{audio_buffer, buffer_length, sample_rate, channels};
+		}
 
-			SoundSample sum{new_rate, new_dur};
+		SampleView SoundSample::View(uint32_t offset, uint32_t length) const {
+			uint32_t frames = GetFrameCount();
 
-			for(uint32_t i = 0; i < sum.buffer_length; i++) {
-				//convert a sample number to a specific time after the start of the sample
-				float t = (float)(i) / (float)(sum.sample_rate);
+			if(offset >= frames) {
+				return SampleView{nullptr, 0, sample_rate, channels};
+			}
+
+			if(length > frames - offset) {
+				length = frames - offset;
+			}
+
+			return SampleView{audio_buffer + (size_t)(offset) * channels, length * channels, sample_rate, channels};
+		}
+
+		SoundSample::operator SampleView() const {
+			return View();
+		}
+
+		void SoundSample::Mix(const SampleView& src, float gain, uint32_t offset) {
+			//an empty clip or a missing rate has nothing to convert, and converting it would give back another empty clip
+			if(src.length == 0 || src.sample_rate == 0 || sample_rate == 0) {
+				return;
+			}
+
+			if(src.sample_rate != sample_rate) {
+				SoundSample converted = Resampler::Convert(src, sample_rate);
 
-				//use the calculated time in order to add together the two samples at the correct period
-				uint32_t this_index = (uint32_t)(t * sample_rate);
-				uint32_t other_index = (uint32_t)(t * other.sample_rate);
+				if(converted.buffer_length > 0) {
+					Mix(converted.View(), gain, offset);
+				}
 
-				sum.audio_buffer[i] = audio_buffer[this_index];
+				return;
+			}
 
-				if(other_index < other.buffer_length) {
-					sum.audio_buffer[i] = other.audio_buffer[other_index];
+			if(src.channels != channels) {
+				if(src.channels == 1) {
+					MixPanned(src, 0.0f, gain, offset);
+					return;
 				}
+
+				std::cerr << "[SoundSample] Error mixing clips\n\t";
+				std::cerr << "Reason: A " << src.channels << " channel clip can't be mixed into a " << channels << " channel one.\n\n";
+				return;
+			}
+
+			MixBufferWithGain(audio_buffer + (size_t)(offset) * channels, src.data, gain, CoveredFrames(src, offset) * channels);
+		}
+
+		void SoundSample::MixPanned(const SampleView& mono, float pan, float gain, uint32_t offset) {
+			if(mono.length == 0 || mono.sample_rate == 0 || sample_rate == 0) {
+				return;
+			}
+
+			if(mono.channels != 1) {
+				std::cerr << "[SoundSample] Error panning clip\n\t";
+				std::cerr << "Reason: Only mono clips can be panned.\n\n";
+				return;
+			}
+
+			if(mono.sample_rate != sample_rate) {
+				SoundSample converted = Resampler::Convert(mono, sample_rate);
+
+				if(converted.buffer_length > 0) {
+					MixPanned(converted.View(), pan, gain, offset);
+				}
+
+				return;
+			}
+
+			if(channels > MAX_CHANNELS) {
+				std::cerr << "[SoundSample] Error panning clip\n\t";
+				std::cerr << "Reason: Panning handles at most " << MAX_CHANNELS << " channels.\n\n";
+				return;
+			}
+
+			float gains[MAX_CHANNELS];
+			PanGains(pan, channels, gains);
+
+			for(uint16_t c = 0; c < channels; c++) {
+				gains[c] *= gain;
+			}
+
+			MixBufferPanned(audio_buffer + (size_t)(offset) * channels, channels, mono.data, gains, CoveredFrames(mono, offset));
+		}
+
+		void SoundSample::Crossfade(const SampleView& src, uint32_t offset) {
+			if(src.length == 0 || src.sample_rate == 0 || sample_rate == 0) {
+				return;
+			}
+
+			if(src.sample_rate != sample_rate) {
+				SoundSample converted = Resampler::Convert(src, sample_rate);
+
+				if(converted.buffer_length > 0) {
+					Crossfade(converted.View(), offset);
+				}
+
+				return;
 			}
 
+			if(src.channels != channels) {
+				std::cerr << "[SoundSample] Error crossfading clips\n\t";
+				std::cerr << "Reason: The clips have different channel counts.\n\n";
+				return;
+			}
+
+			uint32_t frames = CoveredFrames(src, offset);
+			float* dst = audio_buffer + (size_t)(offset) * channels;
+
+			if(channels == 1) {
+				CrossfadeBuffer(dst, src.data, frames);
+				return;
+			}
+
+			//the fade has to move per frame, not per interleaved sample
+			for(uint32_t i = 0; i < frames; i++) {
+				float w = (float)(i + 1) / (float)(frames);
+
+				for(uint16_t c = 0; c < channels; c++) {
+					size_t k = (size_t)(i) * channels + c;
+					dst[k] += w * (src.data[k] - dst[k]);
+				}
+			}
+		}
+
+		void SoundSample::ApplyEnvelope(const SampleView& envelope, uint32_t offset) {
+			if(envelope.length == 0 || envelope.sample_rate == 0 || sample_rate == 0) {
+				return;
+			}
+
+			if(envelope.sample_rate != sample_rate) {
+				SoundSample converted = Resampler::Convert(envelope, sample_rate);
+
+				if(converted.buffer_length > 0) {
+					ApplyEnvelope(converted.View(), offset);
+				}
+
+				return;
+			}
+
+			uint32_t frames = CoveredFrames(envelope, offset);
+			float* dst = audio_buffer + (size_t)(offset) * channels;
+
+			if(envelope.channels == channels) {
+				MultiplyBuffer(dst, envelope.data, frames * channels);
+				return;
+			}
+
+			if(envelope.channels != 1) {
+				std::cerr << "[SoundSample] Error applying envelope\n\t";
+				std::cerr << "Reason: The envelope must be mono or match the clip's channel count.\n\n";
+				return;
+			}
+
+			for(uint32_t i = 0; i < frames; i++) {
+				for(uint16_t c = 0; c < channels; c++) {
+					dst[(size_t)(i) * channels + c] *= envelope.data[i];
+				}
+			}
+		}
+
+		void SoundSample::ApplyGain(float gain) {
+			ScaleBuffer(audio_buffer, gain, buffer_length);
+		}
+
+		float SoundSample::Peak() const {
+			return BufferPeak(audio_buffer, buffer_length);
+		}
+
+		float SoundSample::Rms() const {
+			return BufferRms(audio_buffer, buffer_length);
+		}
+
+		SoundSample SoundSample::operator+(const SampleView& other) const {
+			//always choose the higher quality sound
+			uint32_t new_rate = (sample_rate > other.sample_rate) ? sample_rate : other.sample_rate;
+
+			//choose the longer clip- we're adding samples together, after all
+			uint32_t other_duration = (other.sample_rate > 0) ? (uint32_t)(((uint64_t)(other.GetFrameCount()) * 1000) / other.sample_rate) : 0;
+			uint32_t new_dur = (duration_milliseconds > other_duration) ?
+                                duration_milliseconds :
+								other_duration;
+
+			//a mono clip spreads over the other's channels
+			uint16_t new_channels = (channels > other.channels) ? channels : other.channels;
+
+			SoundSample sum{new_rate, new_dur, new_channels, true};
+
+			sum.Mix(View());
+			sum.Mix(other);
+
 			return sum;
 		}
 
-		SoundSample SoundSample::operator-(SoundSample other) {
+		SoundSample SoundSample::operator-(const SampleView& other) const {
 			uint32_t new_rate = (sample_rate < other.sample_rate) ? sample_rate : other.sample_rate;
-			uint32_t new_dur = (duration_milliseconds < other.duration_milliseconds) ?
+			uint32_t other_duration = (other.sample_rate > 0) ? (uint32_t)(((uint64_t)(other.GetFrameCount()) * 1000) / other.sample_rate) : 0;
+			uint32_t new_dur = (duration_milliseconds < other_duration) ?
                                 duration_milliseconds :
-								other.duration_milliseconds;
+								other_duration;
+			uint16_t new_channels = (channels > other.channels) ? channels : other.channels;
 
-			SoundSample difference{new_rate, new_dur};
+			SoundSample difference{new_rate, new_dur, new_channels, true};
 
-			for(uint32_t i = 0; i < difference.buffer_length; i++) {
-				float t = (float)(i) / (float)(difference.sample_rate);
-				uint32_t this_index = (uint32_t)(t * sample_rate);
-				uint32_t other_index = (uint32_t)(t * other.sample_rate);
-
-				difference.audio_buffer[i] = audio_buffer[this_index] - other.audio_buffer[other_index];
-			}
+			difference.Mix(View());
+			difference.Mix(other, -1.0f);
 
 			return difference;
 		}
 
-		SoundSample& SoundSample::operator+=(SoundSample other) {
-			for(uint32_t i = 0; i < buffer_length; i++) {
-				float t = (float)(i) / (float)(sample_rate);
-				uint32_t other_index = (uint32_t)(t * other.sample_rate);
+		SoundSample& SoundSample::operator+=(const SampleView& other) {
+			Mix(other);
+			return *this;
+		}
+
+		SoundSample& SoundSample::operator-=(const SampleView& other) {
+			Mix(other, -1.0f);
+			return *this;
+		}
+
+		void SoundSample::Initialise(uint32_t rate, uint32_t dur_milli, uint16_t channel_count, bool zeroed) {
+			audio_buffer = nullptr;
+			buffer_length = 0;
+			capacity = 0;
+			channels = (channel_count > 0) ? channel_count : 1;
+
+			if(dur_milli == 0 || rate == 0) {
+				sample_rate = 0;
+				duration_milliseconds = 0;
+				return;
+			}
+
+			sample_rate = rate;
+			duration_milliseconds = dur_milli;
+			float sample_per_milli = (float)(sample_rate) / 1000.0f;
+			float sample_count = sample_per_milli * dur_milli;
 
-				audio_buffer[i] = audio_buffer[i] + other.audio_buffer[other_index];
+			uint32_t frames = (uint32_t)(sample_count);
+			if(sample_count > frames) {
+				frames++;
 			}
 
-			return *this;
+			Allocate(frames * channels);
+
+			if(zeroed && audio_buffer) {
+				std::fill(audio_buffer, audio_buffer + buffer_length, 0.0f);
+			}
 		}
 
-		SoundSample& SoundSample::operator-=(SoundSample other) {
-			for(uint32_t i = 0; i < buffer_length; i++) {
-				float t = (float)(i) / (float)(sample_rate);
-				uint32_t other_index = (uint32_t)(t * other.sample_rate);
+		uint32_t SoundSample::CoveredFrames(const SampleView& src, uint32_t offset) const {
+			uint32_t frames = GetFrameCount();
 
-				audio_buffer[i] = audio_buffer[i] - other.audio_buffer[other_index];
+			if(offset >= frames || !src.data) {
+				return 0;
 			}
 
-			return *this;
+			uint32_t room = frames - offset;
+			uint32_t available = src.GetFrameCount();
+
+			return (available < room) ? available : room;
 		}
 
 		float& SoundSample::operator[](size_t index) {
@@ -167,6 +408,22 @@ namespace geiger {
             return audio_buffer[index];
 		}
 
+		void SoundSample::Allocate(uint32_t samples) {
+			if(samples == 0) {
+				return;
+			}
+
+			audio_buffer = BufferPool::Get().Acquire(samples, capacity);
+			buffer_length = audio_buffer ? samples : 0;
+		}
+
+		void SoundSample::Release() {
+			BufferPool::Get().Release(audio_buffer, capacity);
+			audio_buffer = nullptr;
+			buffer_length = 0;
+			capacity = 0;
+		}
+
 		Note::Note() : note(A), acc(NATURAL), octave(4) {}
 		Note::Note(BASE_NOTE n, ACCIDENTAL a, int8_t oct) : note(n), acc(a), octave(oct) {}
 
@@ -183,54 +440,53 @@ namespace geiger {
 		}
 
 		float NoteToFrequency(Note n) {
-            static Note STANDARD_PITCH = Note{};
+			int32_t note = NoteNumber(n);
 
-            int half_step_difference = ((n.note + n.acc) - (STANDARD_PITCH.note + STANDARD_PITCH.acc));
-            int octave_difference = n.octave - STANDARD_PITCH.octave;
+			if(note >= 0) {
+				return EqualTemperedFrequency((uint8_t)(note));
+			}
 
-            float frequency = 440.0f * std::pow(2.0f, (octave_difference * 12.0f + half_step_difference) / 12.0f);
+			//only octaves beyond the MIDI range end up here
+			int32_t semitone = (n.octave * 12) + (int32_t)(n.note) + (int32_t)(n.acc) + 11;
+			return REFERENCE_FREQUENCY * std::pow(2.0f, (semitone - (int32_t)(REFERENCE_NOTE)) / 12.0f);
+		}
+
+		float NoteToFrequency(uint8_t note_number) {
+			return EqualTemperedFrequency(note_number);
+		}
 
-            return frequency;
+		int32_t NoteNumber(Note n) {
+			int32_t note = (n.octave * 12) + (int32_t)(n.note) + (int32_t)(n.acc) + 11;
+			return (note >= 0 && note < (int32_t)(NOTE_COUNT)) ? note : -1;
+		}
+
+		Note NoteNumberToNote(uint8_t note_number) {
+			static const Note::BASE_NOTE NAMES[12] = {
+				Note::C, Note::C, Note::D, Note::D, Note::E, Note::F, Note::F, Note::G, Note::G, Note::A, Note::A, Note::B
+			};
+
+			static const Note::ACCIDENTAL ACCIDENTALS[12] = {
+				Note::NATURAL, Note::SHARP, Note::NATURAL, Note::SHARP, Note::NATURAL, Note::NATURAL,
+				Note::SHARP, Note::NATURAL, Note::SHARP, Note::NATURAL, Note::SHARP, Note::NATURAL
+			};
+
+			//MIDI note 0 is C of octave -1
+			uint32_t note = note_number & 0x7F;
+			return Note(NAMES[note % 12], ACCIDENTALS[note % 12], (int8_t)((int32_t)(note / 12) - 1));
+		}
+
+		float DecibelsToAmplitude(float decibels) {
+			return std::pow(10.0f, decibels / 20.0f);
 		}
 
 		Note FrequencyToClosestNote(float freq) {
-            freq = freq / 440.0f;
-            freq = std::log(freq) / std::log(2.0f);
-            freq = freq * 12.0f;
-            int8_t octave_difference = (int8_t)(freq) / 12;
-
-            int half_step_difference;
-
-            if(octave_difference != 0) {
-				half_step_difference = (int)(freq) / octave_difference;
-            } else {
-				half_step_difference = (int)(freq) - Note::A;
-            }
-
-            Note n;
-            n.octave = 4 + octave_difference;
-
-            if(half_step_difference > -5 && half_step_difference < 3) {
-				int note_offset = (half_step_difference / 2);
-				n.note = (Note::BASE_NOTE)(Note::A + (note_offset * 2));
-
-				if(half_step_difference < 0) {
-					n.acc = (Note::ACCIDENTAL)((-half_step_difference) % 2);
-					n.note = (Note::BASE_NOTE)(n.note - 2);
-				} else if(half_step_difference > 0){
-					n.acc = (Note::ACCIDENTAL)(-(half_step_difference % 2));
-					n.note = (Note::BASE_NOTE)(n.note + 2);
-				} else {
-					n.acc = (Note::ACCIDENTAL)(0);
-				}
+			static const Tuning EQUAL_TEMPERED;
 
-            } else {
-				int note_offset = ((half_step_difference - 1) / 2) - 1;
-				n.note = (Note::BASE_NOTE)(Note::A + (note_offset * 2) + 1);
-				n.acc = (Note::ACCIDENTAL)(-(half_step_difference + 1) % 2);
-            }
+			return NoteNumberToNote(EQUAL_TEMPERED.GetClosestNote(freq));
+		}
 
-            return n;
+		void Synth::PlayNote(uint8_t note_number) {
+			PlayNote(NoteNumberToNote(note_number));
 		}
 
 	}
@@ -2,6 +2,8 @@
 #define SYNTH_HPP
 
 #include "SDL2/SDL_audio.h"
+#include "CommandQueue.hpp"
+#include "Tuning.hpp"
 #include <cmath>
 #include <limits>
 #include <atomic>
@@ -13,29 +15,83 @@
 namespace geiger {
 	namespace midi {
 
+		//a read-only window onto samples owned by a SoundSample or any other buffer; copying one never copies audio
+		//multichannel samples are interleaved, so 'length' counts every channel's samples
+		struct SampleView {
+			const float* data;
+			uint32_t length;
+			uint32_t sample_rate;
+			uint16_t channels;
+
+			SampleView();
+			SampleView(const float* samples, uint32_t len, uint32_t rate, uint16_t channel_count = 1);
+
+			uint32_t GetFrameCount() const;
+
+			const float& operator[](size_t index) const;
+		};
+
+		//a clip of interleaved samples in a 64-byte aligned buffer borrowed from BufferPool
+		//moving hands the buffer over; copying is the only operation that duplicates audio
 		struct SoundSample {
             uint32_t sample_rate;
             uint32_t buffer_length;
             uint32_t duration_milliseconds;
             float* audio_buffer;
 
+			//the buffer's real size, needed to hand it back to the pool
+			uint32_t capacity;
+			uint16_t channels;
+
 			SoundSample();
-			SoundSample(uint32_t rate, uint32_t dur_milli);
+
+			//pass zeroed = false when every sample is about to be overwritten anyway
+			SoundSample(uint32_t rate, uint32_t dur_milli, bool zeroed = true);
+			SoundSample(uint32_t rate, uint32_t dur_milli, uint16_t channel_count, bool zeroed);
+			explicit SoundSample(const SampleView& view);
 			SoundSample(const SoundSample& other);
-			SoundSample(SoundSample&& other);
+			SoundSample(SoundSample&& other) noexcept;
             ~SoundSample();
 
             SoundSample& operator=(const SoundSample& s);
-            SoundSample& operator=(SoundSample&& s);
+            SoundSample& operator=(SoundSample&& s) noexcept;
+
+            uint32_t GetFrameCount() const;
+
+            //offsets and lengths count frames, one sample from every channel
+            SampleView View() const;
+            SampleView View(uint32_t offset, uint32_t length) const;
+            operator SampleView() const;
+
+            //in-place operations starting 'offset' frames into this clip; a source at another rate is resampled to this one first
+            //frames that would fall past the end of this clip are left out
+            //a mono source is spread over every channel, centre panned; any other channel count has to match this clip's
+            void Mix(const SampleView& src, float gain = 1.0f, uint32_t offset = 0);
+            void MixPanned(const SampleView& mono, float pan, float gain = 1.0f, uint32_t offset = 0);
+            void Crossfade(const SampleView& src, uint32_t offset = 0);
+            void ApplyEnvelope(const SampleView& envelope, uint32_t offset = 0);
+            void ApplyGain(float gain);
+
+            float Peak() const;
+            float Rms() const;
 
-            SoundSample operator+(SoundSample other);
-            SoundSample operator-(SoundSample other);
+            SoundSample operator+(const SampleView& other) const;
+            SoundSample operator-(const SampleView& other) const;
 
-            SoundSample& operator+=(SoundSample other);
-            SoundSample& operator-=(SoundSample other);
+            SoundSample& operator+=(const SampleView& other);
+            SoundSample& operator-=(const SampleView& other);
 
             float& operator[](size_t index);
             const float& operator[](size_t index) const;
+
+			private:
+				void Initialise(uint32_t rate, uint32_t dur_milli, uint16_t channel_count, bool zeroed);
+
+				//how many of this clip's frames from 'offset' onwards 'src' covers
+				uint32_t CoveredFrames(const SampleView& src, uint32_t offset) const;
+
+				void Allocate(uint32_t samples);
+				void Release();
 		};
 
 		struct Note {
@@ -71,8 +127,21 @@ namespace geiger {
 			void AddNote(Note n);
 		};
 
+		//equal tempered pitches, read from the precomputed table
 		float NoteToFrequency(Note n);
-		Note FrequencyToNote(float freq);
+		float NoteToFrequency(uint8_t note_number);
+
+		//Note::C of octave 4 is semitone 49 and middle C is MIDI note 60; -1 for notes outside 0 to 127
+		int32_t NoteNumber(Note n);
+		Note NoteNumberToNote(uint8_t note_number);
+
+		//the equal tempered note nearest 'freq', spelled with sharps
+		Note FrequencyToClosestNote(float freq);
+
+		//voices whose output can no longer exceed this level are switched off and skipped
+		const float DEFAULT_SILENCE_THRESHOLD = -80.0f;
+
+		float DecibelsToAmplitude(float decibels);
 
 		class Synth
 		{
@@ -83,8 +152,21 @@ namespace geiger {
 
 				virtual SoundSample GenerateSample(uint32_t sample_rate, uint32_t duration_milliseconds, int32_t offset_milliseconds) = 0;
 
+				//audio thread: overwrites 'frames' samples of buffer with the synth's next block
+				//AudioEngine calls this for every playing synth from its one callback
+				virtual void RenderBlock(float* buffer, uint32_t frames, uint32_t sample_rate) = 0;
+
+				//audio thread: applies an event between two rendered blocks; synths ignore types they don't understand
+				virtual void HandleCommand(const SynthCommand&) {}
+
+				//where the engine places the synth's mono output between left (-1) and right (1)
+				virtual float GetPan() const { return 0.0f; }
+
 				virtual void PlayNote(Note n) = 0;
 
+				//a MIDI note number; synths that don't override it spell the note out and call PlayNote(Note)
+				virtual void PlayNote(uint8_t note_number);
+
 				virtual void Pause() = 0;
 				virtual void Unpause() = 0;
 
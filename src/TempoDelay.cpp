@@ -0,0 +1,138 @@
+#include "TempoDelay.hpp"
+#include <cstddef>
+
+namespace geiger {
+	namespace midi {
+
+		constexpr float TempoDelay::MAX_SECONDS;
+
+		TempoDelay::TempoDelay() : tempo{120.0f}, division{0.75f}, feedback{0.35f}, mix{0.3f} {
+			sample_rate = 0;
+			channel_count = 1;
+			capacity = 0;
+			write = 0;
+			current_delay = 0.0;
+		}
+
+		void TempoDelay::SetTempo(float beats_per_minute) {
+			if(beats_per_minute <= 0.0f) {
+				return;
+			}
+
+			tempo.store(beats_per_minute, std::memory_order_relaxed);
+		}
+
+		void TempoDelay::SetDivision(float beats) {
+			if(beats <= 0.0f) {
+				return;
+			}
+
+			division.store(beats, std::memory_order_relaxed);
+		}
+
+		void TempoDelay::SetFeedback(float value) {
+			value = (value > 0.0f) ? ((value < 0.95f) ? value : 0.95f) : 0.0f;
+			feedback.store(value, std::memory_order_relaxed);
+		}
+
+		void TempoDelay::SetMix(float value) {
+			value = (value > 0.0f) ? ((value < 1.0f) ? value : 1.0f) : 0.0f;
+			mix.store(value, std::memory_order_relaxed);
+		}
+
+		float TempoDelay::GetTempo() const {
+			return tempo.load(std::memory_order_relaxed);
+		}
+
+		float TempoDelay::GetDivision() const {
+			return division.load(std::memory_order_relaxed);
+		}
+
+		float TempoDelay::GetFeedback() const {
+			return feedback.load(std::memory_order_relaxed);
+		}
+
+		float TempoDelay::GetMix() const {
+			return mix.load(std::memory_order_relaxed);
+		}
+
+		float TempoDelay::GetDelaySeconds() const {
+			return 60.0f * GetDivision() / GetTempo();
+		}
+
+		void TempoDelay::Configure(uint32_t rate, uint16_t channels) {
+			sample_rate = (rate > 0) ? rate : 44100;
+			channel_count = (channels > 0) ? channels : 1;
+
+			uint32_t longest = (uint32_t)(MAX_SECONDS * sample_rate) + 2;
+			capacity = 1;
+
+			while(capacity < longest) {
+				capacity <<= 1;
+			}
+
+			history.assign((size_t)(capacity) * channel_count, 0.0f);
+			Reset();
+		}
+
+		void TempoDelay::Reset() {
+			for(float& sample : history) {
+				sample = 0.0f;
+			}
+
+			write = 0;
+
+			//the first block after a reset starts at the right time rather than gliding to it
+			current_delay = 0.0;
+		}
+
+		void TempoDelay::Process(float* buffer, uint32_t frames) {
+			if(capacity == 0 || frames == 0) {
+				return;
+			}
+
+			double target = (double)(GetDelaySeconds()) * sample_rate;
+			double limit = (double)(MAX_SECONDS) * sample_rate;
+			target = (target > 1.0) ? ((target < limit) ? target : limit) : 1.0;
+
+			if(current_delay == 0.0) {
+				current_delay = target;
+			}
+
+			double delay = current_delay;
+			double step = (target - current_delay) / frames;
+
+			float back = feedback.load(std::memory_order_relaxed);
+			float wet = mix.load(std::memory_order_relaxed);
+			float dry = 1.0f - wet;
+
+			uint32_t mask = capacity - 1;
+			uint32_t stride = channel_count;
+
+			for(uint32_t i = 0; i < frames; i++) {
+				delay += step;
+
+				//linear interpolation between the two frames either side of the read position
+				uint32_t whole = (uint32_t)(delay);
+				float fraction = (float)(delay - whole);
+
+				const float* newer = &history[(size_t)((write - whole) & mask) * stride];
+				const float* older = &history[(size_t)((write - whole - 1) & mask) * stride];
+				float* input = &history[(size_t)(write) * stride];
+				float* frame = buffer + (size_t)(i) * stride;
+
+				for(uint32_t c = 0; c < stride; c++) {
+					float echo = newer[c] + fraction * (older[c] - newer[c]);
+
+					input[c] = frame[c] + back * echo;
+					frame[c] = dry * frame[c] + wet * echo;
+				}
+
+				write = (write + 1) & mask;
+			}
+
+			current_delay = target;
+		}
+
+	}
+}
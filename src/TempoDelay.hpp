@@ -0,0 +1,68 @@
+#ifndef TEMPODELAY_HPP
+#define TEMPODELAY_HPP
+
+#include "Effect.hpp"
+
+#include <atomic>
+#include <vector>
+
+namespace geiger {
+	namespace midi {
+
+		//an echo whose time is a number of beats at a tempo, with feedback, on every channel separately
+		//a new delay time glides in across one block instead of jumping, so retiming it bends the pitch of the echoes
+		//rather than clicking, the way a tape delay does
+		class TempoDelay : public Effect
+		{
+			public:
+				//the longest delay the buffer is sized for
+				static constexpr float MAX_SECONDS = 4.0f;
+
+				TempoDelay();
+
+				//any thread: applied from the next block
+				void SetTempo(float beats_per_minute);
+
+				//the delay in beats: 1 is a quarter note in 4/4, 0.75 a dotted eighth, 0.5 an eighth
+				void SetDivision(float beats);
+
+				//how much of each echo comes back again, from 0 up to 0.95
+				void SetFeedback(float feedback);
+
+				//0 is dry only and 1 is echoes only
+				void SetMix(float mix);
+
+				float GetTempo() const;
+				float GetDivision() const;
+				float GetFeedback() const;
+				float GetMix() const;
+
+				//the delay the current tempo and division ask for, before it's limited to MAX_SECONDS
+				float GetDelaySeconds() const;
+
+				virtual void Configure(uint32_t sample_rate, uint16_t channels) override;
+				virtual void Process(float* buffer, uint32_t frames) override;
+				virtual void Reset() override;
+
+			private:
+				std::atomic<float> tempo;
+				std::atomic<float> division;
+				std::atomic<float> feedback;
+				std::atomic<float> mix;
+
+				uint32_t sample_rate;
+				uint16_t channel_count;
+
+				//'capacity' interleaved frames, a power of two
+				std::vector<float> history;
+				uint32_t capacity;
+				uint32_t write;
+
+				//audio thread: the delay in samples at the end of the last block
+				double current_delay;
+		};
+
+	}
+}
+
+#endif // TEMPODELAY_HPP
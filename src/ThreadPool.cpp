@@ -0,0 +1,126 @@
+#include "ThreadPool.hpp"
+
+namespace geiger {
+	namespace midi {
+
+		ThreadPool::ThreadPool(uint32_t thread_count) : next_queue{0}, queued{0}, pending{0}, quit{false} {
+			//there is always at least one queue, even when the caller's thread does all the work
+			uint32_t queue_count = (thread_count > 0) ? thread_count : 1;
+
+			for(uint32_t i = 0; i < queue_count; i++) {
+				workers.emplace_back(new Worker());
+			}
+
+			for(uint32_t i = 0; i < thread_count; i++) {
+				threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+			}
+		}
+
+		ThreadPool::~ThreadPool() {
+			Wait();
+
+			{
+				std::lock_guard<std::mutex> guard(wake_lock);
+				quit = true;
+			}
+
+			wake.notify_all();
+
+			for(std::thread& t : threads) {
+				t.join();
+			}
+		}
+
+		void ThreadPool::Submit(std::function<void()> task) {
+			Worker& worker = *workers[next_queue.fetch_add(1) % workers.size()];
+
+			pending.fetch_add(1);
+			queued.fetch_add(1);
+
+			{
+				std::lock_guard<std::mutex> guard(worker.lock);
+				worker.tasks.push_back(std::move(task));
+			}
+
+			//taking the lock orders this notify after any worker's check of 'queued'
+			{
+				std::lock_guard<std::mutex> guard(wake_lock);
+			}
+
+			wake.notify_one();
+		}
+
+		void ThreadPool::Wait() {
+			while(pending.load() > 0) {
+				if(RunOne(0)) {
+					continue;
+				}
+
+				std::unique_lock<std::mutex> guard(wake_lock);
+				done.wait(guard, [this] { return pending.load() == 0 || queued.load() > 0; });
+			}
+		}
+
+		uint32_t ThreadPool::GetThreadCount() const {
+			return (uint32_t)(threads.size());
+		}
+
+		bool ThreadPool::RunOne(uint32_t home) {
+			std::function<void()> task;
+			uint32_t count = (uint32_t)(workers.size());
+
+			//newest task from our own queue, since its data is most likely still in cache
+			{
+				Worker& own = *workers[home];
+				std::lock_guard<std::mutex> guard(own.lock);
+
+				if(!own.tasks.empty()) {
+					task = std::move(own.tasks.back());
+					own.tasks.pop_back();
+				}
+			}
+
+			//otherwise steal the oldest task from the next busy worker
+			for(uint32_t i = 1; i < count && !task; i++) {
+				Worker& victim = *workers[(home + i) % count];
+				std::lock_guard<std::mutex> guard(victim.lock);
+
+				if(!victim.tasks.empty()) {
+					task = std::move(victim.tasks.front());
+					victim.tasks.pop_front();
+				}
+			}
+
+			if(!task) {
+				return false;
+			}
+
+			queued.fetch_sub(1);
+
+			task();
+
+			if(pending.fetch_sub(1) == 1) {
+				std::lock_guard<std::mutex> guard(wake_lock);
+				done.notify_all();
+			}
+
+			return true;
+		}
+
+		void ThreadPool::WorkerLoop(uint32_t index) {
+			while(true) {
+				if(RunOne(index)) {
+					continue;
+				}
+
+				std::unique_lock<std::mutex> guard(wake_lock);
+				wake.wait(guard, [this] { return quit || queued.load() > 0; });
+
+				if(quit) {
+					return;
+				}
+			}
+		}
+
+	}
+}
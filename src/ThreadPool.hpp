@@ -0,0 +1,61 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace geiger {
+	namespace midi {
+
+		//a fixed set of worker threads, each with its own task deque
+		//workers take their newest task first and steal the oldest task of another worker when idle
+		class ThreadPool
+		{
+			public:
+				//a pool with no threads runs every task on the thread calling Wait()
+				explicit ThreadPool(uint32_t thread_count = std::thread::hardware_concurrency());
+				~ThreadPool();
+
+				ThreadPool(const ThreadPool&) = delete;
+				ThreadPool& operator=(const ThreadPool&) = delete;
+
+				void Submit(std::function<void()> task);
+
+				//blocks until every submitted task has finished, running tasks on this thread meanwhile
+				void Wait();
+
+				uint32_t GetThreadCount() const;
+
+			private:
+				struct Worker {
+					std::deque<std::function<void()>> tasks;
+					std::mutex lock;
+				};
+
+				bool RunOne(uint32_t home);
+				void WorkerLoop(uint32_t index);
+
+				std::vector<std::unique_ptr<Worker>> workers;
+				std::vector<std::thread> threads;
+
+				std::atomic<uint32_t> next_queue;
+				std::atomic<uint32_t> queued;
+				std::atomic<uint32_t> pending;
+
+				std::mutex wake_lock;
+				std::condition_variable wake;
+				std::condition_variable done;
+				bool quit;
+		};
+
+	}
+}
+
+#endif // THREADPOOL_HPP
@@ -0,0 +1,182 @@
+#include "Tuning.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace geiger {
+	namespace midi {
+
+		//the next line that isn't a comment, with the line ending removed
+		static bool ReadScalaLine(std::istream& is, std::string& line) {
+			while(std::getline(is, line)) {
+				if(!line.empty() && line.back() == '\r') {
+					line.pop_back();
+				}
+
+				if(line.empty() || line[0] != '!') {
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		//a pitch line is cents if it has a decimal point and a ratio (n/d or a whole number) otherwise; anything after it is ignored
+		static bool ParseScalaPitch(const std::string& line, double& ratio) {
+			std::istringstream ss(line);
+			std::string token;
+
+			if(!(ss >> token)) {
+				return false;
+			}
+
+			if(token.find('.') != std::string::npos) {
+				char* end = nullptr;
+				double cents = std::strtod(token.c_str(), &end);
+
+				if(end == token.c_str()) {
+					return false;
+				}
+
+				ratio = std::pow(2.0, cents / 1200.0);
+				return true;
+			}
+
+			size_t slash = token.find('/');
+			char* end = nullptr;
+			double numerator = (double)(std::strtoull(token.c_str(), &end, 10));
+
+			if(end == token.c_str()) {
+				return false;
+			}
+
+			double denominator = 1.0;
+
+			if(slash != std::string::npos) {
+				const char* rest = token.c_str() + slash + 1;
+				denominator = (double)(std::strtoull(rest, &end, 10));
+
+				if(end == rest) {
+					return false;
+				}
+			}
+
+			if(numerator <= 0.0 || denominator <= 0.0) {
+				return false;
+			}
+
+			ratio = numerator / denominator;
+			return true;
+		}
+
+		Tuning::Tuning() {
+			SetEqualTemperament();
+		}
+
+		void Tuning::SetEqualTemperament(float reference_frequency) {
+			float scale = reference_frequency / REFERENCE_FREQUENCY;
+
+			for(uint32_t i = 0; i < NOTE_COUNT; i++) {
+				frequencies[i] = EQUAL_TEMPERAMENT.frequencies[i] * scale;
+			}
+
+			description = "12-TET";
+		}
+
+		bool Tuning::LoadScala(const std::string& path, uint8_t base_note, float base_frequency) {
+			std::ifstream file(path);
+
+			if(!file) {
+				std::cerr << "[Tuning] Error loading Scala scale\n\t";
+				std::cerr << "Reason: Couldn't open " << path << ".\n\n";
+				return false;
+			}
+
+			return ParseScala(file, base_note, base_frequency);
+		}
+
+		bool Tuning::ParseScala(std::istream& is, uint8_t base_note, float base_frequency) {
+			std::string name;
+			std::string line;
+
+			if(!ReadScalaLine(is, name) || !ReadScalaLine(is, line)) {
+				std::cerr << "[Tuning] Error loading Scala scale\n\t";
+				std::cerr << "Reason: The file ends before the number of notes.\n\n";
+				return false;
+			}
+
+			uint32_t count = (uint32_t)(std::strtoul(line.c_str(), nullptr, 10));
+
+			if(count == 0 || count > NOTE_COUNT * 8) {
+				std::cerr << "[Tuning] Error loading Scala scale\n\t";
+				std::cerr << "Reason: \"" << line << "\" isn't a usable number of notes.\n\n";
+				return false;
+			}
+
+			if(base_frequency <= 0.0f) {
+				std::cerr << "[Tuning] Error loading Scala scale\n\t";
+				std::cerr << "Reason: The base frequency must be positive.\n\n";
+				return false;
+			}
+
+			//degree 0 is always 1/1 and isn't listed; the last listed pitch is the period the scale repeats at
+			std::vector<double> ratios(1, 1.0);
+
+			for(uint32_t i = 0; i < count; i++) {
+				double ratio;
+
+				if(!ReadScalaLine(is, line) || !ParseScalaPitch(line, ratio)) {
+					std::cerr << "[Tuning] Error loading Scala scale\n\t";
+					std::cerr << "Reason: Pitch " << (i + 1) << " of " << count << " is missing or malformed.\n\n";
+					return false;
+				}
+
+				ratios.push_back(ratio);
+			}
+
+			double period = ratios[count];
+
+			for(uint32_t i = 0; i < NOTE_COUNT; i++) {
+				int32_t steps = (int32_t)(i) - (int32_t)(base_note & 0x7F);
+				int32_t periods = (steps >= 0) ? (steps / (int32_t)(count)) : -((-steps + (int32_t)(count) - 1) / (int32_t)(count));
+				int32_t degree = steps - periods * (int32_t)(count);
+
+				frequencies[i] = (float)(base_frequency * std::pow(period, (double)(periods)) * ratios[degree]);
+			}
+
+			size_t start = name.find_first_not_of(" \t");
+			description = (start == std::string::npos) ? std::string() : name.substr(start);
+
+			return true;
+		}
+
+		uint8_t Tuning::GetClosestNote(float frequency) const {
+			if(frequency <= 0.0f) {
+				return 0;
+			}
+
+			//scales needn't rise monotonically, so every note is checked; comparing ratios keeps it free of logarithms
+			uint8_t closest = 0;
+			float best = 0.0f;
+
+			for(uint32_t i = 0; i < NOTE_COUNT; i++) {
+				float ratio = (frequencies[i] > frequency) ? (frequencies[i] / frequency) : (frequency / frequencies[i]);
+
+				if(i == 0 || ratio < best) {
+					best = ratio;
+					closest = (uint8_t)(i);
+				}
+			}
+
+			return closest;
+		}
+
+		const std::string& Tuning::GetDescription() const {
+			return description;
+		}
+
+	}
+}
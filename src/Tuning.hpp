@@ -0,0 +1,95 @@
+#ifndef TUNING_HPP
+#define TUNING_HPP
+
+#include <cstdint>
+#include <istream>
+#include <string>
+
+namespace geiger {
+	namespace midi {
+
+		//MIDI note numbers run from 0 to 127, with A4 (69) at concert pitch
+		const uint32_t NOTE_COUNT = 128;
+		const uint8_t REFERENCE_NOTE = 69;
+		const float REFERENCE_FREQUENCY = 440.0f;
+
+		namespace detail {
+
+			//2^x for the table below; std::pow isn't constexpr, so this splits off the integer part and sums the series for the rest
+			constexpr double ConstexprExp2(double x) {
+				double scale = 1.0;
+
+				while(x >= 1.0) {
+					scale *= 2.0;
+					x -= 1.0;
+				}
+
+				while(x < 0.0) {
+					scale *= 0.5;
+					x += 1.0;
+				}
+
+				//e^(x ln 2) with x in [0, 1); thirty terms are well past double precision
+				double y = x * 0.69314718055994530942;
+				double term = 1.0;
+				double sum = 1.0;
+
+				for(uint32_t k = 1; k < 30; k++) {
+					term *= y / (double)(k);
+					sum += term;
+				}
+
+				return scale * sum;
+			}
+
+			struct FrequencyTable {
+				float frequencies[NOTE_COUNT];
+
+				constexpr FrequencyTable() : frequencies{} {
+					for(uint32_t i = 0; i < NOTE_COUNT; i++) {
+						frequencies[i] = (float)(REFERENCE_FREQUENCY * ConstexprExp2(((double)(i) - REFERENCE_NOTE) / 12.0));
+					}
+				}
+			};
+
+		}
+
+		//twelve-tone equal temperament, built by the compiler
+		constexpr detail::FrequencyTable EQUAL_TEMPERAMENT{};
+
+		constexpr float EqualTemperedFrequency(uint8_t note) {
+			return EQUAL_TEMPERAMENT.frequencies[note & 0x7F];
+		}
+
+		//a frequency for every MIDI note, worked out once so playing a note is a single lookup
+		//equal temperament by default; a Scala scale (.scl) can replace it, laid out across the keyboard from a base note
+		class Tuning
+		{
+			public:
+				Tuning();
+
+				//equal temperament with A4 at 'reference_frequency'
+				void SetEqualTemperament(float reference_frequency = REFERENCE_FREQUENCY);
+
+				//degree 0 of the scale sounds at 'base_frequency' on 'base_note', and the scale repeats every period from there
+				//on failure the tuning is left as it was
+				bool LoadScala(const std::string& path, uint8_t base_note = 60, float base_frequency = EqualTemperedFrequency(60));
+				bool ParseScala(std::istream& is, uint8_t base_note = 60, float base_frequency = EqualTemperedFrequency(60));
+
+				float GetFrequency(uint8_t note) const { return frequencies[note & 0x7F]; }
+
+				//the note whose pitch is nearest 'frequency', measured as a ratio rather than in hertz
+				uint8_t GetClosestNote(float frequency) const;
+
+				//the scale file's description line, or "12-TET"
+				const std::string& GetDescription() const;
+
+			private:
+				float frequencies[NOTE_COUNT];
+				std::string description;
+		};
+
+	}
+}
+
+#endif // TUNING_HPP
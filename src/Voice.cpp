@@ -0,0 +1,612 @@
+#include "Voice.hpp"
+#include "AudioKernels.hpp"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEIGER_VOICE_SSE2
+#endif
+
+namespace geiger {
+	namespace midi {
+
+		//samples of wave a WaveVoice works out before shaping and mixing them in
+		static const uint32_t WAVE_CHUNK = 256;
+
+		WaveVoice::WaveVoice() {
+			wave = WaveSynth::SIN;
+			rate = 44100;
+			phase = 0.0;
+			phase_increment = 0.0;
+			amplitude = 0.0f;
+			active = false;
+		}
+
+		WaveVoice::WaveVoice(WaveSynth::WAVE_TYPE type, float release_seconds) {
+			wave = type;
+			rate = 44100;
+			phase = 0.0;
+			phase_increment = 0.0;
+			amplitude = 0.0f;
+			active = false;
+
+			SetReleaseTime(release_seconds);
+		}
+
+		WaveVoice::~WaveVoice() {}
+
+		void WaveVoice::SetWaveType(WaveSynth::WAVE_TYPE type) {
+			wave = type;
+		}
+
+		void WaveVoice::SetReleaseTime(float seconds) {
+			Envelope::Settings settings = envelope.GetSettings();
+			settings.release = seconds;
+			envelope.SetSettings(settings);
+		}
+
+		void WaveVoice::SetEnvelope(const Envelope::Settings& settings) {
+			envelope.SetSettings(settings);
+		}
+
+		const Envelope::Settings& WaveVoice::GetEnvelope() const {
+			return envelope.GetSettings();
+		}
+
+		void WaveVoice::SetSampleRate(uint32_t sample_rate) {
+			if(sample_rate == 0) {
+				return;
+			}
+
+			if(rate != sample_rate) {
+				phase_increment = phase_increment * rate / sample_rate;
+			}
+
+			rate = sample_rate;
+			envelope.SetSampleRate(rate);
+		}
+
+		void WaveVoice::NoteOn(float frequency, float velocity) {
+			phase = 0.0;
+			phase_increment = (double)(frequency) / (double)(rate);
+			amplitude = velocity;
+			active = true;
+
+			//a stolen voice attacks from where it was rather than jumping to silence
+			envelope.NoteOn();
+		}
+
+		void WaveVoice::NoteOff() {
+			envelope.NoteOff();
+		}
+
+		void WaveVoice::Kill() {
+			active = false;
+			envelope.Reset();
+		}
+
+		void WaveVoice::Render(float* buffer, uint32_t frames) {
+			if(!active) {
+				return;
+			}
+
+			//the wave is worked out a chunk at a time, shaped by the envelope in one multiply, then mixed in
+			float wave_block[WAVE_CHUNK];
+
+			for(uint32_t done = 0; done < frames; ) {
+				uint32_t count = (frames - done < WAVE_CHUNK) ? (frames - done) : WAVE_CHUNK;
+
+				for(uint32_t i = 0; i < count; i++) {
+					float p = (float)(phase);
+					float value;
+
+					switch(wave) {
+						case WaveSynth::SQR: {
+							value = (p < 0.5f) ? 1.0f : -1.0f;
+							break;
+						}
+
+						case WaveSynth::TRI: {
+							float sawtooth = 2.0f * p - 1.0f;
+							value = 2.0f * std::abs(sawtooth) - 1.0f;
+							break;
+						}
+
+						case WaveSynth::SAW: {
+							value = 2.0f * p - 1.0f;
+							break;
+						}
+
+						default: {
+							value = std::sin(2.0f * (float)(M_PI) * p);
+							break;
+						}
+					}
+
+					wave_block[i] = value;
+
+					phase += phase_increment;
+					if(phase >= 1.0) {
+						phase -= 1.0;
+					}
+				}
+
+				bool sounding = envelope.Apply(wave_block, count);
+				MixBufferWithGain(buffer + done, wave_block, amplitude, count);
+
+				//the release has finished, so the voice costs nothing from here on
+				if(!sounding) {
+					Kill();
+					return;
+				}
+
+				done += count;
+			}
+		}
+
+		bool WaveVoice::IsActive() const {
+			return active;
+		}
+
+		bool WaveVoice::IsReleased() const {
+			return envelope.IsReleased();
+		}
+
+		float WaveVoice::Level() const {
+			return active ? (amplitude * envelope.GetLevel()) : 0.0f;
+		}
+
+		StringVoice::StringVoice() {
+			rate = 44100;
+			number_of_harmonics = 18;
+			harmonics_used = 0;
+			damping_ratio = 1.0f;
+			release_damping = 20.0f;
+			pluck_position = 0.23f;
+			frequency = 0.0f;
+			level = 0.0f;
+			level_decay = 1.0f;
+			note_cache = nullptr;
+			cached_position = 0;
+			cached_end = 0;
+			handoff_length = 0;
+			handoff_remaining = 0;
+			velocity = 0.0f;
+			active = false;
+			released = false;
+
+			SetSilenceThreshold(DEFAULT_SILENCE_THRESHOLD);
+
+			for(uint32_t i = 0; i < MAX_HARMONICS; i++) {
+				re[i] = im[i] = initial[i] = 0.0f;
+				rot_re[i] = 1.0f;
+				rot_im[i] = 0.0f;
+			}
+		}
+
+		StringVoice::StringVoice(uint32_t harmonics, float damping, float pluck) : StringVoice() {
+			SetHarmonicCount(harmonics);
+			SetDampingRatio(damping);
+			SetPluckPosition(pluck);
+		}
+
+		StringVoice::~StringVoice() {}
+
+		void StringVoice::SetHarmonicCount(uint32_t harmonics) {
+			if(harmonics == 0) {
+				harmonics = 1;
+			}
+
+			number_of_harmonics = (harmonics > MAX_HARMONICS) ? MAX_HARMONICS : harmonics;
+		}
+
+		void StringVoice::SetDampingRatio(float gamma) {
+			if(gamma < 0.0f) {
+				return;
+			}
+
+			damping_ratio = gamma;
+		}
+
+		void StringVoice::SetReleaseDamping(float gamma) {
+			if(gamma < 0.0f) {
+				return;
+			}
+
+			release_damping = gamma;
+		}
+
+		void StringVoice::SetPluckPosition(float fraction_of_length) {
+			if(fraction_of_length <= 0.0f || fraction_of_length >= 1.0f) {
+				return;
+			}
+
+			pluck_position = fraction_of_length;
+		}
+
+		void StringVoice::SetNoteCache(NoteCache* cache) {
+			note_cache = cache;
+		}
+
+		void StringVoice::SetSampleRate(uint32_t sample_rate) {
+			if(sample_rate == 0) {
+				return;
+			}
+
+			//the cached note is at the old rate, so carry on live from where it got to
+			if(cached) {
+				SeekPhasors(cached_position);
+				cached.reset();
+			}
+
+			rate = sample_rate;
+
+			if(active) {
+				UpdateDecay(released ? (damping_ratio + release_damping) : damping_ratio);
+			}
+		}
+
+		void StringVoice::NoteOn(float freq, float velocity_) {
+			frequency = freq;
+
+			float nyquist = 0.5f * rate;
+			float amplitudes[MAX_HARMONICS];
+			float total = 0.0f;
+
+			harmonics_used = 0;
+
+			//same mode shapes as StringSynth::HarmonicAmplitude, minus the constant factors
+			for(uint32_t i = 0; i < number_of_harmonics; i++) {
+				uint32_t j = i + 1;
+
+				if(j * frequency >= nyquist) {
+					break;
+				}
+
+				amplitudes[i] = std::sin(j * M_PI * pluck_position) / (float)(j * j);
+				total += std::abs(amplitudes[i]);
+				harmonics_used++;
+			}
+
+			if(harmonics_used == 0 || total <= 0.0f) {
+				Kill();
+				return;
+			}
+
+			for(uint32_t i = 0; i < MAX_HARMONICS; i++) {
+				re[i] = initial[i] = (i < harmonics_used) ? velocity_ * (amplitudes[i] / total) : 0.0f;
+				im[i] = 0.0f;
+			}
+
+			velocity = velocity_;
+			level = velocity;
+			released = false;
+			active = true;
+
+			UpdateDecay(damping_ratio);
+
+			cached.reset();
+
+			if(!note_cache || !note_cache->IsEnabled()) {
+				return;
+			}
+
+			//the output is linear in velocity, so one render at unit velocity serves every velocity
+			NoteCache::Key key = {rate, number_of_harmonics, frequency, damping_ratio, pluck_position, silence_level};
+
+			cached = note_cache->Find(key);
+
+			if(!cached) {
+				cached = note_cache->Insert(key, RenderEntry());
+			}
+
+			if(cached->frames == 0) {
+				cached.reset();
+				return;
+			}
+
+			cached_position = 0;
+			cached_end = cached->complete ? cached->frames : cached->frames - std::min((uint32_t)(CROSSFADE_FRAMES), cached->frames);
+			handoff_length = 0;
+			handoff_remaining = 0;
+		}
+
+		void StringVoice::NoteOff() {
+			if(!active || released) {
+				return;
+			}
+
+			released = true;
+
+			//the cache only holds the unreleased note, so the release always comes from the phasors
+			if(cached && handoff_remaining == 0) {
+				BeginHandoff();
+			}
+
+			UpdateDecay(damping_ratio + release_damping);
+		}
+
+		void StringVoice::Kill() {
+			active = false;
+			released = false;
+			level = 0.0f;
+			harmonics_used = 0;
+			cached.reset();
+		}
+
+		void StringVoice::Render(float* buffer, uint32_t frames) {
+			if(!active) {
+				return;
+			}
+
+			uint32_t done = 0;
+
+			while(cached && done < frames) {
+				const NoteCache::Entry& entry = *cached;
+
+				if(handoff_remaining == 0) {
+					uint32_t count = std::min(frames - done, cached_end - cached_position);
+
+					MixBufferWithGain(buffer + done, entry.samples + cached_position, velocity, count);
+					cached_position += count;
+					done += count;
+
+					if(cached_position == cached_end) {
+						if(entry.complete) {
+							Kill();
+							return;
+						}
+
+						BeginHandoff();
+					}
+
+					continue;
+				}
+
+				float live[CROSSFADE_FRAMES] = { 0.0f };
+				uint32_t count = std::min(frames - done, handoff_remaining);
+
+				Synthesize(live, count);
+
+				for(uint32_t i = 0; i < count; i++) {
+					float w = (float)(handoff_length - handoff_remaining + i + 1) / (float)(handoff_length);
+					buffer[done + i] += (1.0f - w) * velocity * entry.samples[cached_position + i] + w * live[i];
+				}
+
+				cached_position += count;
+				handoff_remaining -= count;
+				done += count;
+
+				if(handoff_remaining == 0) {
+					cached.reset();
+				}
+			}
+
+			Synthesize(buffer + done, frames - done);
+
+			level *= std::pow(level_decay, (float)(frames));
+
+			if(level < silence_level) {
+				Kill();
+				return;
+			}
+
+			//higher harmonics die out first; drop them before they decay into denormals
+			while(harmonics_used > 1) {
+				uint32_t top = harmonics_used - 1;
+
+				if(std::abs(re[top]) + std::abs(im[top]) > harmonic_silence_level) {
+					break;
+				}
+
+				re[top] = im[top] = 0.0f;
+				harmonics_used--;
+			}
+		}
+
+		void StringVoice::Synthesize(float* buffer, uint32_t frames) {
+			//four harmonics at a time stay in registers for a whole chunk of frames, each adding its lanes into 'sums';
+			//the lanes are only added across once per frame at the end, instead of once per group of harmonics
+			//harmonics past harmonics_used are zero, so the last group can be padded out
+			static const uint32_t SYNTH_CHUNK = 64;
+			uint32_t groups = (harmonics_used + 3) / 4;
+
+			for(uint32_t done = 0; done < frames; done += SYNTH_CHUNK) {
+				uint32_t count = std::min(SYNTH_CHUNK, frames - done);
+				float* out = buffer + done;
+
+#if defined(GEIGER_VOICE_SSE2)
+				__m128 sums[SYNTH_CHUNK];
+
+				for(uint32_t n = 0; n < count; n++) {
+					sums[n] = _mm_setzero_ps();
+				}
+
+				uint32_t g = 0;
+
+				//two groups side by side, since each rotation waits on the one before it and one chain alone leaves the multipliers idle
+				for(; g + 2 <= groups; g += 2) {
+					__m128 r0 = _mm_loadu_ps(re + 4 * g);
+					__m128 m0 = _mm_loadu_ps(im + 4 * g);
+					__m128 rr0 = _mm_loadu_ps(rot_re + 4 * g);
+					__m128 ri0 = _mm_loadu_ps(rot_im + 4 * g);
+					__m128 r1 = _mm_loadu_ps(re + 4 * g + 4);
+					__m128 m1 = _mm_loadu_ps(im + 4 * g + 4);
+					__m128 rr1 = _mm_loadu_ps(rot_re + 4 * g + 4);
+					__m128 ri1 = _mm_loadu_ps(rot_im + 4 * g + 4);
+
+					for(uint32_t n = 0; n < count; n++) {
+						sums[n] = _mm_add_ps(sums[n], _mm_add_ps(r0, r1));
+
+						__m128 next0 = _mm_sub_ps(_mm_mul_ps(r0, rr0), _mm_mul_ps(m0, ri0));
+						__m128 next1 = _mm_sub_ps(_mm_mul_ps(r1, rr1), _mm_mul_ps(m1, ri1));
+						m0 = _mm_add_ps(_mm_mul_ps(r0, ri0), _mm_mul_ps(m0, rr0));
+						m1 = _mm_add_ps(_mm_mul_ps(r1, ri1), _mm_mul_ps(m1, rr1));
+						r0 = next0;
+						r1 = next1;
+					}
+
+					_mm_storeu_ps(re + 4 * g, r0);
+					_mm_storeu_ps(im + 4 * g, m0);
+					_mm_storeu_ps(re + 4 * g + 4, r1);
+					_mm_storeu_ps(im + 4 * g + 4, m1);
+				}
+
+				if(g < groups) {
+					__m128 r = _mm_loadu_ps(re + 4 * g);
+					__m128 m = _mm_loadu_ps(im + 4 * g);
+					__m128 rr = _mm_loadu_ps(rot_re + 4 * g);
+					__m128 ri = _mm_loadu_ps(rot_im + 4 * g);
+
+					for(uint32_t n = 0; n < count; n++) {
+						sums[n] = _mm_add_ps(sums[n], r);
+
+						__m128 next = _mm_sub_ps(_mm_mul_ps(r, rr), _mm_mul_ps(m, ri));
+						m = _mm_add_ps(_mm_mul_ps(r, ri), _mm_mul_ps(m, rr));
+						r = next;
+					}
+
+					_mm_storeu_ps(re + 4 * g, r);
+					_mm_storeu_ps(im + 4 * g, m);
+				}
+
+				uint32_t n = 0;
+
+				//four frames' lanes transposed, so one add chain gives all four totals
+				for(; n + 4 <= count; n += 4) {
+					__m128 a = sums[n];
+					__m128 b = sums[n + 1];
+					__m128 c = sums[n + 2];
+					__m128 d = sums[n + 3];
+					_MM_TRANSPOSE4_PS(a, b, c, d);
+
+					__m128 total = _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+					_mm_storeu_ps(out + n, _mm_add_ps(_mm_loadu_ps(out + n), total));
+				}
+
+				for(; n < count; n++) {
+					float lanes[4];
+					_mm_storeu_ps(lanes, sums[n]);
+					out[n] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+				}
+#else
+				float sums[SYNTH_CHUNK][4] = {};
+
+				for(uint32_t g = 0; g < groups; g++) {
+					float r[4], m[4], rr[4], ri[4];
+
+					for(uint32_t k = 0; k < 4; k++) {
+						r[k] = re[4 * g + k];
+						m[k] = im[4 * g + k];
+						rr[k] = rot_re[4 * g + k];
+						ri[k] = rot_im[4 * g + k];
+					}
+
+					for(uint32_t n = 0; n < count; n++) {
+						for(uint32_t k = 0; k < 4; k++) {
+							sums[n][k] += r[k];
+
+							float next = r[k] * rr[k] - m[k] * ri[k];
+							m[k] = r[k] * ri[k] + m[k] * rr[k];
+							r[k] = next;
+						}
+					}
+
+					for(uint32_t k = 0; k < 4; k++) {
+						re[4 * g + k] = r[k];
+						im[4 * g + k] = m[k];
+					}
+				}
+
+				for(uint32_t n = 0; n < count; n++) {
+					out[n] += (sums[n][0] + sums[n][1]) + (sums[n][2] + sums[n][3]);
+				}
+#endif
+			}
+		}
+
+		void StringVoice::SeekPhasors(uint32_t frames) {
+			double dt = 1.0 / (double)(rate);
+
+			for(uint32_t i = 0; i < harmonics_used; i++) {
+				uint32_t j = i + 1;
+				double decay = std::exp(-damping_ratio * j * frames * dt);
+				double angle = std::fmod(2.0 * M_PI * j * frequency * frames * dt, 2.0 * M_PI);
+
+				re[i] = (float)(initial[i] * decay * std::cos(angle));
+				im[i] = (float)(initial[i] * decay * std::sin(angle));
+			}
+		}
+
+		void StringVoice::BeginHandoff() {
+			SeekPhasors(cached_position);
+
+			handoff_length = std::min((uint32_t)(CROSSFADE_FRAMES), cached->frames - cached_position);
+			handoff_remaining = handoff_length;
+
+			if(handoff_remaining == 0) {
+				cached.reset();
+			}
+		}
+
+		std::shared_ptr<const NoteCache::Entry> StringVoice::RenderEntry() const {
+			uint32_t frames = (uint32_t)(note_cache->GetMaxSeconds() * rate);
+			std::shared_ptr<NoteCache::Entry> entry = std::make_shared<NoteCache::Entry>((frames > 0) ? frames : 1);
+
+			//a copy of this voice plays the note on its own, in the blocks the voices usually get
+			StringVoice scratch(*this);
+			scratch.note_cache = nullptr;
+			scratch.cached.reset();
+			scratch.NoteOn(frequency, 1.0f);
+
+			uint32_t done = 0;
+
+			while(done < entry->frames && scratch.active) {
+				uint32_t count = std::min(entry->frames - done, (uint32_t)(1024));
+				scratch.Render(entry->samples + done, count);
+				done += count;
+			}
+
+			if(!scratch.active) {
+				entry->frames = done;
+				entry->complete = true;
+			}
+
+			return entry;
+		}
+
+		bool StringVoice::IsActive() const {
+			return active;
+		}
+
+		bool StringVoice::IsReleased() const {
+			return released;
+		}
+
+		float StringVoice::Level() const {
+			return active ? level : 0.0f;
+		}
+
+		void StringVoice::SetSilenceThreshold(float decibels) {
+			silence_level = DecibelsToAmplitude(decibels);
+			harmonic_silence_level = silence_level / MAX_HARMONICS;
+		}
+
+		void StringVoice::UpdateDecay(float gamma) {
+			double dt = 1.0 / (double)(rate);
+
+			for(uint32_t i = 0; i < harmonics_used; i++) {
+				uint32_t j = i + 1;
+				double omega = 2.0 * M_PI * j * frequency * dt;
+				double decay = std::exp(-gamma * j * dt);
+
+				rot_re[i] = (float)(decay * std::cos(omega));
+				rot_im[i] = (float)(decay * std::sin(omega));
+			}
+
+			//harmonic j decays as exp(-gamma * j * t), so the fundamental bounds them all
+			level_decay = (float)(std::exp(-gamma * dt));
+		}
+
+	}
+}
@@ -0,0 +1,169 @@
+#ifndef VOICE_HPP
+#define VOICE_HPP
+
+#include "Synth.hpp"
+#include "WaveSynth.hpp"
+#include "NoteCache.hpp"
+#include "Envelope.hpp"
+
+namespace geiger {
+	namespace midi {
+
+		//a single sounding note owned by a polyphonic instrument
+		//voices are allocated up front and reused, so none of these calls may allocate
+		class Voice
+		{
+			public:
+				virtual ~Voice() {}
+
+				virtual void SetSampleRate(uint32_t sample_rate) = 0;
+
+				virtual void NoteOn(float frequency, float velocity) = 0;
+				virtual void NoteOff() = 0;
+				virtual void Kill() = 0;
+
+				//adds the next 'frames' samples of this voice into the buffer
+				virtual void Render(float* buffer, uint32_t frames) = 0;
+
+				virtual bool IsActive() const = 0;
+				virtual bool IsReleased() const = 0;
+
+				//an upper bound on the current output amplitude, used to pick voices to steal
+				virtual float Level() const = 0;
+
+				//decaying voices switch themselves off once Level() falls below this many dB
+				virtual void SetSilenceThreshold(float) {}
+		};
+
+		class WaveVoice : public Voice
+		{
+			public:
+				WaveVoice();
+				WaveVoice(WaveSynth::WAVE_TYPE type, float release_seconds = 0.01f);
+				virtual ~WaveVoice();
+
+				void SetWaveType(WaveSynth::WAVE_TYPE type);
+				void SetReleaseTime(float seconds);
+
+				//the whole envelope; the voice switches itself off as soon as its release finishes
+				void SetEnvelope(const Envelope::Settings& settings);
+				const Envelope::Settings& GetEnvelope() const;
+
+				virtual void SetSampleRate(uint32_t sample_rate) override;
+
+				virtual void NoteOn(float frequency, float velocity) override;
+				virtual void NoteOff() override;
+				virtual void Kill() override;
+
+				virtual void Render(float* buffer, uint32_t frames) override;
+
+				virtual bool IsActive() const override;
+				virtual bool IsReleased() const override;
+				virtual float Level() const override;
+
+			private:
+				WaveSynth::WAVE_TYPE wave;
+				uint32_t rate;
+
+				//phase is kept in cycles (0 to 1) and advanced incrementally
+				double phase;
+				double phase_increment;
+
+				float amplitude;
+				Envelope envelope;
+
+				bool active;
+		};
+
+		class StringVoice : public Voice
+		{
+			public:
+				static const uint32_t MAX_HARMONICS = 32;
+
+				StringVoice();
+				StringVoice(uint32_t harmonics, float damping_ratio = 1.0f, float pluck_position = 0.23f);
+				virtual ~StringVoice();
+
+				void SetHarmonicCount(uint32_t harmonics);
+				void SetDampingRatio(float gamma);
+				void SetReleaseDamping(float gamma);
+				void SetPluckPosition(float fraction_of_length);
+
+				//notes are played back from the cache while it's enabled, rendering them into it on a miss
+				//a miss allocates, so leave this null (the default) for voices on the audio thread
+				void SetNoteCache(NoteCache* cache);
+
+				virtual void SetSampleRate(uint32_t sample_rate) override;
+
+				virtual void NoteOn(float frequency, float velocity) override;
+				virtual void NoteOff() override;
+				virtual void Kill() override;
+
+				virtual void Render(float* buffer, uint32_t frames) override;
+
+				virtual bool IsActive() const override;
+				virtual bool IsReleased() const override;
+				virtual float Level() const override;
+
+				virtual void SetSilenceThreshold(float decibels) override;
+
+			private:
+				//the switch from a cached note to live synthesis fades between the two over this many samples
+				static const uint32_t CROSSFADE_FRAMES = 64;
+
+				void UpdateDecay(float gamma);
+
+				//adds the phasors' next 'frames' samples into the buffer
+				void Synthesize(float* buffer, uint32_t frames);
+
+				//sets the phasors to where they'd be 'frames' samples into the unreleased note
+				void SeekPhasors(uint32_t frames);
+
+				//starts the crossfade from the cached note into live synthesis at the current position
+				void BeginHandoff();
+
+				//this voice's current note at unit velocity, as long as the cache keeps notes
+				std::shared_ptr<const NoteCache::Entry> RenderEntry() const;
+
+				uint32_t rate;
+				uint32_t number_of_harmonics;
+				uint32_t harmonics_used;
+
+				float damping_ratio;
+				float release_damping;
+				float pluck_position;
+				float frequency;
+
+				//each harmonic is a decaying phasor (re, im) rotated by (rot_re, rot_im) every sample,
+				//which replaces the per-sample cos() and exp() of StringSynth::Value
+				float re[MAX_HARMONICS];
+				float im[MAX_HARMONICS];
+				float initial[MAX_HARMONICS];
+				float rot_re[MAX_HARMONICS];
+				float rot_im[MAX_HARMONICS];
+
+				//sum of the harmonic amplitudes times the slowest harmonic's decay
+				float level;
+				float level_decay;
+
+				//the voice stops below silence_level, and single harmonics are dropped below harmonic_silence_level
+				float silence_level;
+				float harmonic_silence_level;
+
+				//the note being played back; cached_end is where playback hands over to the phasors, or stops if the entry is complete
+				NoteCache* note_cache;
+				std::shared_ptr<const NoteCache::Entry> cached;
+				uint32_t cached_position;
+				uint32_t cached_end;
+				uint32_t handoff_length;
+				uint32_t handoff_remaining;
+				float velocity;
+
+				bool active;
+				bool released;
+		};
+
+	}
+}
+
+#endif // VOICE_HPP
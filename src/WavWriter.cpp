@@ -0,0 +1,236 @@
+#include "WavWriter.hpp"
+#include <cstring>
+#include <iostream>
+
+namespace geiger {
+	namespace midi {
+
+		//samples are converted this many frames at a time, so memory use doesn't grow with the block size
+		static const uint32_t ENCODE_FRAMES = 4096;
+
+		static const uint16_t WAVE_FORMAT_PCM = 1;
+		static const uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+
+		//WAV is little-endian regardless of the machine writing it
+		static void PutLE(char* out, uint32_t value, uint32_t bytes) {
+			for(uint32_t i = 0; i < bytes; i++) {
+				out[i] = (char)((value >> (8 * i)) & 0xFF);
+			}
+		}
+
+		static void WriteLE(std::ostream& os, uint32_t value, uint32_t bytes) {
+			char buf[4];
+			PutLE(buf, value, bytes);
+			os.write(buf, bytes);
+		}
+
+		static float Clamp(float s) {
+			return (s > 1.0f) ? 1.0f : ((s < -1.0f) ? -1.0f : s);
+		}
+
+		WavWriter::WavWriter() {
+			format = PCM_16;
+			rate = 0;
+			channel_count = 0;
+			bytes_per_sample = 0;
+			frames_written = 0;
+			data_bytes = 0;
+			riff_size_position = 0;
+			fact_position = 0;
+			data_size_position = 0;
+		}
+
+		WavWriter::WavWriter(const std::string& path, uint32_t sample_rate, uint16_t channels, SAMPLE_FORMAT fmt) : WavWriter() {
+			Open(path, sample_rate, channels, fmt);
+		}
+
+		WavWriter::~WavWriter() {
+			Close();
+		}
+
+		bool WavWriter::Open(const std::string& path, uint32_t sample_rate, uint16_t channels, SAMPLE_FORMAT fmt) {
+			Close();
+
+			if(sample_rate == 0 || channels == 0) {
+				std::cerr << "[WavWriter] Error opening " << path << "\n\t";
+				std::cerr << "Reason: Sample rate and channel count must be non-zero.\n\n";
+				return false;
+			}
+
+			file.open(path, std::ios::out | std::ios::trunc | std::ios::binary);
+
+			if(!file) {
+				std::cerr << "[WavWriter] Error opening " << path << "\n\t";
+				std::cerr << "Reason: The file could not be created.\n\n";
+				return false;
+			}
+
+			format = fmt;
+			rate = sample_rate;
+			channel_count = channels;
+			bytes_per_sample = (format == PCM_16) ? 2 : ((format == PCM_24) ? 3 : 4);
+			frames_written = 0;
+			data_bytes = 0;
+
+			encoded.assign((size_t)(ENCODE_FRAMES) * channel_count * bytes_per_sample, 0);
+
+			WriteHeader();
+
+			return (bool)(file);
+		}
+
+		bool WavWriter::Write(const float* samples, uint32_t frames) {
+			if(!file.is_open()) {
+				return false;
+			}
+
+			uint32_t done = 0;
+
+			while(done < frames) {
+				uint32_t count = (frames - done < ENCODE_FRAMES) ? (frames - done) : ENCODE_FRAMES;
+				uint32_t sample_count = count * channel_count;
+				const float* in = samples + (size_t)(done) * channel_count;
+				char* out = encoded.data();
+
+				switch(format) {
+					case PCM_16: {
+						for(uint32_t i = 0; i < sample_count; i++) {
+							int32_t v = (int32_t)(std::lrint(Clamp(in[i]) * 32767.0f));
+							PutLE(out + 2 * i, (uint32_t)(v), 2);
+						}
+						break;
+					}
+
+					case PCM_24: {
+						for(uint32_t i = 0; i < sample_count; i++) {
+							int32_t v = (int32_t)(std::lrint(Clamp(in[i]) * 8388607.0f));
+							PutLE(out + 3 * i, (uint32_t)(v), 3);
+						}
+						break;
+					}
+
+					default: {
+						for(uint32_t i = 0; i < sample_count; i++) {
+							uint32_t bits;
+							std::memcpy(&bits, &in[i], sizeof(bits));
+							PutLE(out + 4 * i, bits, 4);
+						}
+						break;
+					}
+				}
+
+				uint32_t bytes = sample_count * bytes_per_sample;
+				file.write(out, bytes);
+
+				if(!file) {
+					std::cerr << "[WavWriter] Error writing audio data\n\t";
+					std::cerr << "Reason: Output stream failure.\n\n";
+					return false;
+				}
+
+				data_bytes += bytes;
+				frames_written += count;
+				done += count;
+			}
+
+			return true;
+		}
+
+		bool WavWriter::Write(const SoundSample& sample) {
+			if(sample.sample_rate != rate) {
+				std::cerr << "[WavWriter] Error writing SoundSample\n\t";
+				std::cerr << "Reason: Sample rate " << sample.sample_rate << " does not match the file's rate of " << rate << ".\n\n";
+				return false;
+			}
+
+			if(sample.channels != channel_count) {
+				std::cerr << "[WavWriter] Error writing SoundSample\n\t";
+				std::cerr << "Reason: The sample has " << sample.channels << " channels but the file has " << channel_count << ".\n\n";
+				return false;
+			}
+
+			return Write(sample.audio_buffer, sample.GetFrameCount());
+		}
+
+		bool WavWriter::Close() {
+			if(!file.is_open()) {
+				return false;
+			}
+
+			//a data chunk must have an even length
+			if(data_bytes % 2 != 0) {
+				file.put(0);
+			}
+
+			uint64_t riff_size = (uint64_t)(file.tellp()) - 8;
+
+			if(riff_size > 0xFFFFFFFFull) {
+				std::cerr << "[WavWriter] Error finishing WAV file\n\t";
+				std::cerr << "Reason: More than 4GB of audio was written; the size fields are truncated.\n\n";
+				riff_size = 0xFFFFFFFFull;
+			}
+
+			uint32_t data_size = (data_bytes > 0xFFFFFFFFull) ? 0xFFFFFFFFu : (uint32_t)(data_bytes);
+
+			file.seekp(riff_size_position);
+			WriteLE(file, (uint32_t)(riff_size), 4);
+
+			if(fact_position != 0) {
+				file.seekp(fact_position);
+				WriteLE(file, (frames_written > 0xFFFFFFFFull) ? 0xFFFFFFFFu : (uint32_t)(frames_written), 4);
+			}
+
+			file.seekp(data_size_position);
+			WriteLE(file, data_size, 4);
+
+			bool ok = (bool)(file);
+			file.close();
+
+			return ok;
+		}
+
+		bool WavWriter::IsOpen() const {
+			return file.is_open();
+		}
+
+		uint64_t WavWriter::GetFramesWritten() const {
+			return frames_written;
+		}
+
+		void WavWriter::WriteHeader() {
+			uint16_t block_align = channel_count * bytes_per_sample;
+			bool is_float = (format == FLOAT_32);
+
+			file.write("RIFF", 4);
+			riff_size_position = file.tellp();
+			WriteLE(file, 0, 4);
+			file.write("WAVE", 4);
+
+			//non-PCM formats carry a cbSize field and need a fact chunk
+			file.write("fmt ", 4);
+			WriteLE(file, is_float ? 18 : 16, 4);
+			WriteLE(file, is_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM, 2);
+			WriteLE(file, channel_count, 2);
+			WriteLE(file, rate, 4);
+			WriteLE(file, rate * block_align, 4);
+			WriteLE(file, block_align, 2);
+			WriteLE(file, bytes_per_sample * 8, 2);
+
+			if(is_float) {
+				WriteLE(file, 0, 2);
+
+				file.write("fact", 4);
+				WriteLE(file, 4, 4);
+				fact_position = file.tellp();
+				WriteLE(file, 0, 4);
+			} else {
+				fact_position = 0;
+			}
+
+			file.write("data", 4);
+			data_size_position = file.tellp();
+			WriteLE(file, 0, 4);
+		}
+
+	}
+}
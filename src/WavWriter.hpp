@@ -0,0 +1,63 @@
+#ifndef WAVWRITER_HPP
+#define WAVWRITER_HPP
+
+#include "Synth.hpp"
+#include <fstream>
+#include <string>
+
+namespace geiger {
+	namespace midi {
+
+		//writes a WAV file incrementally from blocks of float samples
+		//the RIFF and data sizes are unknown until the last block, so Close() seeks back and patches them
+		class WavWriter
+		{
+			public:
+
+				enum SAMPLE_FORMAT {
+					PCM_16 = 0,
+					PCM_24,
+					FLOAT_32
+				};
+
+				WavWriter();
+				WavWriter(const std::string& path, uint32_t sample_rate, uint16_t channels = 1, SAMPLE_FORMAT format = PCM_16);
+				~WavWriter();
+
+				WavWriter(const WavWriter&) = delete;
+				WavWriter& operator=(const WavWriter&) = delete;
+
+				bool Open(const std::string& path, uint32_t sample_rate, uint16_t channels = 1, SAMPLE_FORMAT format = PCM_16);
+
+				//samples are interleaved, 'frames' samples per channel
+				bool Write(const float* samples, uint32_t frames);
+				bool Write(const SoundSample& sample);
+
+				bool Close();
+
+				bool IsOpen() const;
+				uint64_t GetFramesWritten() const;
+
+			private:
+				void WriteHeader();
+
+				std::ofstream file;
+				std::vector<char> encoded;
+
+				SAMPLE_FORMAT format;
+				uint32_t rate;
+				uint16_t channel_count;
+				uint16_t bytes_per_sample;
+
+				uint64_t frames_written;
+				uint64_t data_bytes;
+
+				std::streamoff riff_size_position;
+				std::streamoff fact_position;
+				std::streamoff data_size_position;
+		};
+
+	}
+}
+
+#endif // WAVWRITER_HPP
@@ -1,27 +1,29 @@
 #include "WaveSynth.hpp"
+#include "AudioEngine.hpp"
 #include <limits>
+#include <thread>
+#include <chrono>
 
 namespace geiger {
 	namespace midi {
 
-		WaveSynth::WaveSynth() : volume_adjusting{false}
+		WaveSynth::WaveSynth() : wave{SIN}, frequency{440.0f}, amplitude{0.5f}, envelope_snapshot{Envelope().GetSettings()}, gate{false}, sounding{false}
 		{
+			envelope_settings = envelope.GetSettings();
 			paused = false;
 			stopped = true;
 
-			wave = SIN;
-			frequency = 440.0f;
-			amplitude = 0.5f;
+			samples_elapsed = 0;
+			phase = 0.0;
 		}
 
-		WaveSynth::WaveSynth(WAVE_TYPE type, float freq, float volume) {
+		WaveSynth::WaveSynth(WAVE_TYPE type, float freq, float volume) : wave{type}, frequency{freq}, amplitude{volume}, envelope_snapshot{Envelope().GetSettings()}, gate{false}, sounding{false} {
+			envelope_settings = envelope.GetSettings();
 			paused = false;
 			stopped = true;
 
-			wave = type;
-			frequency = freq;
-			amplitude = volume;
-
+			samples_elapsed = 0;
+			phase = 0.0;
 		}
 
 		WaveSynth::~WaveSynth()
@@ -37,113 +39,104 @@ namespace geiger {
 			frequency = freq;
 		}
 
+		void WaveSynth::SetEnvelope(const Envelope::Settings& settings) {
+			//the envelope tidies the settings up; publishing its copy keeps both sides agreeing
+			Envelope shaped(settings);
+
+			envelope_settings = shaped.GetSettings();
+			envelope_snapshot.Publish(envelope_settings);
+		}
+
+		Envelope::Settings WaveSynth::GetEnvelope() const {
+			return envelope_settings;
+		}
+
 		void WaveSynth::PlayWave(WAVE_TYPE type, float freq, float volume, uint32_t samp_rate, int32_t dur_milli) {
 
 			if(!stopped) {
 				Stop();
 			}
 
-			float dur_second = (samp_rate / 1000.0f) * (float)(dur_milli);
-
 			wave = type;
 			frequency = freq;
-			amplitude = volume;
+			amplitude.Set(volume);
+
+			samples_elapsed = 0;
 
 			Play();
 
-			//this gets modified in another thread through a pointer
-			while(time_elapsed < dur_second);
+			//a negative duration plays until Stop() is called
+			if(dur_milli < 0) {
+				return;
+			}
+
+			uint64_t duration = ((uint64_t)(samp_rate) * (uint64_t)(dur_milli)) / 1000;
+
+			//the audio thread advances this once per block
+			while(!stopped && samples_elapsed.load(std::memory_order_relaxed) < duration) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
 
 			Stop();
 		}
 
 		float WaveSynth::Value(float t) {
-            switch(wave) {
+			double cycles = (double)(t) * frequency.load(std::memory_order_relaxed);
+
+			return amplitude.GetTarget() * Waveform(cycles - std::floor(cycles));
+		}
+
+		float WaveSynth::Waveform(double phase) const {
+			switch(wave.load(std::memory_order_relaxed)) {
 				case SIN: {
-					float omega = 2 * M_PI * frequency;
-					return amplitude * std::sin(omega * t);
+					return (float)(std::sin(2.0 * M_PI * phase));
 				}
 
 				case SQR: {
-					float omega = 2 * M_PI * frequency;
-					return amplitude * sign(std::sin(omega * t));
+					return sign(std::sin(2.0 * M_PI * phase));
 				}
 
 				case TRI: {
-					float period = 1.0f/frequency;
-					float a = period / 2;
-					float sawtooth = 2 * ((t/a) - (int32_t)((t/a) + 1.0f/2.0f));
-					return (amplitude * (2 * std::abs(sawtooth) - 1.0f));
+					//phase measured in half periods, as the sawtooth below is
+					float x = (float)(2.0 * phase);
+					float sawtooth = 2 * (x - (int32_t)(x + 1.0f/2.0f));
+					return (2 * std::abs(sawtooth) - 1.0f);
 				}
 
 				case SAW: {
-					float period = 1.0f/frequency;
-					float a = period / 2;
-					float sawtooth = 2 * ((t/a) - (int32_t)(1.0f/2.0f + t/a));
-					return amplitude * sawtooth;
+					float x = (float)(2.0 * phase);
+					float sawtooth = 2 * (x - (int32_t)(1.0f/2.0f + x));
+					return sawtooth;
 				}
 
 				default: {
-					float omega = 2 * M_PI * frequency;
-					return amplitude * std::sin(omega * t);
+					return (float)(std::sin(2.0 * M_PI * phase));
 				}
 			}
 		}
 
 		SoundSample WaveSynth::GenerateSample(uint32_t samp_rate, uint32_t duration_milliseconds, int32_t offset_milliseconds) {
-            SoundSample sample{samp_rate, duration_milliseconds};
+            SoundSample sample{samp_rate, duration_milliseconds, false};
 
-			float offset_t = (float)(offset_milliseconds) / (float)(samp_rate);
-			float dt = 1.0f / (float)(samp_rate);
+			if(sample.buffer_length == 0) {
+				return sample;
+			}
 
-			switch(wave) {
-				case SIN: {
-					float omega = 2 * M_PI * frequency;
-					for(size_t i = 0; i < sample.buffer_length; i++) {
-						float t = (i * dt) + offset_t;
-						sample.audio_buffer[i] = (amplitude * std::sin(omega * t));
-					}
-					break;
-				}
+			float amplitude = this->amplitude.GetTarget();
+			double increment = (double)(frequency.load(std::memory_order_relaxed)) / (double)(samp_rate);
 
-				case SQR: {
-					float omega = 2 * M_PI * frequency;
-					for(size_t i = 0; i < sample.buffer_length; i++) {
-						float t = (i * dt) + offset_t;
-						sample.audio_buffer[i] = (amplitude * sign(std::sin(omega * t)));
-					}
-					break;
-				}
+			//the same accumulator RenderBlock uses, started from the offset's sample
+			uint64_t start = (offset_milliseconds > 0) ? ((uint64_t)(samp_rate) * offset_milliseconds) / 1000 : 0;
+			double phase = (double)(start) * increment;
+			phase -= std::floor(phase);
 
-				case TRI: {
-					float period = 1.0f/frequency;
-					float a = period / 2;
-					for(size_t i = 0; i < sample.buffer_length; i++) {
-						float t = (i * dt) + offset_t;
-						float sawtooth = 2 * ((t/a) - (int32_t)((t/a) + 1.0f/2.0f));
-						sample.audio_buffer[i] = (amplitude * (2 * std::abs(sawtooth) - 1.0f));
-					}
-					break;
-				}
+			for(size_t i = 0; i < sample.buffer_length; i++) {
+				sample.audio_buffer[i] = amplitude * Waveform(phase);
 
-				case SAW: {
-					float period = 1.0f/frequency;
-					float a = period / 2;
-					for(size_t i = 0; i < sample.buffer_length; i++) {
-						float t = (i * dt) + offset_t;
-						float sawtooth = 2 * ((t/a) - (int32_t)(1.0f/2.0f + t/a));
-						sample.audio_buffer[i] = (amplitude * sawtooth);
-					}
-					break;
-				}
+				phase += increment;
 
-				default: {
-					float omega = 2 * M_PI * frequency;
-					for(size_t i = 0; i < sample.buffer_length; i++) {
-						float t = (i * dt) + offset_t;
-						sample.audio_buffer[i] = (amplitude * std::sin(omega * t));
-					}
-					break;
+				if(phase >= 1.0) {
+					phase -= std::floor(phase);
 				}
 			}
 
@@ -154,43 +147,60 @@ namespace geiger {
 
 			float frequency = NoteToFrequency(n);
 
-            PlayWave(SIN, frequency, amplitude);
+            PlayWave(SIN, frequency, amplitude.GetTarget());
+		}
+
+		void WaveSynth::PlayNote(uint8_t note_number) {
+			PlayWave(SIN, EqualTemperedFrequency(note_number), amplitude.GetTarget());
 		}
 
 		void WaveSynth::Pause() {
 			if(!stopped) {
-				SDL_PauseAudioDevice(device_ID, 1);
+				AudioEngine::Get().SetPaused(this, true);
 				paused = true;
 			}
 		}
 
 		void WaveSynth::Unpause() {
 			if(!stopped) {
-				SDL_PauseAudioDevice(device_ID, 0);
+				AudioEngine::Get().SetPaused(this, false);
 				paused = false;
 			}
 		}
 
 		void WaveSynth::Play() {
-			SDL_AudioSpec want;
-			want.freq = 44100;
-			want.format = AUDIO_F32SYS;
-			want.channels = 1;
-			want.samples = 4096;
-			want.callback = wavesynth_callback;
-			want.userdata = (void*)(this);
-
-			device_ID = SDL_OpenAudioDevice(NULL, 0, &want, &specification, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
-			SDL_PauseAudioDevice(device_ID, 0);
+			if(!stopped) {
+				return;
+			}
+
 			paused = false;
-			stopped = false;
+			gate = true;
+			stopped = !AudioEngine::Get().Add(this);
 		}
 
 		void WaveSynth::Stop() {
-			SDL_PauseAudioDevice(device_ID, 1);
-			SDL_CloseAudioDevice(device_ID);
+			if(stopped) {
+				return;
+			}
+
+			gate = false;
+
+			//let the release play out; a paused synth isn't rendered, and the wait is capped in case the device stalls
+			if(!paused) {
+				auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((int64_t)(envelope_settings.release * 1000.0f) + 250);
+
+				while(sounding.load(std::memory_order_acquire) && std::chrono::steady_clock::now() < deadline) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			}
+
+			AudioEngine::Get().Remove(this);
 			stopped = true;
 			paused = false;
+
+			//the engine no longer renders this synth, so the next note starts from silence
+			envelope.Reset();
+			sounding = false;
 		}
 
 		void WaveSynth::SetVolume(float percent) {
@@ -203,53 +213,53 @@ namespace geiger {
 				percent = 1.0f;
 			}
 
-			while(volume_adjusting.exchange(true));
-
-			amplitude = percent;
-
-			volume_adjusting.store(false);
+			amplitude.Set(percent);
 
 		}
 
 		float WaveSynth::GetVolume() const {
-			return amplitude;
+			return amplitude.GetTarget();
 		}
 
-		void wavesynth_callback(void* synth_, Uint8* stream_, int len_) {
-			WaveSynth* synth = (WaveSynth*)(synth_);
+		void WaveSynth::RenderBlock(float* buffer, uint32_t frames, uint32_t sample_rate) {
+			double increment = (double)(frequency.load(std::memory_order_relaxed)) / (double)(sample_rate);
 
-			float dt = 1.0f / (float)(synth->specification.freq);
+			const Envelope::Settings& settings = envelope_snapshot.Acquire();
 
-			if(synth->specification.format != AUDIO_F32SYS) {
-				if(synth->specification.format == AUDIO_S16SYS) {
-					uint16_t* stream = (uint16_t*)(stream_);
-
-					len_ = len_ / sizeof(uint16_t);
+			if(settings != envelope.GetSettings()) {
+				envelope.SetSettings(settings);
+			}
 
-					while(synth->volume_adjusting.exchange(true));
+			if(sample_rate != envelope.GetSampleRate()) {
+				envelope.SetSampleRate(sample_rate);
+			}
 
-					for(int i = 0; i < len_; i++) {
-						stream[i] = (int16_t)(synth->Value(synth->time_elapsed) * std::numeric_limits<int16_t>::max());
-						synth->time_elapsed += dt;
-					}
+			//the gate is only read here, so a note starts and stops on a block boundary
+			bool held = gate.load(std::memory_order_relaxed);
 
-					synth->volume_adjusting.store(false);
-				}
+			if(held && (!envelope.IsActive() || envelope.IsReleased())) {
+				envelope.NoteOn();
+			} else if(!held && envelope.IsActive() && !envelope.IsReleased()) {
+				envelope.NoteOff();
 			}
 
-			float* stream = (float*)(stream_);
+			//ramping the volume across the block avoids zipper noise from SetVolume
+			amplitude.BeginBlock(frames);
 
-			len_ = len_ / sizeof(float);
+			for(uint32_t i = 0; i < frames; i++) {
+				buffer[i] = amplitude.Current() * Waveform(phase);
+				amplitude.Advance();
 
-			while(synth->volume_adjusting.exchange(true));
+				phase += increment;
 
-			for(int i = 0; i < len_; i++) {
-				stream[i] = synth->Value(synth->time_elapsed);
-				synth->time_elapsed += dt;
+				if(phase >= 1.0) {
+					phase -= std::floor(phase);
+				}
 			}
 
-			synth->volume_adjusting.store(false);
+			sounding.store(envelope.Apply(buffer, frames), std::memory_order_release);
 
+			samples_elapsed.fetch_add(frames, std::memory_order_relaxed);
 		}
 	}
 }
@@ -2,10 +2,13 @@
 #define WAVESYNTH_HPP
 
 #include "Synth.hpp"
+#include "Parameter.hpp"
+#include "Envelope.hpp"
 
 namespace geiger {
 	namespace midi {
 
+		//Play() opens the envelope's gate and Stop() closes it, waiting for the release before leaving the engine
 		class WaveSynth : public Synth
 		{
 			public:
@@ -24,13 +27,19 @@ namespace geiger {
 				void SetWaveType(WAVE_TYPE type);
 				void SetFrequency(float freq);
 
+				//any thread: takes effect from the next block, including on a note that's already sounding
+				void SetEnvelope(const Envelope::Settings& settings);
+				Envelope::Settings GetEnvelope() const;
+
 				virtual float Value(float t);
 
 				void PlayWave(WAVE_TYPE type, float freq, float volume, uint32_t samp_rate = 44100, int32_t dur_milli = -1);
 
 				virtual SoundSample GenerateSample(uint32_t sample_rate, uint32_t duration_milliseconds, int32_t offset_milliseconds) override;
+				virtual void RenderBlock(float* buffer, uint32_t frames, uint32_t sample_rate) override;
 
 				virtual void PlayNote(Note n) override;
+				virtual void PlayNote(uint8_t note_number) override;
 
 				virtual void Pause() override;
 				virtual void Unpause() override;
@@ -42,25 +51,32 @@ namespace geiger {
 				virtual float GetVolume() const override;
 
 			private:
-				friend void wavesynth_callback(void* synth_, Uint8* stream_, int len_);
+				//the wave at unit amplitude, for a phase in [0, 1)
+				float Waveform(double phase) const;
 
-				WAVE_TYPE wave;
-				float frequency;
-				float amplitude;
+				//written by control threads and read by the audio thread, so none of these lock
+				std::atomic<WAVE_TYPE> wave;
+				std::atomic<float> frequency;
+				SmoothedParameter amplitude;
 
-				float time_elapsed;
+				//the control side's envelope settings, the snapshot the audio thread picks them up from,
+				//and whether the note is held; 'sounding' goes false once a release has finished
+				Envelope::Settings envelope_settings;
+				ParameterSnapshot<Envelope::Settings> envelope_snapshot;
+				std::atomic<bool> gate;
+				std::atomic<bool> sounding;
 
-				bool paused;
-				bool stopped;
+				//advanced by the audio thread once per block; PlayWave polls it
+				std::atomic<uint64_t> samples_elapsed;
 
-				SDL_AudioDeviceID device_ID;
-				SDL_AudioSpec specification;
+				//audio thread only; advanced by frequency / rate every sample, so pitch doesn't drift however long it plays
+				double phase;
+				Envelope envelope;
 
-				std::atomic<bool> volume_adjusting;
+				bool paused;
+				bool stopped;
 		};
 
-		void wavesynth_callback(void* synth_, Uint8* stream_, int len_);
-
 		template<typename T>
 		int sign(T number) {
 			if(number > 0) {